@@ -0,0 +1,281 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+/*
+ * Corpus benchmark: generates xdot graphs of several shapes and sizes and
+ * times, on each one, the parsing with both parser engines, the destruction
+ * of the parsed graph, the decoding of the render operations, the first
+ * load of a parsed graph and the update of a displayed graph with a new
+ * layout. It prints the throughput of each phase, the peak resident set
+ * size of the process and the memory used by the model, by category. The
+ * generated graphs can also be written to files, to be given to the parser
+ * benchmark or to kgraphviewer.
+ */
+
+#include "dotcorpus.h"
+#include "dotgraph.h"
+#include "dotgrammar.h"
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <kcomponentdata.h>
+#include <klocale.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QTime>
+
+#include <iostream>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace KGraphViewer;
+
+/** In MB, or 0 when unknown */
+static double peakResidentSetSize()
+{
+#ifdef Q_OS_UNIX
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+  }
+#endif
+  return 0;
+}
+
+static int elementsCount(const DotGraph& graph)
+{
+  // the nested subgraphs are also in the graph subgraphs map
+  int count = graph.nodes().size() + graph.edges().size() + graph.subgraphs().size();
+  foreach (const GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    foreach (const GraphElement* element, subgraph->content())
+    {
+      if (dynamic_cast<const GraphSubgraph*>(element) == 0)
+      {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+static void collectDrawings(const GraphElement* element, QList<QByteArray>& drawings)
+{
+  const QMap<QString,QString> attributes = element->attributes();
+  QMap<QString,QString>::const_iterator it, it_end;
+  it = attributes.constBegin(); it_end = attributes.constEnd();
+  for (; it != it_end; it++)
+  {
+    if (it.key().startsWith('_') && it.key().endsWith("draw_") && !it.value().isEmpty())
+    {
+      drawings.push_back(it.value().toAscii());
+    }
+  }
+}
+
+static void collectDrawings(const DotGraph& graph, QList<QByteArray>& drawings)
+{
+  collectDrawings(&graph, drawings);
+  foreach (const GraphNode* node, graph.nodes())
+  {
+    collectDrawings(node, drawings);
+  }
+  foreach (const GraphEdge* edge, graph.edges())
+  {
+    collectDrawings(edge, drawings);
+  }
+  foreach (const GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    collectDrawings(subgraph, drawings);
+    foreach (const GraphElement* element, subgraph->content())
+    {
+      if (dynamic_cast<const GraphSubgraph*>(element) == 0)
+      {
+        collectDrawings(element, drawings);
+      }
+    }
+  }
+}
+
+static void reportPhase(const char* phase, int elapsed, int iterations, double megabytes,
+                        double items, const char* itemsName)
+{
+  double seconds = qMax(elapsed, 1) / (1000.0 * iterations);
+  std::cout << "  " << phase << ": " << seconds * 1000 << " ms, ";
+  if (megabytes > 0)
+  {
+    std::cout << megabytes / seconds << " MB/s, ";
+  }
+  std::cout << items / seconds << " " << itemsName << "/s" << std::endl;
+}
+
+static void benchmarkCorpus(const QByteArray& content, int iterations)
+{
+  double megabytes = content.size() / (1024.0 * 1024.0);
+  const DotGraph::ParserEngine engines[] = {DotGraph::HandWrittenParser, DotGraph::SpiritParser};
+  const char* const phases[] = {"parse (handwritten)", "parse (spirit)"};
+  int elements = 0;
+  for (int e = 0; e < 2; e++)
+  {
+    int elapsed = 0;
+    int teardown = 0;
+    bool ok = true;
+    for (int i = 0; i < iterations && ok; i++)
+    {
+      DotGraph* graph = new DotGraph();
+      graph->setParserEngine(engines[e]);
+      graph->setDeferRenderOperations(true);
+      QTime timer;
+      timer.start();
+      ok = graph->parseXdot(content);
+      elapsed += timer.elapsed();
+      elements = elementsCount(*graph);
+      timer.restart();
+      delete graph;
+      teardown += timer.elapsed();
+    }
+    if (!ok)
+    {
+      std::cout << "  " << phases[e] << ": failed" << std::endl;
+      return;
+    }
+    reportPhase(phases[e], elapsed, iterations, megabytes, elements, "elements");
+    if (e == 0)
+    {
+      reportPhase("teardown", teardown, iterations, 0, elements, "elements");
+    }
+  }
+
+  DotGraph graph;
+  graph.setDeferRenderOperations(true);
+  graph.parseXdot(content);
+  QList<QByteArray> drawings;
+  collectDrawings(graph, drawings);
+  double drawingsMegabytes = 0;
+  foreach (const QByteArray& drawing, drawings)
+  {
+    drawingsMegabytes += drawing.size();
+  }
+  drawingsMegabytes /= 1024.0 * 1024.0;
+  int ops = 0;
+  QTime timer;
+  timer.start();
+  for (int i = 0; i < iterations; i++)
+  {
+    DotStringPool strings;
+    ops = 0;
+    foreach (const QByteArray& drawing, drawings)
+    {
+      DotRenderOpVec vec;
+      parse_renderop(drawing.constData(), drawing.constData() + drawing.size(), vec, &strings);
+      ops += vec.size();
+    }
+  }
+  reportPhase("parse_renderop", timer.elapsed(), iterations, drawingsMegabytes, ops, "ops");
+
+  // the first layout of a graph, moved to the empty displayed one
+  int elapsed = 0;
+  for (int i = 0; i < iterations; i++)
+  {
+    DotGraph displayed;
+    DotGraph layout;
+    layout.parseXdot(content);
+    timer.restart();
+    displayed.updateWithParsedGraph(layout);
+    elapsed += timer.elapsed();
+  }
+  reportPhase("first load", elapsed, iterations, 0, elements, "elements");
+
+  // a new layout of the displayed graph, all its elements being known
+  elapsed = 0;
+  for (int i = 0; i < iterations; i++)
+  {
+    DotGraph displayed;
+    displayed.parseXdot(content);
+    DotGraph layout;
+    layout.parseXdot(content);
+    timer.restart();
+    displayed.updateWithGraph(layout);
+    elapsed += timer.elapsed();
+  }
+  reportPhase("updateWithGraph", elapsed, iterations, 0, elements, "elements");
+  std::cout << "  peak RSS: " << peakResidentSetSize() << " MB" << std::endl;
+
+  graph.decodePendingRenderOperations();
+  std::cout << "  model memory, render operations decoded:" << std::endl;
+  foreach (const QString& line, graph.memoryUsage().report().split('\n', QString::SkipEmptyParts))
+  {
+    std::cout << "    " << line.toLocal8Bit().data() << std::endl;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  KAboutData about("kgraphviewer_corpusbenchmark", 0, ki18n("KGraphViewer corpus benchmark"), "0.1",
+                   ki18n("Measures parsing and updating generated graphs"), KAboutData::License_GPL);
+  KCmdLineArgs::init(argc, argv, &about);
+
+  KCmdLineOptions options;
+  options.add("iterations <count>", ki18n("Number of times each phase is run on each graph"), "1");
+  options.add("max-elements <count>", ki18n("Size of the largest generated graphs, from 1000 to 1000000 elements"), "100000");
+  options.add("write <directory>", ki18n("Also write the generated graphs in this directory"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  KComponentData componentData(&about);
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  int iterations = qMax(args->getOption("iterations").toInt(), 1);
+  int maxElements = qBound(1000, args->getOption("max-elements").toInt(), 1000000);
+  QString directory = args->isSet("write") ? args->getOption("write") : QString();
+
+  for (int s = 0; s < DotCorpus::shapesCount; s++)
+  {
+    for (int elements = 1000; elements <= maxElements; elements *= 10)
+    {
+      QTime timer;
+      timer.start();
+      QByteArray content = DotCorpus::generate(DotCorpus::shapes[s].shape, elements);
+      int generation = timer.elapsed();
+      std::cout << DotCorpus::shapes[s].name << ", " << elements << " elements ("
+          << content.size() / (1024.0 * 1024.0) << " MB, generated in " << generation << " ms)" << std::endl;
+      if (!directory.isEmpty())
+      {
+        QString fileName = QString("%1-%2.dot").arg(DotCorpus::shapes[s].name).arg(elements);
+        fileName.replace(' ', '-');
+        QFile file(QDir(directory).filePath(fileName));
+        if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size())
+        {
+          std::cerr << "Unable to write " << file.fileName().toLocal8Bit().data() << std::endl;
+        }
+      }
+      benchmarkCorpus(content, iterations);
+    }
+  }
+  args->clear();
+  return 0;
+}
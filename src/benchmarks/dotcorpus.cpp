@@ -0,0 +1,268 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "dotcorpus.h"
+
+#include <QtGlobal>
+
+namespace DotCorpus
+{
+
+const ShapeDescription shapes[] = {
+  {Chain, "chain"},
+  {FanOut, "fan-out"},
+  {NestedClusters, "nested clusters"},
+  {MultiEdges, "multi-edges"},
+  {LongLabels, "long labels"}
+};
+
+const int shapesCount = sizeof(shapes) / sizeof(ShapeDescription);
+
+/** Coordinates are written with one decimal, as dot does for splines */
+static QByteArray number(double d)
+{
+  return QByteArray::number(d, 'f', 1);
+}
+
+/**
+ * Writes the statements of an xdot graph. The bounding box of the graph is
+ * only known at the end, so the body is written first.
+ */
+class XdotWriter
+{
+public:
+  explicit XdotWriter(int elements) : m_body(), m_indent("\t"), m_width(0), m_height(0)
+  {
+    m_body.reserve(elements * 200);
+  }
+
+  void node(const QByteArray& name, double x, double y, const QByteArray& label = QByteArray())
+  {
+    const QByteArray& text = label.isEmpty() ? name : label;
+    double halfWidth = qMax(27.0, 3.5 * text.size() + 9);
+    m_body += m_indent + name + " [";
+    if (!label.isEmpty())
+    {
+      m_body += "label=\"" + label + "\", ";
+    }
+    m_body += "pos=\"" + number(x) + ',' + number(y) + "\", width=\"" + number(halfWidth / 36)
+        + "\", height=\"0.5\", _draw_=\"c 7 -#000000 e " + number(x) + ' ' + number(y) + ' '
+        + number(halfWidth) + " 18 \", _ldraw_=\"F 14 11 -Times-Roman c 7 -#000000 T "
+        + number(x) + ' ' + number(y - 4) + " 0 " + number(2 * halfWidth - 18) + ' '
+        + QByteArray::number(text.size()) + " -" + text + " \"];\n";
+    extend(x + halfWidth, y + 18);
+  }
+
+  /** An edge going from (x1,y1) to (x2,y2), its middle being moved right by bend */
+  void edge(const QByteArray& tail, const QByteArray& head,
+            double x1, double y1, double x2, double y2, double bend = 0)
+  {
+    double dx = (x2 - x1) / 3;
+    double dy = (y2 - y1) / 3;
+    // the spline stops where the 10 points long arrowhead starts
+    double length = qMax(qAbs(x2 - x1) + qAbs(y2 - y1), 1.0);
+    double ex = x2 - 10 * (x2 - x1) / length;
+    double ey = y2 - 10 * (y2 - y1) / length;
+    double points[] = {x1, y1, x1 + dx + bend, y1 + dy, x1 + 2 * dx + bend, y1 + 2 * dy, ex, ey};
+    QByteArray pos = "e," + number(x2) + ',' + number(y2);
+    QByteArray spline;
+    for (int i = 0; i < 8; i += 2)
+    {
+      pos += ' ' + number(points[i]) + ',' + number(points[i + 1]);
+      spline += number(points[i]) + ' ' + number(points[i + 1]) + ' ';
+    }
+    m_body += m_indent + tail + " -> " + head + " [pos=\"" + pos
+        + "\", _draw_=\"c 7 -#000000 B 4 " + spline
+        + "\", _hdraw_=\"S 5 -solid c 7 -#000000 C 7 -#000000 P 3 "
+        + number(ex - 3.5) + ' ' + number(ey) + ' ' + number(x2) + ' ' + number(y2) + ' '
+        + number(ex + 3.5) + ' ' + number(ey) + " \"];\n";
+    extend(qMax(x1, x2) + qAbs(bend), qMax(y1, y2));
+  }
+
+  void beginCluster(const QByteArray& name, double x1, double y1, double x2, double y2)
+  {
+    m_body += m_indent + "subgraph " + name + " {\n";
+    m_indent += '\t';
+    m_body += m_indent + "graph [bb=\"" + number(x1) + ',' + number(y1) + ',' + number(x2) + ',' + number(y2)
+        + "\", _draw_=\"c 7 -#000000 p 4 " + number(x1) + ' ' + number(y1) + ' ' + number(x1) + ' '
+        + number(y2) + ' ' + number(x2) + ' ' + number(y2) + ' ' + number(x2) + ' ' + number(y1) + " \"];\n";
+    extend(x2, y2);
+  }
+
+  void endCluster()
+  {
+    m_indent.chop(1);
+    m_body += m_indent + "}\n";
+  }
+
+  QByteArray finish(const char* name)
+  {
+    QByteArray bb = "0,0," + number(m_width + 8) + ',' + number(m_height + 8);
+    QByteArray content;
+    content.reserve(m_body.size() + 512);
+    content += QByteArray("digraph ") + '"' + name + "\" {\n";
+    content += "\tgraph [bb=\"" + bb + "\", _draw_=\"c 9 -#ffffffff C 9 -#ffffffff P 4 0 0 0 "
+        + number(m_height + 8) + ' ' + number(m_width + 8) + ' ' + number(m_height + 8) + ' '
+        + number(m_width + 8) + " 0 \"];\n";
+    content += "\tnode [label=\"\\N\"];\n";
+    content += m_body;
+    content += "}\n";
+    return content;
+  }
+
+private:
+  void extend(double x, double y)
+  {
+    m_width = qMax(m_width, x);
+    m_height = qMax(m_height, y);
+  }
+
+  QByteArray m_body;
+  QByteArray m_indent;
+  double m_width, m_height;
+};
+
+static QByteArray nodeName(int i)
+{
+  return 'n' + QByteArray::number(i);
+}
+
+static void chain(XdotWriter& writer, int nodes, bool longLabels)
+{
+  for (int i = 0; i < nodes; i++)
+  {
+    QByteArray label;
+    if (longLabels)
+    {
+      int length = 200 + (i * 37) % 800;
+      while (label.size() < length)
+      {
+        label += "label of node " + QByteArray::number(i) + ' ';
+      }
+      label.truncate(length);
+    }
+    writer.node(nodeName(i), 27, 18 + 72 * i, label);
+  }
+  for (int i = 1; i < nodes; i++)
+  {
+    writer.edge(nodeName(i - 1), nodeName(i), 27, 36 + 72 * (i - 1), 27, 72 * i);
+  }
+}
+
+static void fanOut(XdotWriter& writer, int leaves)
+{
+  double hubX = 27 + 54 * (leaves / 2);
+  writer.node("hub", hubX, 162);
+  for (int i = 0; i < leaves; i++)
+  {
+    writer.node(nodeName(i), 27 + 54 * i, 18);
+    writer.edge("hub", nodeName(i), hubX, 144, 27 + 54 * i, 36);
+  }
+}
+
+/**
+ * Stacks of depth clusters, each one holding two linked nodes and the next
+ * cluster of the stack. The first node of a cluster is linked to the one of
+ * the nested cluster.
+ */
+static void nestedClusters(XdotWriter& writer, int stacks, int depth)
+{
+  int cluster = 0;
+  for (int s = 0; s < stacks; s++)
+  {
+    double left = 300 * s;
+    double bottom = 144 * depth + 40;
+    for (int d = 0; d < depth; d++)
+    {
+      writer.beginCluster("cluster_" + QByteArray::number(cluster), left + 4 * d, 144 * d, left + 280 - 4 * d, bottom - 4 * d);
+      QByteArray first = 'c' + QByteArray::number(cluster) + "_0";
+      QByteArray second = 'c' + QByteArray::number(cluster) + "_1";
+      double y = 144 * d + 40;
+      writer.node(first, left + 60, y);
+      writer.node(second, left + 220, y);
+      writer.edge(first, second, left + 87, y, left + 193, y);
+      if (d > 0)
+      {
+        QByteArray outer = 'c' + QByteArray::number(cluster - 1) + "_0";
+        writer.edge(outer, first, left + 60, y - 126, left + 60, y - 18);
+      }
+      cluster++;
+    }
+    for (int d = 0; d < depth; d++)
+    {
+      writer.endCluster();
+    }
+  }
+}
+
+/** nodes in a ring, each one linked to the next one by many parallel edges */
+static void multiEdges(XdotWriter& writer, int nodes, int edges)
+{
+  for (int i = 0; i < nodes; i++)
+  {
+    writer.node(nodeName(i), 27 + 108 * i, 18);
+  }
+  for (int k = 0; k < edges; k++)
+  {
+    int i = k % nodes;
+    int j = (i + 1) % nodes;
+    int rank = k / nodes;
+    double bend = (rank % 2 == 0 ? 1 : -1) * 6 * ((rank + 1) / 2);
+    writer.edge(nodeName(i), nodeName(j), 27 + 108 * i + 27, 18, 27 + 108 * j - 27, 18, bend);
+  }
+}
+
+QByteArray generate(Shape shape, int elements)
+{
+  elements = qMax(elements, 8);
+  XdotWriter writer(elements);
+  const char* name = "corpus";
+  switch (shape)
+  {
+    case Chain:
+      chain(writer, elements / 2 + 1, false);
+      name = "chain";
+      break;
+    case FanOut:
+      fanOut(writer, elements / 2);
+      name = "fanout";
+      break;
+    case NestedClusters:
+    {
+      // a cluster, its two nodes and its two edges
+      const int depth = 16;
+      nestedClusters(writer, qMax(elements / (5 * depth), 1), depth);
+      name = "nested";
+      break;
+    }
+    case MultiEdges:
+    {
+      int nodes = qMax(elements / 20, 2);
+      multiEdges(writer, nodes, elements - nodes);
+      name = "multiedges";
+      break;
+    }
+    case LongLabels:
+      chain(writer, elements / 2 + 1, true);
+      name = "labels";
+      break;
+  }
+  return writer.finish(name);
+}
+
+}
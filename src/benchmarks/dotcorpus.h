@@ -0,0 +1,58 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+/*
+ * Synthetic xdot graphs for the benchmarks
+ */
+
+#ifndef DOT_CORPUS_H
+#define DOT_CORPUS_H
+
+#include <QByteArray>
+
+namespace DotCorpus
+{
+
+enum Shape
+{
+  Chain,          ///< each node linked to the next one
+  FanOut,         ///< one node linked to all the other ones
+  NestedClusters, ///< stacks of clusters nested in each other
+  MultiEdges,     ///< few nodes joined by many parallel edges
+  LongLabels      ///< a chain of nodes with labels of hundreds of characters
+};
+
+struct ShapeDescription
+{
+  Shape shape;
+  const char* name;
+};
+
+extern const ShapeDescription shapes[];
+extern const int shapesCount;
+
+/**
+ * Returns a graph of the given shape made of about the given number of
+ * nodes, edges and clusters, written as dot -Txdot would lay it out: with
+ * positions, bounding boxes and drawing attributes.
+ */
+QByteArray generate(Shape shape, int elements);
+
+}
+
+#endif
@@ -0,0 +1,716 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+/*
+ * Parser throughput benchmark: parses xdot files with each parser engine,
+ * decoding the render operations while parsing or deferring it, and reports
+ * MB/s and nodes/s and the memory used by the attributes and the render
+ * operations. It fails when the two parser engines do not build the same
+ * graph from a file. It also checks that parsing the files concurrently
+ * gives the same graphs as parsing them one after the other, compares the
+ * render operations decoders and times choosing the layout program of each
+ * file.
+ * With --scaling, it also checks that the parse time of generated clustered
+ * graphs grows linearly with their size.
+ */
+
+#include "dotgraph.h"
+#include "dotgrammar.h"
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <kcomponentdata.h>
+#include <klocale.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTime>
+#include <QtConcurrentMap>
+
+#include <iostream>
+
+using namespace KGraphViewer;
+
+struct EngineDescription
+{
+  DotGraph::ParserEngine engine;
+  bool deferRenderOperations;
+  const char* name;
+};
+
+static const EngineDescription engines[] = {
+  {DotGraph::SpiritParser, false, "spirit"},
+  {DotGraph::HandWrittenParser, false, "handwritten"},
+  {DotGraph::HandWrittenParser, true, "handwritten, deferred render operations"}
+};
+
+/** What is compared between serial and concurrent parses */
+struct ParseResult
+{
+  bool ok;
+  QStringList nodes;
+  QStringList subgraphs;
+  int edges;
+
+  bool operator==(const ParseResult& other) const
+  {
+    return ok == other.ok && nodes == other.nodes
+        && subgraphs == other.subgraphs && edges == other.edges;
+  }
+};
+
+/** Parses with one engine, as a QtConcurrent map functor */
+struct ContentParser
+{
+  typedef ParseResult result_type;
+
+  ContentParser(DotGraph::ParserEngine engine) : m_engine(engine) {}
+
+  ParseResult operator()(const QByteArray& content) const
+  {
+    DotGraph graph;
+    graph.setParserEngine(m_engine);
+    ParseResult result;
+    result.ok = graph.parseXdot(content);
+    result.nodes = graph.nodes().keys();
+    result.subgraphs = graph.subgraphs().keys();
+    result.edges = graph.edges().size();
+    return result;
+  }
+
+  DotGraph::ParserEngine m_engine;
+};
+
+/**
+ * Returns false when parsing concurrently with one of the engines gives a
+ * graph differing from the serial parse. The Spirit parses are still
+ * serialized by the grammar.
+ */
+static bool checkConcurrentParsing(const QList<QByteArray>& contents, int threads)
+{
+  bool result = true;
+  for (unsigned int e = 0; e < sizeof(engines) / sizeof(EngineDescription); e++)
+  {
+    if (engines[e].deferRenderOperations)
+    {
+      continue;
+    }
+    ContentParser parser(engines[e].engine);
+    QList<ParseResult> serial;
+    foreach (const QByteArray& content, contents)
+    {
+      serial.push_back(parser(content));
+    }
+
+    QTime timer;
+    timer.start();
+    QList<ParseResult> concurrent = QtConcurrent::blockingMapped< QList<ParseResult> >(contents, parser);
+    int elapsed = timer.elapsed();
+
+    int mismatches = 0;
+    for (int i = 0; i < contents.size(); i++)
+    {
+      if (!(serial[i] == concurrent[i]))
+      {
+        mismatches++;
+      }
+    }
+    std::cout << "concurrent " << engines[e].name << " parsing of " << contents.size()
+        << " inputs on " << threads << " threads: " << elapsed << " ms, "
+        << mismatches << " result(s) differing from serial parsing" << std::endl;
+    if (mismatches > 0)
+    {
+      result = false;
+    }
+  }
+  return result;
+}
+
+/**
+ * Estimates the memory used by the attributes of the elements with Qt 4 on
+ * 64 bits platforms, counting once the strings data and the default
+ * attributes maps shared between them and as if each element had its own
+ * copies, as before interning.
+ */
+struct AttributesMemory
+{
+  AttributesMemory() : elements(0), attributes(0), shared(0), copied(0) {}
+
+  void add(const GraphElement* element)
+  {
+    const int pointer = sizeof(void*);
+    const int allocation = 2 * pointer;
+    const int mapNode = 2 * sizeof(QString) + 3 * pointer + allocation;
+    elements++;
+    const QMap<QString,QString> merged = element->attributes();
+    QMap<QString,QString>::const_iterator it, it_end;
+    it = merged.constBegin(); it_end = merged.constEnd();
+    for (; it != it_end; it++)
+    {
+      attributes++;
+      copied += mapNode;
+      addString(it.key());
+      addString(it.value());
+    }
+    shared += element->ownAttributes().size() * mapNode;
+    const QMap<QString,QString>& defaults = element->defaultAttributes();
+    const void* data = const_cast<QMap<QString,QString>&>(defaults).data_ptr();
+    if (!defaults.isEmpty() && !maps.contains(data))
+    {
+      maps.insert(data);
+      shared += defaults.size() * mapNode;
+    }
+  }
+
+  void addString(const QString& str)
+  {
+    if (str.isEmpty())
+    {
+      return;
+    }
+    const int stringHeader = 32;
+    const int bytes = stringHeader + (str.size() + 1) * sizeof(QChar) + 2 * sizeof(void*);
+    copied += bytes;
+    if (!strings.contains(str.constData()))
+    {
+      strings.insert(str.constData());
+      shared += bytes;
+    }
+  }
+
+  int elements;
+  int attributes;
+  qint64 shared;
+  qint64 copied;
+  QSet<const QChar*> strings;
+  QSet<const void*> maps;
+};
+
+static void reportAttributesMemory(const DotGraph& graph)
+{
+  AttributesMemory memory;
+  memory.add(&graph);
+  foreach (GraphNode* node, graph.nodes())
+  {
+    memory.add(node);
+  }
+  foreach (GraphEdge* edge, graph.edges())
+  {
+    memory.add(edge);
+  }
+  foreach (GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    memory.add(subgraph);
+  }
+  std::cout << "  attributes: " << double(memory.attributes) / memory.elements << " per element, "
+      << double(memory.shared) / memory.elements << " bytes/element with interned strings and shared defaults, ~"
+      << double(memory.copied) / memory.elements << " bytes/element with copies" << std::endl;
+}
+
+/**
+ * Estimates the memory the former DotRenderOp, made of two QString and a
+ * QList<int> stored in a QList, would use for ops with Qt 4 on 64 bits
+ * platforms. Texts are not counted, as for DotRenderOpVec::memoryUsage().
+ */
+static int legacyRenderOpsMemory(const DotRenderOpVec& ops)
+{
+  const int pointer = sizeof(void*);
+  const int allocation = 2 * pointer;
+  const int stringHeader = 32;
+  const int listHeader = 32;
+  int bytes = 0;
+  foreach (const DotRenderOp& op, ops)
+  {
+    // list slot, heap allocated node and one letter opcode string
+    bytes += pointer + 3 * pointer + allocation + stringHeader + 2 * sizeof(QChar) + allocation;
+    if (!op.integers.isEmpty())
+    {
+      bytes += listHeader + (op.integers.size() - 1) * pointer + allocation;
+    }
+  }
+  return bytes;
+}
+
+struct RenderOpsMemory
+{
+  RenderOpsMemory() : ops(0), packed(0), legacy(0) {}
+
+  void add(const DotRenderOpVec& vec)
+  {
+    ops += vec.size();
+    packed += vec.memoryUsage();
+    legacy += legacyRenderOpsMemory(vec);
+  }
+
+  int ops;
+  qint64 packed;
+  qint64 legacy;
+};
+
+static void reportRenderOpsMemory(const QByteArray& content)
+{
+  DotGraph graph;
+  if (!graph.parseXdot(content))
+  {
+    return;
+  }
+  reportAttributesMemory(graph);
+  RenderOpsMemory memory;
+  memory.add(graph.renderOperations());
+  foreach (GraphNode* node, graph.nodes())
+  {
+    memory.add(node->renderOperations());
+  }
+  foreach (GraphEdge* edge, graph.edges())
+  {
+    memory.add(edge->renderOperations());
+    memory.add(edge->arrowheads());
+  }
+  foreach (GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    memory.add(subgraph->renderOperations());
+  }
+  if (memory.ops == 0)
+  {
+    return;
+  }
+  std::cout << "  render operations: " << memory.ops << " ops, "
+      << double(memory.packed) / memory.ops << " bytes/op packed, ~"
+      << double(memory.legacy) / memory.ops << " bytes/op with the former layout" << std::endl;
+  std::cout << "  deferring their decoding saves " << memory.packed / 1024
+      << " KB until the elements are displayed" << std::endl;
+}
+
+typedef bool (*RenderOpsDecoder)(const std::string&, DotRenderOpVec&, DotStringPool*);
+
+static void collectDrawings(const GraphElement* element, QList<std::string>& drawings)
+{
+  const QMap<QString,QString> attributes = element->attributes();
+  QMap<QString,QString>::const_iterator it, it_end;
+  it = attributes.constBegin(); it_end = attributes.constEnd();
+  for (; it != it_end; it++)
+  {
+    if (it.key().startsWith('_') && it.key().endsWith("draw_") && !it.value().isEmpty())
+    {
+      QByteArray bytes = it.value().toAscii();
+      drawings.push_back(std::string(bytes.constData(), bytes.size()));
+    }
+  }
+}
+
+/**
+ * Times the render operations decoder accepting fractional coordinates
+ * against the former integer only one on the drawing attributes of the file
+ */
+static void benchmarkRenderOpsDecoders(const QByteArray& content, int iterations)
+{
+  DotGraph graph;
+  graph.setDeferRenderOperations(true);
+  if (!graph.parseXdot(content))
+  {
+    return;
+  }
+  QList<std::string> drawings;
+  collectDrawings(&graph, drawings);
+  foreach (GraphNode* node, graph.nodes())
+  {
+    collectDrawings(node, drawings);
+  }
+  foreach (GraphEdge* edge, graph.edges())
+  {
+    collectDrawings(edge, drawings);
+  }
+  foreach (GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    collectDrawings(subgraph, drawings);
+  }
+  double megabytes = 0;
+  foreach (const std::string& drawing, drawings)
+  {
+    megabytes += drawing.size();
+  }
+  megabytes /= 1024.0 * 1024.0;
+
+  const RenderOpsDecoder decoders[] = {parse_renderop, parse_renderop_spirit};
+  const char* const names[] = {"float", "integer (spirit)"};
+  for (int d = 0; d < 2; d++)
+  {
+    bool ok = true;
+    int ops = 0;
+    QTime timer;
+    timer.start();
+    for (int i = 0; i < iterations && ok; i++)
+    {
+      ops = 0;
+      for (int j = 0; j < drawings.size() && ok; j++)
+      {
+        DotRenderOpVec vec;
+        ok = decoders[d](drawings[j], vec, 0);
+        ops += vec.size();
+      }
+    }
+    if (!ok)
+    {
+      std::cout << "  " << names[d] << " render operations decoder: failed" << std::endl;
+      continue;
+    }
+    double seconds = qMax(timer.elapsed(), 1) / (1000.0 * iterations);
+    std::cout << "  " << names[d] << " render operations decoder: "
+        << seconds * 1000 << " ms, " << megabytes / seconds << " MB/s, "
+        << ops / seconds << " ops/s" << std::endl;
+  }
+}
+
+/** Choosing the layout program should only read the start of the files */
+static void benchmarkLayoutProgramChoice(const QString& fileName)
+{
+  QTime timer;
+  timer.start();
+  QString program = DotGraph::chooseLayoutProgramForFile(fileName);
+  int elapsed = timer.elapsed();
+  std::cout << "  layout program: " << program.toLocal8Bit().data() << ", chosen in "
+      << elapsed << " ms" << std::endl;
+}
+
+/**
+ * A graph of clusters holding nodesPerCluster nodes each, the nodes of a
+ * cluster being chained and each cluster linked to the next one
+ */
+static QByteArray clusteredGraph(int clusters, int nodesPerCluster)
+{
+  QByteArray content("digraph clustered {\n");
+  for (int c = 0; c < clusters; c++)
+  {
+    content += "  subgraph cluster_" + QByteArray::number(c) + " {\n";
+    for (int n = 0; n < nodesPerCluster; n++)
+    {
+      content += "    n" + QByteArray::number(c) + "_" + QByteArray::number(n) + " [label=\"node\"];\n";
+    }
+    for (int n = 1; n < nodesPerCluster; n++)
+    {
+      content += "    n" + QByteArray::number(c) + "_" + QByteArray::number(n - 1)
+          + " -> n" + QByteArray::number(c) + "_" + QByteArray::number(n) + ";\n";
+    }
+    content += "  }\n";
+    if (c > 0)
+    {
+      content += "  n" + QByteArray::number(c - 1) + "_0 -> n" + QByteArray::number(c) + "_0;\n";
+    }
+  }
+  content += "}\n";
+  return content;
+}
+
+/**
+ * The largest ratio allowed between the times per element of the largest
+ * and the smallest clustered graphs, 16 times smaller: a quadratic lookup
+ * would reach about 16, timing noise stays well below
+ */
+#define MAXSCALINGRATIO 4.0
+
+/**
+ * Parses clustered graphs of growing sizes: the time per element stays the
+ * same when looking up the elements by name does not depend on the graph
+ * size. Returns false when it grows more than MAXSCALINGRATIO times.
+ */
+static bool benchmarkClusteredGraphsScaling(int iterations)
+{
+  std::cout << "clustered graphs scaling" << std::endl;
+  double smallest = 0;
+  double largest = 0;
+  for (int clusters = 250; clusters <= 4000; clusters *= 2)
+  {
+    QByteArray content = clusteredGraph(clusters, 10);
+    int elapsed = 0;
+    int elements = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+      DotGraph graph;
+      QTime timer;
+      timer.start();
+      graph.parseXdot(content);
+      elapsed += timer.elapsed();
+      elements = graph.edges().size() + graph.subgraphs().size();
+      foreach (const GraphSubgraph* subgraph, graph.subgraphs())
+      {
+        elements += subgraph->content().size();
+      }
+    }
+    double milliseconds = double(elapsed) / iterations;
+    std::cout << "  " << clusters << " clusters, " << elements << " elements: "
+        << milliseconds << " ms, "
+        << milliseconds * 1000 / elements << " us per element" << std::endl;
+    // a graph parsed in less than the timer resolution counts for 1 ms
+    double perElement = qMax(double(elapsed), 1.0) / iterations / elements;
+    if (clusters == 250)
+    {
+      smallest = perElement;
+    }
+    largest = perElement;
+  }
+  double ratio = largest / smallest;
+  std::cout << "  time per element ratio: " << ratio << " (at most " << MAXSCALINGRATIO << ")" << std::endl;
+  return ratio <= MAXSCALINGRATIO;
+}
+
+typedef QMap< QString, QMap<QString,QString> > GraphContent;
+
+static void addContent(GraphContent& content, const QString& key, const GraphElement* element)
+{
+  content[key] = element->attributes();
+}
+
+/**
+ * The attributes of all the elements of a graph by kind and id, the
+ * subgraphs contents being listed under a "(content)" attribute
+ */
+static GraphContent graphContent(const DotGraph& graph)
+{
+  GraphContent content;
+  addContent(content, "graph", &graph);
+  foreach (const QString& id, graph.nodes().keys())
+  {
+    addContent(content, "node " + id, graph.nodes().value(id));
+  }
+  foreach (const QString& id, graph.edges().keys())
+  {
+    addContent(content, "edge " + id, graph.edges().value(id));
+  }
+  foreach (const QString& id, graph.subgraphs().keys())
+  {
+    const GraphSubgraph* subgraph = graph.subgraphs().value(id);
+    addContent(content, "subgraph " + id, subgraph);
+    QStringList ids;
+    foreach (const GraphElement* element, subgraph->content())
+    {
+      ids.push_back(element->id());
+      if (element->kind() != GraphElement::Subgraph)
+      {
+        addContent(content, "subgraph " + id + " element " + element->id(), element);
+      }
+    }
+    content["subgraph " + id]["(content)"] = ids.join(",");
+  }
+  return content;
+}
+
+/** Returns false and tells the first difference when the engines build different graphs */
+static bool checkEnginesAgree(const QByteArray& content)
+{
+  const DotGraph::ParserEngine checkedEngines[] = {DotGraph::SpiritParser, DotGraph::HandWrittenParser};
+  GraphContent contents[2];
+  for (int e = 0; e < 2; e++)
+  {
+    DotGraph graph;
+    graph.setParserEngine(checkedEngines[e]);
+    // the drawing attributes are compared as they were read
+    graph.setDeferRenderOperations(true);
+    if (!graph.parseXdot(content))
+    {
+      std::cout << "  engines comparison: " << (e == 0 ? "spirit" : "handwritten")
+          << " parsing failed" << std::endl;
+      return false;
+    }
+    contents[e] = graphContent(graph);
+  }
+  QSet<QString> keys = QSet<QString>::fromList(contents[0].keys()) + QSet<QString>::fromList(contents[1].keys());
+  foreach (const QString& key, keys)
+  {
+    if (!contents[0].contains(key) || !contents[1].contains(key))
+    {
+      std::cout << "  engines comparison: " << key.toLocal8Bit().data() << " only built by the "
+          << (contents[0].contains(key) ? "spirit" : "handwritten") << " parser" << std::endl;
+      return false;
+    }
+    const QMap<QString,QString>& spirit = contents[0][key];
+    const QMap<QString,QString>& handwritten = contents[1][key];
+    if (spirit != handwritten)
+    {
+      QSet<QString> names = QSet<QString>::fromList(spirit.keys()) + QSet<QString>::fromList(handwritten.keys());
+      foreach (const QString& name, names)
+      {
+        if (spirit.value(name, "(none)") != handwritten.value(name, "(none)"))
+        {
+          std::cout << "  engines comparison: " << key.toLocal8Bit().data() << " attribute "
+              << name.toLocal8Bit().data() << " is '" << spirit.value(name, "(none)").toLocal8Bit().data()
+              << "' with spirit and '" << handwritten.value(name, "(none)").toLocal8Bit().data()
+              << "' with handwritten" << std::endl;
+          break;
+        }
+      }
+      return false;
+    }
+  }
+  std::cout << "  engines comparison: same " << keys.size() << " elements and attributes" << std::endl;
+  return true;
+}
+
+/**
+ * Parses quoted strings ending with escaped backslashes or with an escaped
+ * double quote: only a double quote after an odd number of backslashes is
+ * part of the string
+ */
+static bool checkQuotedStringsEscapes()
+{
+  const QByteArray content("digraph g {\n  n [comment=\"a\\\\\"];\n  m [comment=\"\\\\\\\"\"];\n}\n");
+  DotGraph graph;
+  graph.setParserEngine(DotGraph::HandWrittenParser);
+  bool ok = graph.parseXdot(content) && graph.nodes().contains("n") && graph.nodes().contains("m")
+      && graph.nodes()["n"]->attribute("comment") == "a\\\\"
+      && graph.nodes()["m"]->attribute("comment") == "\\\\\\\"";
+  std::cout << "quoted strings escapes: " << (ok ? "read as written" : "misread") << std::endl;
+  return ok;
+}
+
+/**
+ * Reloads a graph whose cluster lost a node: the node has to be purged from
+ * the cluster content and reported as removed
+ */
+static bool checkClusterNodeRemoval()
+{
+  const QByteArray before("digraph g {\n  subgraph cluster_0 {\n    a;\n    b;\n    a -> b;\n  }\n  c;\n  a -> c;\n}\n");
+  const QByteArray after("digraph g {\n  subgraph cluster_0 {\n    a;\n  }\n  c;\n  a -> c;\n}\n");
+  DotGraph graph;
+  DotGraph reloaded;
+  if (!graph.parseXdot(before) || !reloaded.parseXdot(after))
+  {
+    std::cout << "cluster node removal: parsing failed" << std::endl;
+    return false;
+  }
+  graph.updateWithGraph(reloaded);
+  GraphChangeSet changes = graph.takeLayoutChanges();
+  const GraphSubgraph* cluster = graph.subgraphs().value("cluster_0", 0);
+  bool purged = cluster != 0 && cluster->contentElement("a") != 0 && cluster->contentElement("b") == 0
+      && graph.elementNamed("b") == 0 && changes.removed.contains("b");
+  std::cout << "cluster node removal: " << (purged ? "node purged" : "node still there or not reported")
+      << std::endl;
+  return purged;
+}
+
+/** Returns false when an engine fails or when the engines disagree */
+static bool benchmarkFile(const QString& fileName, const QByteArray& content, int iterations)
+{
+  bool result = true;
+  double megabytes = content.size() / (1024.0 * 1024.0);
+
+  std::cout << fileName.toLocal8Bit().data() << " (" << megabytes << " MB)" << std::endl;
+  for (unsigned int e = 0; e < sizeof(engines) / sizeof(EngineDescription); e++)
+  {
+    int elapsed = 0;
+    int decoding = 0;
+    int nodes = 0;
+    int edges = 0;
+    bool ok = true;
+    for (int i = 0; i < iterations && ok; i++)
+    {
+      DotGraph graph;
+      graph.setParserEngine(engines[e].engine);
+      graph.setDeferRenderOperations(engines[e].deferRenderOperations);
+      QTime timer;
+      timer.start();
+      ok = graph.parseXdot(content);
+      elapsed += timer.elapsed();
+      nodes = graph.nodes().size();
+      edges = graph.edges().size();
+      timer.restart();
+      graph.decodePendingRenderOperations();
+      decoding += timer.elapsed();
+    }
+    if (!ok)
+    {
+      std::cout << "  " << engines[e].name << ": parsing failed" << std::endl;
+      result = false;
+      continue;
+    }
+    double seconds = qMax(elapsed, 1) / (1000.0 * iterations);
+    std::cout << "  " << engines[e].name << ": "
+        << seconds * 1000 << " ms, "
+        << megabytes / seconds << " MB/s, "
+        << nodes / seconds << " nodes/s ("
+        << nodes << " nodes, " << edges << " edges)" << std::endl;
+    if (engines[e].deferRenderOperations)
+    {
+      std::cout << "    decoding all the deferred render operations on "
+          << QThreadPool::globalInstance()->maxThreadCount() << " threads: "
+          << double(decoding) / iterations << " ms" << std::endl;
+    }
+  }
+  reportRenderOpsMemory(content);
+  return checkEnginesAgree(content) && result;
+}
+
+int main(int argc, char **argv)
+{
+  KAboutData about("kgraphviewer_parserbenchmark", 0, ki18n("KGraphViewer parser benchmark"), "0.1",
+                   ki18n("Measures the dot parsers throughput"), KAboutData::License_GPL);
+  KCmdLineArgs::init(argc, argv, &about);
+
+  KCmdLineOptions options;
+  options.add("iterations <count>", ki18n("Number of times each file is parsed"), "5");
+  options.add("threads <count>", ki18n("Number of threads used to decode the render operations and to parse all the files concurrently"), "4");
+  options.add("scaling", ki18n("Also parse generated clustered graphs of growing sizes"));
+  options.add("+files", ki18n("xdot files to parse"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  KComponentData componentData(&about);
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  int iterations = qMax(args->getOption("iterations").toInt(), 1);
+  int threads = qMax(args->getOption("threads").toInt(), 1);
+  // also used to decode the render operations of each parsed graph
+  QThreadPool::globalInstance()->setMaxThreadCount(threads);
+  QList<QByteArray> contents;
+  bool ok = true;
+  for (int i = 0; i < args->count(); i++)
+  {
+    QFile file(args->arg(i));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      std::cerr << "Unable to open " << args->arg(i).toLocal8Bit().data() << std::endl;
+      ok = false;
+      continue;
+    }
+    QByteArray content = file.readAll();
+    content.replace("\\\n","");
+    ok = benchmarkFile(args->arg(i), content, iterations) && ok;
+    benchmarkRenderOpsDecoders(content, iterations);
+    benchmarkLayoutProgramChoice(args->arg(i));
+    // enough inputs to keep all the threads busy
+    for (int t = 0; t < threads; t++)
+    {
+      contents.push_back(content);
+    }
+  }
+  if (!contents.isEmpty())
+  {
+    ok = checkConcurrentParsing(contents, threads) && ok;
+  }
+  ok = checkQuotedStringsEscapes() && ok;
+  ok = checkClusterNodeRemoval() && ok;
+  if (args->isSet("scaling"))
+  {
+    ok = benchmarkClusteredGraphsScaling(iterations) && ok;
+  }
+  args->clear();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+/*
+ * Spatial benchmark: on generated xdot graphs, compares the spatial index of
+ * the graph (DotGraph::computeCells(), elementsIn() and elementNearestTo())
+ * with the BSP index of a QGraphicsScene holding one rectangle per element,
+ * for the build of the index, rectangle queries the size of a viewport and
+ * point queries.
+ */
+
+#include "dotcorpus.h"
+#include "dotgraph.h"
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <kcomponentdata.h>
+#include <klocale.h>
+
+#include <QApplication>
+#include <QGraphicsRectItem>
+#include <QGraphicsScene>
+#include <QTime>
+#include <QVector>
+
+#include <iostream>
+
+using namespace KGraphViewer;
+
+static void collectBoxes(const GraphElement* element, QVector< QRectF >& boxes)
+{
+  QRectF box;
+  if (element->layoutBoundingBox(box))
+  {
+    boxes.push_back(box);
+  }
+}
+
+static void collectBoxes(const DotGraph& graph, QVector< QRectF >& boxes)
+{
+  foreach (const GraphNode* node, graph.nodes())
+  {
+    collectBoxes(node, boxes);
+  }
+  foreach (const GraphEdge* edge, graph.edges())
+  {
+    collectBoxes(edge, boxes);
+  }
+  foreach (const GraphSubgraph* subgraph, graph.subgraphs())
+  {
+    collectBoxes(subgraph, boxes);
+    foreach (const GraphElement* element, subgraph->content())
+    {
+      if (dynamic_cast<const GraphSubgraph*>(element) == 0)
+      {
+        collectBoxes(element, boxes);
+      }
+    }
+  }
+}
+
+/** The scene has y going down */
+static inline QRectF toScene(const QRectF& box)
+{
+  return QRectF(box.left(), -box.bottom(), box.width(), box.height());
+}
+
+static qreal randomBetween(qreal min, qreal max)
+{
+  return min + (max - min) * qrand() / RAND_MAX;
+}
+
+static void reportQueries(const char* index, int elapsed, int queries, int found)
+{
+  std::cout << "    " << index << ": " << elapsed * 1000.0 / queries << " us/query, "
+      << found << " elements found" << std::endl;
+}
+
+static void benchmarkCorpus(const QByteArray& content, int queries)
+{
+  DotGraph graph;
+  graph.setDeferRenderOperations(true);
+  if (!graph.parseXdot(content))
+  {
+    std::cout << "  parsing failed" << std::endl;
+    return;
+  }
+  QVector< QRectF > boxes;
+  collectBoxes(graph, boxes);
+  QRectF area;
+  foreach (const QRectF& box, boxes)
+  {
+    area = area.united(box);
+  }
+
+  QTime timer;
+  timer.start();
+  graph.computeCells();
+  int cellsBuild = timer.elapsed();
+  std::cout << "  " << boxes.size() << " boxes, " << graph.horizCellFactor() << "x" << graph.vertCellFactor()
+      << " cells" << std::endl;
+  std::cout << "  build: cells " << cellsBuild << " ms, ";
+
+  QGraphicsScene scene;
+  timer.restart();
+  foreach (const QRectF& box, boxes)
+  {
+    scene.addRect(toScene(box));
+  }
+  // the BSP tree is built at the first query
+  scene.items(QRectF(0, 0, 1, 1));
+  std::cout << "scene " << timer.elapsed() << " ms" << std::endl;
+
+  // viewports of 800x600 points and points anywhere in the graph
+  QVector< QRectF > rects;
+  QVector< QPointF > points;
+  qsrand(1);
+  for (int i = 0; i < queries; i++)
+  {
+    rects.push_back(QRectF(randomBetween(area.left() - 400, area.right() - 400),
+                           randomBetween(area.top() - 300, area.bottom() - 300), 800, 600));
+    points.push_back(QPointF(randomBetween(area.left(), area.right()), randomBetween(area.top(), area.bottom())));
+  }
+
+  std::cout << "  rectangles:" << std::endl;
+  int found = 0;
+  timer.restart();
+  foreach (const QRectF& rect, rects)
+  {
+    found += graph.elementsIn(rect).size();
+  }
+  reportQueries("cells", timer.elapsed(), queries, found);
+  found = 0;
+  timer.restart();
+  foreach (const QRectF& rect, rects)
+  {
+    found += scene.items(toScene(rect)).size();
+  }
+  reportQueries("scene", timer.elapsed(), queries, found);
+
+  std::cout << "  points:" << std::endl;
+  found = 0;
+  timer.restart();
+  foreach (const QPointF& point, points)
+  {
+    found += graph.elementNearestTo(point, 3) != 0 ? 1 : 0;
+  }
+  reportQueries("cells", timer.elapsed(), queries, found);
+  found = 0;
+  timer.restart();
+  foreach (const QPointF& point, points)
+  {
+    found += scene.items(QRectF(point.x() - 3, -point.y() - 3, 6, 6)).isEmpty() ? 0 : 1;
+  }
+  reportQueries("scene", timer.elapsed(), queries, found);
+}
+
+int main(int argc, char **argv)
+{
+  KAboutData about("kgraphviewer_spatialbenchmark", 0, ki18n("KGraphViewer spatial benchmark"), "0.1",
+                   ki18n("Compares the graph spatial index with the graphics scene one"), KAboutData::License_GPL);
+  KCmdLineArgs::init(argc, argv, &about);
+
+  KCmdLineOptions options;
+  options.add("queries <count>", ki18n("Number of rectangle and point queries on each graph"), "1000");
+  options.add("max-elements <count>", ki18n("Size of the largest generated graphs, from 1000 to 1000000 elements"), "100000");
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  KComponentData componentData(&about);
+  // the scene needs an application, but nothing is shown
+  QApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv(), false);
+
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  int queries = qMax(args->getOption("queries").toInt(), 1);
+  int maxElements = qBound(1000, args->getOption("max-elements").toInt(), 1000000);
+
+  for (int s = 0; s < DotCorpus::shapesCount; s++)
+  {
+    for (int elements = 1000; elements <= maxElements; elements *= 10)
+    {
+      std::cout << DotCorpus::shapes[s].name << ", " << elements << " elements" << std::endl;
+      benchmarkCorpus(DotCorpus::generate(DotCorpus::shapes[s].shape, elements), queries);
+    }
+  }
+  args->clear();
+  return 0;
+}
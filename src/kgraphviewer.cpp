@@ -550,6 +550,28 @@ void KGraphViewerWindow::newTabSelectedSlot(QWidget* tab)
   }
 }
 
+QString KGraphViewerWindow::memoryUsageReport()
+{
+  KGraphViewer::KGraphViewerInterface* kgv =
+      qobject_cast<KGraphViewer::KGraphViewerInterface*>(m_tabsPartsMap.value(m_widget->currentPage()));
+  if (kgv == 0)
+  {
+    return QString();
+  }
+  return kgv->memoryUsageReport();
+}
+
+QString KGraphViewerWindow::layoutCacheReport()
+{
+  KGraphViewer::KGraphViewerInterface* kgv =
+      qobject_cast<KGraphViewer::KGraphViewerInterface*>(m_tabsPartsMap.value(m_widget->currentPage()));
+  if (kgv == 0)
+  {
+    return QString();
+  }
+  return kgv->layoutCacheReport();
+}
+
 void KGraphViewerWindow::slotHoverEnter(const QString& id)
 {
   kDebug() << id;
@@ -72,6 +72,11 @@ public slots:
     * Use this method to load whatever file/URL you have
     */
   void openUrl(const QString& url) {openUrl(KUrl(url));}
+
+  /** The memory used by the graph of the current tab, by category */
+  QString memoryUsageReport();
+  /** The statistics of the cache of the layouts computed before */
+  QString layoutCacheReport();
   
   void close();
 
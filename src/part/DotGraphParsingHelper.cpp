@@ -37,12 +37,9 @@
 #include <kdebug.h>
     
 #include <QFile>
-#include<QUuid>
 
 using namespace std;
 
-extern KGraphViewer::DotGraphParsingHelper* phelper;
-
 namespace KGraphViewer
 {
 #define KGV_MAX_ITEMS_TO_LOAD std::numeric_limits<int>::max()
@@ -54,13 +51,10 @@ DotGraphParsingHelper::DotGraphParsingHelper():
   subgraphid(),
   uniq(0),
   attributes(),
-  graphAttributes(),
-  nodesAttributes(),
-  edgesAttributes(),
-  graphAttributesStack(),
-  nodesAttributesStack(),
-  edgesAttributesStack(),
+  scope(),
+  scopesStack(),
   edgebounds(),
+  strings(),
   z(0),
   maxZ(0),
   graph(0),
@@ -70,62 +64,74 @@ DotGraphParsingHelper::DotGraphParsingHelper():
 {
 }
 
-void DotGraphParsingHelper::setgraphelementattributes(GraphElement* ge, const AttributesMap& attributes)
+QString DotGraphParsingHelper::attributeValue(const QString& key, const char* first, const char* last)
 {
-  AttributesMap::const_iterator it, it_end;
-  it = attributes.begin(); it_end = attributes.end();
-  for (; it != it_end; it++)
+  if (key == "label")
   {
-//     kDebug() << "    " << QString::fromStdString((*it).first) << "\t=\t'" << QString::fromStdString((*it).second) <<"'";
-    if ((*it).first=="label")
-    {
-      QString label = QString::fromUtf8((*it).second.c_str());
-      label.replace("\\n","\n");
-      (*ge).attributes()["label"] = label;
-    }
-    else
-    {
-      (*ge).attributes()[QString::fromStdString((*it).first)] =
-      QString::fromStdString((*it).second);
-    }
+    QString label = QString::fromUtf8(first, last - first);
+    label.replace("\\n","\n");
+    return label;
   }
-  
-  DotRenderOpVec ops = ge->renderOperations();
-  if (attributes.find("_draw_") != attributes.end())
+  // drawing attributes and coordinates are mostly unique: only short values,
+  // like colors, shapes or sizes, are worth sharing
+  if (last - first > 32 || key.startsWith('_'))
   {
-    parse_renderop((attributes.find("_draw_"))->second, ops);
-//     kDebug() << "element renderOperations size is now " << ge->renderOperations().size();
+    return QString::fromAscii(first, last - first);
   }
-  if (attributes.find("_ldraw_") != attributes.end())
+  for (const char* it = first; it != last; it++)
   {
-    parse_renderop(attributes.find("_ldraw_")->second, ops);
-//     kDebug() << "element renderOperations size is now " << ge->renderOperations().size();
+    // interned strings are UTF-8 decoded, the other values are not
+    if (static_cast<unsigned char>(*it) >= 0x80)
+    {
+      return QString::fromAscii(first, last - first);
+    }
   }
-  if (attributes.find("_hldraw_") != attributes.end())
+  return internedString(first, last);
+}
+
+void DotGraphParsingHelper::addAttribute(const char* keyFirst, const char* keyLast,
+                                         const char* valueFirst, const char* valueLast)
+{
+  const QString& key = internedString(keyFirst, keyLast);
+  if (!attributes.contains(key))
   {
-    parse_renderop(attributes.find("_hldraw_")->second, ops);
-//     kDebug() << "element renderOperations size is now " << ge->renderOperations().size();
+    attributes.insert(key, attributeValue(key, valueFirst, valueLast));
   }
-  if (attributes.find("_tldraw_") != attributes.end())
+}
+
+void DotGraphParsingHelper::setgraphelementattributes(GraphElement* ge, const QMap<QString,QString>& defaults,
+                                                      const AttributesMap& own)
+{
+  // shared with the other elements of the scope instead of copied into each
+  ge->setDefaultAttributes(defaults);
+  AttributesMap::const_iterator it, it_end;
+  it = own.constBegin(); it_end = own.constEnd();
+  for (; it != it_end; it++)
   {
-    parse_renderop(attributes.find("_tldraw_")->second, ops);
-//     kDebug() << "element renderOperations size is now " << ge->renderOperations().size();
+//     kDebug() << "    " << it.key() << "\t=\t'" << it.value() <<"'";
+    ge->setAttribute(it.key(), it.value());
   }
-  ge->setRenderOperations(ops);
+
+  // decoded from the drawing attributes once the whole graph is read
+  ge->setRenderOperationsPending();
 }
 
 void DotGraphParsingHelper::setgraphattributes()
 {
 //   kDebug() << "Attributes for graph are : ";
-  setgraphelementattributes(graph, graphAttributes);
+  setgraphelementattributes(graph, scope.graph, attributes);
 }
 
 void DotGraphParsingHelper::setsubgraphattributes()
 {
 //   kDebug() << "Attributes for subgraph are : ";
+  if (gs == 0)
+  {
+    return;
+  }
   gs->setZ(z);
 //   kDebug() << "z="<<gs->z();
-  setgraphelementattributes(gs, graphAttributes);
+  setgraphelementattributes(gs, scope.graph, attributes);
 }
 
 void DotGraphParsingHelper::setnodeattributes()
@@ -135,12 +141,14 @@ void DotGraphParsingHelper::setnodeattributes()
   if (gn == 0)
   {
 //     kDebug() << "gn is null";
+    attributes.clear();
     return;
   }
 //   kDebug() << "Attributes for node " << gn->id() << " are : ";
   gn->setZ(z+1);
 //   kDebug() << "z="<<gn->z();
-  setgraphelementattributes(gn, nodesAttributes);
+  setgraphelementattributes(gn, scope.nodes, attributes);
+  attributes.clear();
 }
 
 void DotGraphParsingHelper::setedgeattributes()
@@ -150,28 +158,7 @@ void DotGraphParsingHelper::setedgeattributes()
 //   kDebug() << "Attributes for edge " << ge->fromNode()->id() << "->" << ge->toNode()->id() << " are : ";
   ge->setZ(z+1);
 //   kDebug() << "z="<<ge->z();
-  setgraphelementattributes(ge, edgesAttributes);
-  
-  DotRenderOpVec ops = ge->renderOperations();
-  if (edgesAttributes.find("_tdraw_") != edgesAttributes.end())
-  {
-    parse_renderop(edgesAttributes["_tdraw_"], ops);
-//     kDebug() << "edge renderOperations size is now " << ge->renderOperations().size();
-    DotRenderOpVec::const_iterator it, it_end;
-    it = ops.constBegin(); it_end = ops.constEnd();
-    for (; it != it_end; it++)
-      ge->arrowheads().push_back(*it);
-  }
-  if (edgesAttributes.find("_hdraw_") != edgesAttributes.end())
-  {
-    parse_renderop(edgesAttributes["_hdraw_"], ops);
-//     kDebug() << "edge renderOperations size is now " << ge->renderOperations().size();
-    DotRenderOpVec::const_iterator it, it_end;
-    it = ops.constBegin(); it_end = ops.constEnd();
-    for (; it != it_end; it++)
-      ge->arrowheads().push_back(*it);
-  }
-  ge->setRenderOperations(ops);
+  setgraphelementattributes(ge, scope.edges, attributes);
 }
 
 void DotGraphParsingHelper::setattributedlist()
@@ -179,10 +166,10 @@ void DotGraphParsingHelper::setattributedlist()
 // //   kDebug() << "Setting attributes list for " << QString::fromStdString(attributed);
   if (attributed == "graph")
   {
-    if (attributes.find("bb") != attributes.end())
+    if (attributes.contains("bb"))
     {
-      std::vector< int > v;
-      parse_integers(attributes["bb"].c_str(), v);
+      std::vector< double > v;
+      parse_reals(attributes.value("bb").toAscii().constData(), v);
       if (v.size()>=4)
       {
 //         kDebug() << "setting width and height to " << v[2] << v[3];
@@ -190,58 +177,67 @@ void DotGraphParsingHelper::setattributedlist()
         graph->height(v[3]);
       }
     }
-    AttributesMap::const_iterator it, it_end;
-    it = attributes.begin(); it_end = attributes.end();
-    for (; it != it_end; it++)
-    {
-//       kDebug() << "    " << QString::fromStdString((*it).first) << " = " <<  QString::fromStdString((*it).second);
-      graphAttributes[(*it).first] = (*it).second;
-    }
+    setdefaultattributes(scope.graph);
   }
   else if (attributed == "node")
   {
-    AttributesMap::const_iterator it, it_end;
-    it = attributes.begin(); it_end = attributes.end();
-    for (; it != it_end; it++)
-    {
-//       kDebug() << "    " << QString::fromStdString((*it).first) << " = " <<  QString::fromStdString((*it).second);
-      nodesAttributes[(*it).first] = (*it).second;
-    }
+    setdefaultattributes(scope.nodes);
   }
   else if (attributed == "edge")
   {
-    AttributesMap::const_iterator it, it_end;
-    it = attributes.begin(); it_end = attributes.end();
-    for (; it != it_end; it++)
-    {
-//       kDebug() << "    " << QString::fromStdString((*it).first) << " = " <<  QString::fromStdString((*it).second);
-      edgesAttributes[(*it).first] = (*it).second;
-    }
+    setdefaultattributes(scope.edges);
   }
   attributes.clear();
 }
 
+void DotGraphParsingHelper::setdefaultattributes(QMap<QString,QString>& defaults)
+{
+  AttributesMap::const_iterator it, it_end;
+  it = attributes.constBegin(); it_end = attributes.constEnd();
+  for (; it != it_end; it++)
+  {
+//     kDebug() << "    " << it.key() << " = " << it.value();
+    defaults.insert(it.key(), it.value());
+  }
+}
+
+void DotGraphParsingHelper::pushAttrList()
+{
+  scopesStack.push_back(scope);
+}
+
+void DotGraphParsingHelper::popAttrList()
+{
+  scope = scopesStack.back();
+  scopesStack.pop_back();
+}
+
 void DotGraphParsingHelper::createnode(const std::string& nodeid)
 {
-  QString id = QString::fromStdString(nodeid); 
+  createnode(internedString(nodeid));
+}
+
+void DotGraphParsingHelper::createnode(const QString& id)
+{
 //   kDebug() << id;
-  gn = dynamic_cast<GraphNode*>(graph->elementNamed(id));
+  gn = graph->nodeNamed(id);
   if (gn==0 && graph->nodes().size() < KGV_MAX_ITEMS_TO_LOAD)
   {
 //     kDebug() << "Creating a new node" << z << (void*)gs;
-    gn = new GraphNode();
+    gn = graph->createNode();
     gn->setId(id);
 //     gn->label(QString::fromStdString(nodeid));
     if (z>0 && gs != 0)
     {
 //       kDebug() << "Adding node" << id << "in subgraph" << gs->id();
-      gs->content().push_back(gn);
+      gs->appendElement(gn);
     }
     else
     {
 //       kDebug() << "Adding node" << id;
       graph->nodes()[id] = gn;
     }
+    graph->indexElement(id, gn);
   }
   edgebounds.clear();
 }
@@ -249,38 +245,37 @@ void DotGraphParsingHelper::createnode(const std::string& nodeid)
 void DotGraphParsingHelper::createsubgraph()
 {
 //   kDebug() ;
-  if (phelper)
+  std::string str = subgraphid;
+  if (str.empty())
   {
-    std::string str = phelper->subgraphid;
-    if (str.empty())
-    {
-      std::ostringstream oss;
-      oss << "kgv_id_" << phelper->uniq++;
-      str = oss.str();
-    }
-//     kDebug() << QString::fromStdString(str);
-    if (graph->subgraphs().find(QString::fromStdString(str)) == graph->subgraphs().end())
-    {
-//       kDebug() << "Creating a new subgraph";
-      gs = new GraphSubgraph();
-      gs->setId(QString::fromStdString(str));
-//       gs->label(QString::fromStdString(str)); 
-      graph->subgraphs().insert(QString::fromStdString(str), gs);
-//       kDebug() << "there is now"<<graph->subgraphs().size()<<"subgraphs in" << graph;
-    }
-    else
-    {
-//       kDebug() << "Found existing subgraph";
-      gs = *(graph->subgraphs().find(QString::fromStdString(str)));
-    }
-    phelper->subgraphid = "";
+    std::ostringstream oss;
+    oss << "kgv_id_" << uniq++;
+    str = oss.str();
   }
+  QString id = QString::fromUtf8(str.c_str());
+//   kDebug() << id;
+  if (graph->subgraphs().find(id) == graph->subgraphs().end())
+  {
+//     kDebug() << "Creating a new subgraph";
+    gs = graph->createSubgraph();
+    gs->setId(id);
+//     gs->label(id);
+    graph->subgraphs().insert(id, gs);
+    graph->indexElement(id, gs);
+//     kDebug() << "there is now"<<graph->subgraphs().size()<<"subgraphs in" << graph;
+  }
+  else
+  {
+//     kDebug() << "Found existing subgraph";
+    gs = *(graph->subgraphs().find(id));
+  }
+  subgraphid = "";
 }
 
 void DotGraphParsingHelper::createedges()
 {
 //   kDebug();
-  std::string node1Name, node2Name;
+  QString node1Name, node2Name;
   node1Name = edgebounds.front();
   edgebounds.pop_front();
   while (!edgebounds.empty())
@@ -290,25 +285,28 @@ void DotGraphParsingHelper::createedges()
 
     if (graph->nodes().size() >= KGV_MAX_ITEMS_TO_LOAD || graph->edges().size() >= KGV_MAX_ITEMS_TO_LOAD)
     {
+      attributes.clear();
       return;
     }
 //     kDebug() << QString::fromStdString(node1Name) << ", " << QString::fromStdString(node2Name);
-    ge = new GraphEdge();
-    GraphElement* gn1 = graph->elementNamed(QString::fromStdString(node1Name));
+    ge = graph->createEdge();
+    GraphElement* gn1 = graph->elementNamed(node1Name);
     if (gn1 == 0)
     {
 //       kDebug() << "new node 1";
-      gn1 = new GraphNode();
-      gn1->setId(QString::fromStdString(node1Name));
-      graph->nodes()[QString::fromStdString(node1Name)] = dynamic_cast<GraphNode*>(gn1);
+      gn1 = graph->createNode();
+      gn1->setId(node1Name);
+      graph->nodes()[node1Name] = static_cast<GraphNode*>(gn1);
+      graph->indexElement(node1Name, gn1);
     }
-    GraphElement* gn2 = graph->elementNamed(QString::fromStdString(node2Name));
+    GraphElement* gn2 = graph->elementNamed(node2Name);
     if (gn2 == 0)
     {
 //       kDebug() << "new node 2";
-      gn2 = new GraphNode();
-      gn2->setId(QString::fromStdString(node2Name));
-      graph->nodes()[QString::fromStdString(node2Name)] = dynamic_cast<GraphNode*>(gn2);
+      gn2 = graph->createNode();
+      gn2->setId(node2Name);
+      graph->nodes()[node2Name] = static_cast<GraphNode*>(gn2);
+      graph->indexElement(node2Name, gn2);
     }
 //     kDebug() << "Found gn1="<<gn1<<" and gn2=" << gn2;
     if (gn1 == 0 || gn2 == 0)
@@ -322,17 +320,25 @@ void DotGraphParsingHelper::createedges()
 //     kDebug() << ge->id();
     if (ge->id().isEmpty())
     {
-      ge->setId(QString::fromStdString(node1Name)+QString::fromStdString(node2Name)+QUuid::createUuid().toString().remove('{').remove('}').remove('-'));
+      ge->setId(graph->anonymousEdgeId(node1Name, node2Name));
     }
 //     kDebug() << ge->id();
 //     kDebug() << "num before=" << graph->edges().size();
+    GraphEdge* replaced = graph->edges().value(ge->id(), 0);
+    if (replaced != 0)
+    {
+      // an edge given the id of a previous one replaces it
+      graph->destroyElement(replaced);
+    }
     graph->edges().insert(ge->id(), ge);
+    graph->indexElement(ge->id(), ge);
 //     kDebug() << "num after=" << graph->edges().size();
 
 
     node1Name = node2Name;
   }
   edgebounds.clear();
+  attributes.clear();
 }
 
 void DotGraphParsingHelper::finalactions()
@@ -19,8 +19,13 @@
 #ifndef DOT_GRAPHPARSINGHELPER_H
 #define DOT_GRAPHPARSINGHELPER_H
 
-#include <map>
-#include <list>
+#include "dotrenderop.h"
+
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
 #include <string>
 
 namespace KGraphViewer
@@ -33,21 +38,70 @@ class GraphElement;
 
 struct DotGraphParsingHelper
 {
-  typedef std::map< std::string, std::string > AttributesMap;
+  /** The attributes read in the current statement, with interned keys */
+  typedef QMap< QString, QString > AttributesMap;
 
   DotGraphParsingHelper();
 
   void createnode(const std::string& nodeid);
+  void createnode(const QString& nodeid);
   void createsubgraph();
   void setgraphattributes();
   void setsubgraphattributes();
-      void setnodeattributes();
+  void setnodeattributes();
   void setedgeattributes();
   void setattributedlist();
+  void setdefaultattributes(QMap< QString, QString >& defaults);
+  /**
+   * Adds an attribute of the current statement from its key and value
+   * bytes, converted once here. The first value of a key is kept.
+   */
+  void addAttribute(const char* keyFirst, const char* keyLast, const char* valueFirst, const char* valueLast);
+  inline void addAttribute(const std::string& key, const std::string& value)
+  {
+    addAttribute(key.data(), key.data() + key.size(), value.data(), value.data() + value.size());
+  }
+  void pushAttrList();
+  void popAttrList();
   void createedges();
-  void edgebound(const std::string& bound) {edgebounds.push_back(bound);}
+  void edgebound(const std::string& bound) {edgebounds.push_back(internedString(bound));}
+  void edgebound(const QString& bound) {edgebounds.push_back(bound);}
   void finalactions();
-  void setgraphelementattributes(GraphElement* ge, const AttributesMap& attributes);
+
+  /**
+   * The default attributes of each kind of element in the current scope,
+   * with interned keys and values. Entering a subgraph saves them by copying
+   * these implicitly shared maps, which costs nothing until the subgraph sets
+   * defaults of its own, and leaving it restores them.
+   */
+  struct AttributesScope
+  {
+    QMap< QString, QString > graph;
+    QMap< QString, QString > nodes;
+    QMap< QString, QString > edges;
+  };
+
+  /**
+   * Sets to @p ge the given defaults followed by its own attributes, the
+   * ones read in the statement creating it
+   */
+  void setgraphelementattributes(GraphElement* ge, const QMap< QString, QString >& defaults,
+                                 const AttributesMap& own);
+  QString attributeValue(const QString& key, const char* first, const char* last);
+
+  /**
+   * Returns the QString for the given UTF-8 bytes, converting them only the
+   * first time they are seen during this parse. Identifiers and attribute
+   * names repeat a lot, and the returned strings share their data.
+   */
+  inline const QString& internedString(const char* first, const char* last)
+  {
+    return strings.intern(first, last);
+  }
+  inline const QString& internedString(const std::string& str)
+  {
+    return strings.intern(str.data(), str.data() + str.size());
+  }
 
   std::string attrid;
   std::string valid;
@@ -57,14 +111,12 @@ struct DotGraphParsingHelper
   unsigned int uniq;
   
   AttributesMap attributes;
-  AttributesMap graphAttributes;
-  AttributesMap nodesAttributes;
-  AttributesMap edgesAttributes;
-  std::list< AttributesMap > graphAttributesStack;
-  std::list< AttributesMap > nodesAttributesStack;
-  std::list< AttributesMap > edgesAttributesStack;
+  AttributesScope scope;
+  QVector< AttributesScope > scopesStack;
   
-  std::list< std::string > edgebounds;
+  QList< QString > edgebounds;
+
+  DotStringPool strings;
   
   unsigned int z;
   unsigned int maxZ;
@@ -32,6 +32,7 @@
 #include "dot2qtconsts.h"
 #include "dotgraphview.h"
 #include "FontsCache.h"
+#include "graphmemoryusage.h"
 
 #include <KAction>
 
@@ -61,7 +62,7 @@ CanvasEdge::CanvasEdge(DotGraphView* view, GraphEdge* e,
 {
   kDebug() << "edge "  << edge()->fromNode()->id() << "->"  << edge()->toNode()->id() << m_gh;
   setBoundingRegionGranularity(0.9);
-  m_font = FontsCache::changeable().fromName(e->fontName());
+  m_font = FontsCache::changeable().fromName(e->paintAttributes().fontName);
 
   computeBoundingRect();
 //   kDebug() << "boundingRect computed: " << m_boundingRect;
@@ -76,7 +77,6 @@ CanvasEdge::CanvasEdge(DotGraphView* view, GraphEdge* e,
   connect(removeEdgeAction,SIGNAL(triggered(bool)),this,SLOT(slotRemoveEdge()));
   
   
-  connect(e,SIGNAL(changed()),this,SLOT(modelChanged()));
   connect(this, SIGNAL(selected(CanvasEdge*, Qt::KeyboardModifiers)), view, SLOT(slotEdgeSelected(CanvasEdge*, Qt::KeyboardModifiers)));
   
   connect(this, SIGNAL(edgeContextMenuEvent(const QString&, const QPoint&)), view, SLOT(slotContextMenuEvent(const QString&, const QPoint&)));
@@ -110,7 +110,7 @@ QPainterPath CanvasEdge::shape () const
 
   foreach (const DotRenderOp& dro, edge()->renderOperations())
   {
-    if ( dro.renderop == "B" )
+    if ( dro.opcode == DotRenderOp::BSpline )
     {
       for (int splineNum = 0; splineNum < edge()->colors().count() || (splineNum==0 && edge()->colors().count()==0); splineNum++)
       {
@@ -190,7 +190,8 @@ Q_UNUSED(widget)
     widthScaleFactor = 1;
   }
 
-  if (edge()->style()=="invis")
+  const GraphElementPaintAttributes& pa = edge()->paintAttributes();
+  if (pa.invisible)
   {
     return;
   }
@@ -213,7 +214,7 @@ Q_UNUSED(widget)
   foreach (const DotRenderOp& dro, edge()->renderOperations())
   {
     //     kDebug() << edge()->fromNode()->id() << "->" << edge()->toNode()->id() << "renderop" << dro.renderop << "; selected:" << edge()->isSelected();
-    if (dro.renderop == "c")
+    if (dro.opcode == DotRenderOp::PenColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -221,7 +222,7 @@ Q_UNUSED(widget)
       lineColor = c;
 //       kDebug() << "c" << dro.str.mid(0,7) << lineColor;
     }
-    else if (dro.renderop == "C")
+    else if (dro.opcode == DotRenderOp::FillColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -233,12 +234,12 @@ Q_UNUSED(widget)
       backColor = c;
 //       kDebug() << "C" << dro.str.mid(0,7) << backColor;
     }
-    else if ( dro.renderop == "T" )
+    else if ( dro.opcode == DotRenderOp::Text )
     {
       const QString& str = dro.str;
     
       qreal stringWidthGoal = dro.integers[3] * m_scaleX;
-      int fontSize = edge()->fontSize();
+      int fontSize = pa.fontSize;
       m_font->setPointSize(fontSize);
       QFontMetrics fm(*m_font);
       while (fm.width(str) > stringWidthGoal && fontSize > 1)
@@ -250,7 +251,7 @@ Q_UNUSED(widget)
       p->save();
       p->setFont(*m_font);
       
-      p->setPen(Dot2QtConsts::componentData().qtColor(edge()->fontColor()));
+      p->setPen(pa.fontColor);
 
       qreal x = (m_scaleX *
                        (
@@ -267,20 +268,20 @@ Q_UNUSED(widget)
       p->drawText(point,str);
       p->restore();
     }      
-    else if (( dro.renderop == "p" ) || (dro.renderop == "P" ))
+    else if (( dro.opcode == DotRenderOp::Polygon ) || (dro.opcode == DotRenderOp::FilledPolygon ))
     {
       QPolygonF polygon(dro.integers[0]);
       for (int i = 0; i < dro.integers[0]; i++)
       {
         QPointF point(
-            (int(dro.integers[2*i+1])/*%m_wdhcf*/)*m_scaleX +m_xMargin,
-            (int(m_gh-dro.integers[2*i+2])/*%m_hdvcf*/)*m_scaleY + m_yMargin
+            (dro.integers[2*i+1]/*%m_wdhcf*/)*m_scaleX +m_xMargin,
+            (m_gh-dro.integers[2*i+2]/*%m_hdvcf*/)*m_scaleY + m_yMargin
                 );
         polygon[i] = point;
 //         kDebug() << edge()->fromNode()->id() << "->" << edge()->toNode()->id()  << point;
         allPoints.append(point);
       }
-      if (dro.renderop == "P" )
+      if (dro.opcode == DotRenderOp::FilledPolygon )
       {
         p->save();
         p->setBrush(lineColor);
@@ -293,7 +294,7 @@ Q_UNUSED(widget)
         p->setBrush(Dot2QtConsts::componentData().qtColor("white"));
       }
       QPen pen(lineColor);
-      if (edge()->style() == "bold")
+      if (pa.bold)
       {
         pen.setStyle(Qt::SolidLine);
         pen.setWidth((int)(2 * widthScaleFactor));
@@ -301,7 +302,7 @@ Q_UNUSED(widget)
       else
       {
         pen.setWidth((int)(1 * widthScaleFactor));
-        pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(edge()->style()));
+        pen.setStyle(pa.penStyle);
       }
       p->save();
       p->setPen(pen);
@@ -309,14 +310,14 @@ Q_UNUSED(widget)
       p->drawPolyline(polygon);
       p->restore();
     }
-    else if (( dro.renderop == "e" ) || (dro.renderop == "E" ))
+    else if (( dro.opcode == DotRenderOp::Ellipse ) || (dro.opcode == DotRenderOp::FilledEllipse ))
     {
       qreal w = m_scaleX * dro.integers[2] * 2;
       qreal h = m_scaleY *  dro.integers[3] * 2;
       qreal x = (m_xMargin + (dro.integers[0]/*%m_wdhcf*/)*m_scaleX) - w/2;
       qreal y = ((m_gh -  dro.integers[1]/*%m_hdvcf*/)*m_scaleY + m_yMargin) - h/2;
       p->save();
-      if (dro.renderop == "E" )
+      if (dro.opcode == DotRenderOp::FilledEllipse )
       {
         p->setBrush(lineColor);
       }
@@ -325,7 +326,7 @@ Q_UNUSED(widget)
         p->setBrush(Dot2QtConsts::componentData().qtColor("white"));
       }
       QPen pen(lineColor);
-      if (edge()->style() == "bold")
+      if (pa.bold)
       {
         pen.setStyle(Qt::SolidLine);
         pen.setWidth(int(2 * widthScaleFactor));
@@ -333,7 +334,7 @@ Q_UNUSED(widget)
       else
       {
         pen.setWidth(int(1 * widthScaleFactor));
-        pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(edge()->style()));
+        pen.setStyle(pa.penStyle);
       }
       p->setPen(pen);
       QRectF rect(x,y,w,h);
@@ -341,35 +342,30 @@ Q_UNUSED(widget)
       p->drawEllipse(rect);
       p->restore();
     }
-    else if ( dro.renderop == "B" )
+    else if ( dro.opcode == DotRenderOp::BSpline )
     {
-      uint lineWidth = 1;
       QPen pen;
-      if (edge()->style() == "bold")
+      if (pa.bold)
       {
         pen.setStyle(Qt::SolidLine);
         pen.setWidth(int(2 * widthScaleFactor));
       }
-      else if (edge()->style() != "filled")
+      else if (!pa.filled)
       {
-        pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(edge()->style()));
+        pen.setStyle(pa.penStyle);
       }
-      if (edge()->style().left(12) == "setlinewidth")
+      if (pa.hasStyleLineWidth)
       {
-        bool ok;
-        lineWidth = edge()->style().mid(12, edge()->style().length()-1-12).toInt(&ok);
-        pen.setWidth(int(lineWidth * widthScaleFactor));
+        pen.setWidth(int(pa.styleLineWidth * widthScaleFactor));
       }
-      if (edge()->attributes().contains("penwidth"))
+      if (pa.hasPenWidth)
       {
-        bool ok;
-        lineWidth = edge()->attributes()["penwidth"].toInt(&ok);
-        pen.setWidth(int(lineWidth * widthScaleFactor));
+        pen.setWidth(int(pa.penWidth * widthScaleFactor));
       }
-      if (edge()->attributes().contains("color"))
+      if (pa.hasColor)
       {
-        kDebug() << "set edge color to " << QColor(edge()->attributes()["color"]).name();
-        lineColor = QColor(edge()->attributes()["color"]);
+//         kDebug() << "set edge color to " << pa.color.name();
+        lineColor = pa.color;
       }
       for (int splineNum = 0; splineNum < edge()->colors().count() || (splineNum==0 && edge()->colors().count()==0); splineNum++)
       {
@@ -424,6 +420,13 @@ void CanvasEdge::modelChanged()
   computeBoundingRect();
 }
 
+void CanvasEdge::addMemoryUsage(GraphMemoryUsage& usage) const
+{
+  usage.add(GraphMemoryUsage::CanvasItems, sizeof(CanvasEdge));
+  usage.add(GraphMemoryUsage::ItemMenus, sizeof(QMenu) + m_popup->actions().size() * sizeof(KAction));
+  usage.add(GraphMemoryUsage::Caches, m_shape.elementCount() * sizeof(QPainterPath::Element));
+}
+
 void CanvasEdge::computeBoundingRect()
 {
 //   kDebug();
@@ -433,7 +436,7 @@ void CanvasEdge::computeBoundingRect()
   {
     if ((edge()->fromNode()->canvasElement()==0)
       || (edge()->toNode()->canvasElement()==0)
-      || edge()->style()=="invis")
+      || edge()->paintAttributes().invisible)
     {
       m_boundingRect = QRectF();
     }
@@ -452,7 +455,7 @@ void CanvasEdge::computeBoundingRect()
     foreach (const DotRenderOp& dro, edge()->renderOperations())
     {
 //       kDebug() << dro.renderop  << ", ";
-      if ( (dro.renderop != "B") && (dro.renderop != "p") &&  (dro.renderop != "P") ) continue;
+      if ( (dro.opcode != DotRenderOp::BSpline) && (dro.opcode != DotRenderOp::Polygon) &&  (dro.opcode != DotRenderOp::FilledPolygon) ) continue;
       uint previousSize = points.size();
       points.resize(previousSize+dro.integers[0]);
       for (int i = 0; i < dro.integers[0]; i++)
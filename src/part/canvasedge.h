@@ -55,6 +55,7 @@ namespace KGraphViewer
 class CanvasNode;
 class CanvasEdge;
 class GraphEdge;
+class GraphMemoryUsage;
 class DotGraphView;
 
 class CanvasEdge : public QObject, public QAbstractGraphicsShapeItem
@@ -82,6 +83,9 @@ public:
   
   void computeBoundingRect();
 
+  /** Adds the bytes used by the item, its popup menu and its shape */
+  void addMemoryUsage(GraphMemoryUsage& usage) const;
+
 Q_SIGNALS:
   void selected(CanvasEdge*, Qt::KeyboardModifiers);
   void edgeContextMenuEvent(const QString&, const QPoint&);
@@ -23,6 +23,7 @@
 #include "dotdefaults.h"
 #include "dot2qtconsts.h"
 #include "FontsCache.h"
+#include "graphmemoryusage.h"
 
 #include <stdlib.h>
 #include <math.h>
@@ -52,37 +53,36 @@ CanvasElement::CanvasElement(
     m_xMargin(0), m_yMargin(0), m_gh(0), m_wdhcf(0), m_hdvcf(0),
     m_element(gelement), m_view(v),
     m_font(0),
-    m_pen(Dot2QtConsts::componentData().qtColor(gelement->fontColor())),
+    m_pen(gelement->paintAttributes().fontColor),
     m_popup(new QMenu()),
     m_hovered(false),
     m_lastRenderOpRev(0)
 {
 //   kDebug();
-  m_font = FontsCache::changeable().fromName(gelement->fontName());
+  const GraphElementPaintAttributes& pa = gelement->paintAttributes();
+  m_font = FontsCache::changeable().fromName(pa.fontName);
 
 /*  kDebug() << "Creating CanvasElement for "<<gelement->id();
   kDebug() << "    data: " << wdhcf << "," << hdvcf << "," << gh << "," 
     << scaleX << "," << scaleY << "," << xMargin << "," << yMargin << endl;*/
   
-  if (element()->style() == "bold")
+  if (pa.bold)
   {
     m_pen.setStyle(Qt::SolidLine);
     m_pen.setWidth(int(2*((m_scaleX+m_scaleY)/2)));
   }
-  else if (element()->style() != "filled")
+  else if (!pa.filled)
   {
-    m_pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(m_element->style()));
+    m_pen.setStyle(pa.penStyle);
     m_pen.setWidth(int((m_scaleX+m_scaleY)/2));
-    if (element()->style().left(12) == "setlinewidth")
+    if (pa.hasStyleLineWidth)
     {
-      bool ok;
-      uint lineWidth = element()->style().mid(13, m_element->style().length()-1-13).toInt(&ok);
-      m_pen.setWidth(lineWidth * int((m_scaleX+m_scaleY)/2));
+      m_pen.setWidth(pa.styleLineWidth * int((m_scaleX+m_scaleY)/2));
     }
   }
-  if (m_element->style() == "filled")
+  if (pa.filled)
   {
-    m_brush = Dot2QtConsts::componentData().qtColor(element()->backColor());
+    m_brush = pa.backColor;
 //     QCanvasPolygon::drawShape(p);
   }
   else
@@ -114,8 +114,9 @@ CanvasElement::~CanvasElement()
 void CanvasElement::modelChanged()
 {
   kDebug() ;//<< id();
-  m_pen = QPen(Dot2QtConsts::componentData().qtColor(m_element->fontColor()));
-  m_font = FontsCache::changeable().fromName(m_element->fontName());
+  const GraphElementPaintAttributes& pa = m_element->paintAttributes();
+  m_pen = QPen(pa.fontColor);
+  m_font = FontsCache::changeable().fromName(pa.fontName);
   prepareGeometryChange();
   computeBoundingRect();
 }
@@ -143,6 +144,13 @@ QRectF CanvasElement::boundingRect () const
   return m_boundingRect;
 }
 
+void CanvasElement::addMemoryUsage(GraphMemoryUsage& usage) const
+{
+  usage.add(GraphMemoryUsage::CanvasItems, sizeof(CanvasElement));
+  usage.add(GraphMemoryUsage::ItemMenus, sizeof(QMenu) + m_popup->actions().size() * sizeof(KAction));
+  usage.addContainerEntries(GraphMemoryUsage::Caches, m_fontSizeCache.size(), sizeof(int) + sizeof(QPair<int, int>));
+}
+
 void CanvasElement::computeBoundingRect()
 {
 //   kDebug() << element();
@@ -162,35 +170,36 @@ void CanvasElement::computeBoundingRect()
     it = element()->renderOperations().constBegin(); it_end = element()->renderOperations().constEnd();
     for (; it != it_end; it++)
     {
+      const DotRenderOp& dro = *it;
 //       QString msg;
 //       QTextStream dd(&msg);
-//       dd << element()->id() << " an op: " << (*it).renderop << " ";
-//       foreach (int i, (*it).integers)
+//       dd << element()->id() << " an op: " << dro.renderop << " ";
+//       foreach (int i, dro.integers)
 //       {
 //         dd << i << " ";
 //       }
-//       dd << (*it).str;
+//       dd << dro.str;
 //       kDebug() << msg;
 
-      if ((*it).renderop == "e" || (*it).renderop == "E")
+      if (dro.opcode == DotRenderOp::Ellipse || dro.opcode == DotRenderOp::FilledEllipse)
       {
-//         kDebug() << "integers[0]=" << (*it).integers[0] << "; m_wdhcf=" << m_wdhcf
-//             << "(*it).integers[0]/*%m_wdhcf*/=" << (*it).integers[0]/*%m_wdhcf*/;
-        qreal w = m_scaleX * (*it).integers[2] * 2;
-        qreal h = m_scaleY * (*it).integers[3] * 2;
-        qreal x = m_xMargin + (((*it).integers[0]/*%m_wdhcf*/)*m_scaleX) - w/2;
-        qreal y = ((m_gh - (*it).integers[1]/*%m_hdvcf*/)*m_scaleY) + m_yMargin - h/2;
+//         kDebug() << "integers[0]=" << dro.integers[0] << "; m_wdhcf=" << m_wdhcf
+//             << "dro.integers[0]/*%m_wdhcf*/=" << dro.integers[0]/*%m_wdhcf*/;
+        qreal w = m_scaleX * dro.integers[2] * 2;
+        qreal h = m_scaleY * dro.integers[3] * 2;
+        qreal x = m_xMargin + ((dro.integers[0]/*%m_wdhcf*/)*m_scaleX) - w/2;
+        qreal y = ((m_gh - dro.integers[1]/*%m_hdvcf*/)*m_scaleY) + m_yMargin - h/2;
         m_boundingRect = QRectF(x - adjust,y - adjust, w + adjust, h + adjust);
 //         kDebug() << "'" << element()->id() << "' set rect for ellipse to " << rect;
       }
-      else if  ((*it).renderop == "p" || (*it).renderop == "P")
+      else if  (dro.opcode == DotRenderOp::Polygon || dro.opcode == DotRenderOp::FilledPolygon)
       {
-        QPolygonF polygon((*it).integers[0]);
-        for (int i = 0; i < (*it).integers[0]; i++)
+        QPolygonF polygon(dro.integers[0]);
+        for (int i = 0; i < dro.integers[0]; i++)
         {
           qreal x,y;
-          x = ((*it).integers[2*i+1] == m_wdhcf)?(*it).integers[2*i+1]:(*it).integers[2*i+1]/*%m_wdhcf*/;
-          y = ((*it).integers[2*i+2] == m_hdvcf)?(*it).integers[2*i+2]:(*it).integers[2*i+2]/*%m_hdvcf*/;
+          x = (dro.integers[2*i+1] == m_wdhcf)?dro.integers[2*i+1]:dro.integers[2*i+1]/*%m_wdhcf*/;
+          y = (dro.integers[2*i+2] == m_hdvcf)?dro.integers[2*i+2]:dro.integers[2*i+2]/*%m_hdvcf*/;
           {
 
           }
@@ -225,17 +234,17 @@ QWidget *widget)
     widthScaleFactor = 1;
   }
   
-  QString msg;
-  QTextStream dd(&msg);
-  foreach (const DotRenderOp &op, element()->renderOperations())
-  {
-    dd << element()->id() << " an op: " << op.renderop << " ";
-    foreach (int i, op.integers)
-    {
-      dd << i << " ";
-    }
-    dd << op.str << endl;
-  }
+//   QString msg;
+//   QTextStream dd(&msg);
+//   foreach (const DotRenderOp &op, element()->renderOperations())
+//   {
+//     dd << element()->id() << " an op: " << op.renderop << " ";
+//     foreach (int i, op.integers)
+//     {
+//       dd << i << " ";
+//     }
+//     dd << op.str << endl;
+//   }
 //   kDebug() << msg;
 
   if (element()->renderOperations().isEmpty() && m_view->isReadWrite())
@@ -244,20 +253,22 @@ QWidget *widget)
     return;
   }
 
-  QListIterator<DotRenderOp> it(element()->renderOperations());
-//   it.toBack();
+  const DotRenderOpVec& ops = element()->renderOperations();
+  DotRenderOpVec::const_iterator it, it_end;
+  it_end = ops.constEnd();
 
-  QColor lineColor = Dot2QtConsts::componentData().qtColor(element()->lineColor());
-  QColor backColor = Dot2QtConsts::componentData().qtColor(element()->backColor());
+  const GraphElementPaintAttributes& pa = element()->paintAttributes();
+  QColor lineColor = pa.lineColor;
+  QColor backColor = pa.backColor;
   if (m_hovered && m_view->highlighting())
   {
     backColor = backColor.lighter();
   }
   
-  while (it.hasNext())
+  for (it = ops.constBegin(); it != it_end; it++)
   {
-    const DotRenderOp& dro = it.next();
-    if (dro.renderop == "c")
+    const DotRenderOp& dro = *it;
+    if (dro.opcode == DotRenderOp::PenColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -265,7 +276,7 @@ QWidget *widget)
       lineColor = c;
 //       kDebug() << "c" << dro.str.mid(0,7) << lineColor;
     }
-    else if (dro.renderop == "C")
+    else if (dro.opcode == DotRenderOp::FillColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -277,7 +288,7 @@ QWidget *widget)
       backColor = c;
 //       kDebug() << "C" << dro.str.mid(0,7) << backColor;
     }
-    else if (dro.renderop == "e" || dro.renderop == "E")
+    else if (dro.opcode == DotRenderOp::Ellipse || dro.opcode == DotRenderOp::FilledEllipse)
     {
       QPen pen = p->pen();
       qreal w = m_scaleX * dro.integers[2] * 2;
@@ -288,11 +299,9 @@ QWidget *widget)
       p->save();
       p->setBrush(backColor);
       pen.setColor(lineColor);
-      if (element()->attributes().contains("penwidth"))
+      if (pa.hasPenWidth)
       {
-        bool ok;
-        int lineWidth = element()->attributes()["penwidth"].toInt(&ok);
-        pen.setWidth(int(lineWidth * widthScaleFactor));
+        pen.setWidth(int(pa.penWidth * widthScaleFactor));
       }
       p->setPen(pen);
       
@@ -301,7 +310,7 @@ QWidget *widget)
       p->drawEllipse(rect);
       p->restore();
     }
-    else if(dro.renderop == "p" || dro.renderop == "P")
+    else if(dro.opcode == DotRenderOp::Polygon || dro.opcode == DotRenderOp::FilledPolygon)
     {
 //       std::cerr << "Drawing polygon for node '"<<element()->id()<<"': ";
       QPolygonF points(dro.integers[0]);
@@ -322,26 +331,22 @@ QWidget *widget)
 
       QPen pen = p->pen();
       pen.setColor(lineColor);
-      if (element()->style() == "bold")
+      if (pa.bold)
       {
         pen.setStyle(Qt::SolidLine);
         pen.setWidth(2);
       }
-      if (element()->attributes().contains("penwidth"))
+      if (pa.hasPenWidth)
       {
-        bool ok;
-        int lineWidth = element()->attributes()["penwidth"].toInt(&ok);
-        pen.setWidth(int(lineWidth * widthScaleFactor));
+        pen.setWidth(int(pa.penWidth * widthScaleFactor));
       }
-      else if (element()->style() != "filled")
+      else if (!pa.filled)
       {
-        pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(element()->style()));
+        pen.setStyle(pa.penStyle);
       }
-      if (element()->style().left(12) == "setlinewidth")
+      if (pa.hasStyleLineWidth)
       {
-        bool ok;
-        uint lineWidth = element()->style().mid(12, element()->style().length()-1-12).toInt(&ok);
-        pen.setWidth(lineWidth);
+        pen.setWidth(pa.styleLineWidth);
       }
       p->setPen(pen);
       p->setBrush(backColor);
@@ -369,11 +374,10 @@ QWidget *widget)
 
   }
 
-  it.toFront();
-  while (it.hasNext())
+  for (it = ops.constBegin(); it != it_end; it++)
   {
-    const DotRenderOp& dro = it.next();
-    if (dro.renderop == "c")
+    const DotRenderOp& dro = *it;
+    if (dro.opcode == DotRenderOp::PenColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -381,7 +385,7 @@ QWidget *widget)
       lineColor = c;
 //       kDebug() << "c" << dro.str.mid(0,7) << lineColor;
     }
-    else if (dro.renderop == "C")
+    else if (dro.opcode == DotRenderOp::FillColor)
     {
       QColor c(dro.str.mid(0,7));
       bool ok;
@@ -393,7 +397,7 @@ QWidget *widget)
       backColor = c;
 //       kDebug() << "C" << dro.str.mid(0,7) << backColor;
     }
-    else if ( dro.renderop == "L" )
+    else if ( dro.opcode == DotRenderOp::Polyline )
     {
 //       kDebug() << "Label";
       QPolygonF points(dro.integers[0]);
@@ -410,14 +414,14 @@ QWidget *widget)
       }
       p->save();
       QPen pen(lineColor);
-      if (element()->style() == "bold")
+      if (pa.bold)
       {
         pen.setStyle(Qt::SolidLine);
         pen.setWidth(2);
       }
-      else if (element()->style() != "filled")
+      else if (!pa.filled)
       {
-        pen.setStyle(Dot2QtConsts::componentData().qtPenStyle(element()->style()));
+        pen.setStyle(pa.penStyle);
       }
       p->setPen(pen);
 //       kDebug() << element()->id() << "drawPolyline" << points;
@@ -427,28 +431,26 @@ QWidget *widget)
   }
 
 //   kDebug() << "Drawing" << element()->id() << "labels";
-  QString color = lineColor.name();
-  it.toFront();
+  QColor textColor = QColor(lineColor.name());
+  int textFontSize = pa.fontSize;
   uint num_T = 0;
-  while (it.hasNext())
+  for (it = ops.constBegin(); it != it_end; it++)
   {
-    const DotRenderOp& dro = it.next();
-    if (dro.renderop == "c" || dro.renderop == "C")
+    const DotRenderOp& dro = *it;
+    if (dro.opcode == DotRenderOp::PenColor || dro.opcode == DotRenderOp::FillColor)
     {
-      color = dro.str.mid(0,7);
-//       kDebug() << dro.renderop << color;
+      textColor = QColor(dro.str.mid(0,7));
+//       kDebug() << dro.renderop << textColor;
     }
-    else if (dro.renderop == "F")
+    else if (dro.opcode == DotRenderOp::Font)
     {
-      element()->setFontName(dro.str);
-      element()->setFontSize(dro.integers[0]);
-//       kDebug() << "F" << element()->fontName() << element()->fontColor() << element()->fontSize();
+      textFontSize = qRound(dro.integers[0]);
+//       kDebug() << "F" << dro.str << textFontSize;
     }
-    else if ( dro.renderop == "T" )
+    else if ( dro.opcode == DotRenderOp::Text )
     {
       ++num_T;
       // we suppose here that the color has been set just before
-      element()->setFontColor(color);
       // draw a label
 //       kDebug() << "Drawing a label " << dro.integers[0]
 //       << " " << dro.integers[1] << " " << dro.integers[2]
@@ -469,7 +471,7 @@ QWidget *widget)
       }
       if (!cacheValid) {
         int stringWidthGoal = int(dro.integers[3] * m_scaleX);
-        int fontSize = element()->fontSize();
+        int fontSize = textFontSize;
         m_font->setPointSize(fontSize);
 
         QFontMetrics fm(*m_font);
@@ -488,7 +490,7 @@ QWidget *widget)
       p->save();
       p->setFont(*m_font);
       QPen pen(m_pen);
-      pen.setColor(element()->fontColor());
+      pen.setColor(textColor);
       p->setPen(pen);
       qreal x = (m_scaleX *
                        (
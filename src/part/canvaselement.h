@@ -36,6 +36,7 @@ class QGraphicsScene;
 namespace KGraphViewer
 {
 class GraphElement;
+class GraphMemoryUsage;
 class DotGraphView;
 
 class CanvasElement: public QObject, public QAbstractGraphicsShapeItem
@@ -64,6 +65,9 @@ public:
                   qreal wdhcf, qreal hdvcf);
 
   inline void setGh(qreal gh) {m_gh = gh;}
+
+  /** Adds the bytes used by the item, its popup menu and its caches */
+  void addMemoryUsage(GraphMemoryUsage& usage) const;
   
   protected:
   virtual void mouseMoveEvent ( QGraphicsSceneMouseEvent * event );
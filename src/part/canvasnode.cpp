@@ -61,7 +61,6 @@ CanvasNode::CanvasNode(DotGraphView* v,
 
 {
   kDebug() << s->id();
-  connect(s,SIGNAL(changed()),this,SLOT(modelChanged()));
 
   QString tipStr;
   QString id = s->id();
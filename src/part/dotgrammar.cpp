@@ -24,12 +24,17 @@
 #include "DotGraphParsingHelper.h"
 
 #include <iostream>
+#include <limits.h>
+#include <math.h>
 
 #include <kdebug.h>
     
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
 
 #include <boost/spirit/include/classic_confix.hpp>
+#include <boost/bind.hpp>
 #include <boost/throw_exception.hpp> 
 namespace boost
 {
@@ -46,22 +51,17 @@ using namespace KGraphViewer;
 #define KGV_MAX_ITEMS_TO_LOAD std::numeric_limits<size_t>::max()
 #define BOOST_SPIRIT_DEBUG 1
 
-DotGraphParsingHelper* phelper = 0;
-
-std::string therenderop;
-std::string thestr;
-
-void anychar(char const c);
-
 // keyword_p for C++
 // (for basic usage instead of std_p)
 const boost::spirit::classic::distinct_parser<> keyword_p("0-9a-zA-Z_");
 
 template <typename ScannerT>
-DotGrammar::definition<ScannerT>::definition(DotGrammar const& /*self*/)
+DotGrammar::definition<ScannerT>::definition(DotGrammar const& self)
 {
-  graph  = (!(keyword_p("strict")[&strict]) >> (keyword_p("graph")[&undigraph] | keyword_p("digraph")[&digraph])
-  >> !ID[&graphid] >> ch_p('{') >> !stmt_list >> ch_p('}'))[&finalactions];
+  DotGraphParsingHelper* phelper = self.phelper;
+
+  graph  = (!(keyword_p("strict")[boost::bind(&strict, phelper, _1, _2)]) >> (keyword_p("graph")[boost::bind(&undigraph, phelper, _1, _2)] | keyword_p("digraph")[boost::bind(&digraph, phelper, _1, _2)])
+  >> !ID[boost::bind(&graphid, phelper, _1, _2)] >> ch_p('{') >> !stmt_list >> ch_p('}'))[boost::bind(&finalactions, phelper, _1, _2)];
   ID = (
   ( ( (anychar_p - punct_p) | '_' ) >> *( (anychar_p - punct_p) | '_' ) )
   | real_p
@@ -79,22 +79,22 @@ DotGrammar::definition<ScannerT>::definition(DotGrammar const& /*self*/)
   );
 
   attr_stmt  = (
-  (keyword_p("graph")[assign_a(phelper->attributed)] >> attr_list[&setattributedlist])[&setgraphattributes]
-  | (keyword_p("node")[assign_a(phelper->attributed)] >> attr_list[&setattributedlist])
-  | (keyword_p("edge")[assign_a(phelper->attributed)] >> attr_list[&setattributedlist])
+  (keyword_p("graph")[assign_a(phelper->attributed)] >> attr_list[boost::bind(&setattributedlist, phelper, _1, _2)])[boost::bind(&setgraphattributes, phelper, _1, _2)]
+  | (keyword_p("node")[assign_a(phelper->attributed)] >> attr_list[boost::bind(&setattributedlist, phelper, _1, _2)])
+  | (keyword_p("edge")[assign_a(phelper->attributed)] >> attr_list[boost::bind(&setattributedlist, phelper, _1, _2)])
   ) ;
 
   attr_list  = ch_p('[') >> !( a_list ) >> ch_p(']');
-  a_list  =  ((ID[&attrid] >> !( '=' >> ID[&valid] ))[&addattr] >> !(',' >> a_list ));
-  edge_stmt  =  ( (node_id[&edgebound] | subgraph) >>  edgeRHS >> !( attr_list[assign_a(phelper->attributed,"edge")] ) )[&pushAttrList][&setattributedlist][&createedges][&popAttrList];
-  edgeRHS  =  edgeop[&checkedgeop] >> (node_id[&edgebound] | subgraph) >> !( edgeRHS );
+  a_list  =  ((ID[boost::bind(&attrid, phelper, _1, _2)] >> !( '=' >> ID[boost::bind(&valid, phelper, _1, _2)] ))[boost::bind(&addattr, phelper, _1, _2)] >> !(',' >> a_list ));
+  edge_stmt  =  ( (node_id[boost::bind(&edgebound, phelper, _1, _2)] | subgraph) >>  edgeRHS >> !( attr_list[assign_a(phelper->attributed,"edge")] ) )[boost::bind(&createedges, phelper, _1, _2)];
+  edgeRHS  =  edgeop[boost::bind(&checkedgeop, phelper, _1, _2)] >> (node_id[boost::bind(&edgebound, phelper, _1, _2)] | subgraph) >> !( edgeRHS );
   edgeop = str_p("->") | str_p("--");
-  node_stmt  = ( node_id[&createnode] >> !( attr_list ) )[assign_a(phelper->attributed,"node")][&pushAttrList][&setattributedlist][&setnodeattributes][&popAttrList];
+  node_stmt  = ( node_id[boost::bind(&createnode, phelper, _1, _2)] >> !( attr_list ) )[assign_a(phelper->attributed,"node")][boost::bind(&setnodeattributes, phelper, _1, _2)];
   node_id  =  (ID >> !( port ));
   port  =  ( ch_p(':') >> ID >> !( ':' >> compass_pt ) )
   |  ( ':' >> compass_pt );
-  subgraph  =  ( !( keyword_p("subgraph") >> !( ID[&subgraphid] ) ) >> ch_p('{')[&createsubgraph][&incrz][&pushAttrListC] >> stmt_list >> ch_p('}') [&decrz][&popAttrListC])
-  |  ( keyword_p("subgraph") >> ID[&subgraphid]);
+  subgraph  =  ( !( keyword_p("subgraph") >> !( ID[boost::bind(&subgraphid, phelper, _1, _2)] ) ) >> ch_p('{')[boost::bind(&createsubgraph, phelper, _1)][boost::bind(&incrz, phelper, _1)][boost::bind(&pushAttrListC, phelper, _1)] >> stmt_list >> ch_p('}') [boost::bind(&decrz, phelper, _1)][boost::bind(&popAttrListC, phelper, _1)])
+  |  ( keyword_p("subgraph") >> ID[boost::bind(&subgraphid, phelper, _1, _2)]);
   compass_pt  =  (keyword_p("n") | keyword_p("ne") | keyword_p("e")
   | keyword_p("se") | keyword_p("s") | keyword_p("sw")
   | keyword_p("w") | keyword_p("nw") );
@@ -103,7 +103,7 @@ DotGrammar::definition<ScannerT>::definition(DotGrammar const& /*self*/)
 
 
 
-void incrz(char const /*first*/)
+void incrz(DotGraphParsingHelper* phelper, char const /*first*/)
 {
   if (phelper)
   {
@@ -115,12 +115,7 @@ void incrz(char const /*first*/)
   }
 }
 
-void anychar(char const c)
-{
-//   kDebug() << c;
-}
-
-void decrz(char const /*first*/)
+void decrz(DotGraphParsingHelper* phelper, char const /*first*/)
 {
   if (phelper)
   {
@@ -129,42 +124,42 @@ void decrz(char const /*first*/)
   }
 }
 
-void dump(char const* first, char const* last)
+void dump(DotGraphParsingHelper* /*phelper*/, char const* first, char const* last)
 {
   std::string str(first, last);
   kError() << ">>>> " << QString::fromStdString(str) << " <<<<" << endl;
 }
 
-void strict(char const* /*first*/, char const* /*last*/)
+void strict(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
   if (phelper) phelper->graph->strict(true);
 }
 
-void gotid(char const* first, char const* last)
+void gotid(DotGraphParsingHelper* /*phelper*/, char const* first, char const* last)
 {
   std::string id(first,last);
 //   kDebug() << "Got ID  = '"<<QString::fromStdString(phelper->attrid)<<"'";
 }
 
-void undigraph(char const* /*first*/, char const* /*last*/)
+void undigraph(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "Setting graph as undirected";
   if (phelper) phelper->graph->directed(false);
 }
 
-void digraph(char const* /*first*/, char const* /*last*/)
+void digraph(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "Setting graph as directed";
   if (phelper) phelper->graph->directed(true);
 }
 
-void graphid(char const* first, char const* last)
+void graphid(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
 //   kDebug() << QString::fromStdString(std::string(first,last));
   if (phelper) phelper->graph->setId(QString::fromStdString(std::string(first,last)));
 }
 
-void attrid(char const* first, char const* last)
+void attrid(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
   if (phelper) 
   {
@@ -177,7 +172,7 @@ void attrid(char const* first, char const* last)
   }
 }
 
-void subgraphid(char const* first, char const* last)
+void subgraphid(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
   std::string id(first,last);
 //   kDebug() << QString::fromStdString(id);
@@ -190,7 +185,7 @@ void subgraphid(char const* first, char const* last)
   }
 }
 
-void valid(char const* first, char const* last)
+void valid(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
   std::string id(first,last);
   if (phelper)
@@ -202,51 +197,44 @@ void valid(char const* first, char const* last)
   }
 }
 
-void addattr(char const* /*first*/, char const* /*last*/)
+void addattr(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
   if (phelper) 
   {
-    phelper->attributes.insert(std::make_pair(phelper->attrid,phelper->valid));
+    phelper->addAttribute(phelper->attrid, phelper->valid);
   }
 }
 
-void pushAttrListC(char const /*c*/)
+void pushAttrListC(DotGraphParsingHelper* phelper, char const /*c*/)
 {
-  pushAttrList(0,0);
+  pushAttrList(phelper,0,0);
 }
 
-void pushAttrList(char const* /*first*/, char const* /*last*/)
+void pushAttrList(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "Pushing attributes";
   if (phelper)
   {
-    phelper->graphAttributesStack.push_back(phelper->graphAttributes);
-    phelper->nodesAttributesStack.push_back(phelper->nodesAttributes);
-    phelper->edgesAttributesStack.push_back(phelper->edgesAttributes);
+    phelper->pushAttrList();
   }
 }
 
-void popAttrListC(char const /*c*/)
+void popAttrListC(DotGraphParsingHelper* phelper, char const /*c*/)
 {
-  popAttrList(0,0);
+  popAttrList(phelper,0,0);
 }
 
-void popAttrList(char const* /*first*/, char const* /*last*/)
+void popAttrList(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "Poping attributes";
   if (phelper) 
   {
-    phelper->graphAttributes = phelper->graphAttributesStack.back();
-    phelper->graphAttributesStack.pop_back();
-    phelper->nodesAttributes = phelper->nodesAttributesStack.back();
-    phelper->nodesAttributesStack.pop_back();
-    phelper->edgesAttributes = phelper->edgesAttributesStack.back();
-    phelper->edgesAttributesStack.pop_back();
+    phelper->popAttrList();
   }
 //   kDebug() << "Poped";
 }
 
-void createnode(char const* first, char const* last)
+void createnode(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
 //   kDebug() << (void*)first << (void*)last << QString::fromStdString(std::string(first,last));
   if (phelper!=0 && first!=0 && last != 0) 
@@ -258,7 +246,7 @@ void createnode(char const* first, char const* last)
   }
 }
 
-void createsubgraph(char const /*c*/)
+void createsubgraph(DotGraphParsingHelper* phelper, char const /*c*/)
 {
   if (phelper) 
   {
@@ -266,7 +254,7 @@ void createsubgraph(char const /*c*/)
   }
 }
 
-void setgraphattributes(char const* /*first*/, char const* /*last*/)
+void setgraphattributes(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "setgraphattributes with z = " << phelper->z;
   if (phelper) 
@@ -282,7 +270,7 @@ void setgraphattributes(char const* /*first*/, char const* /*last*/)
   }
 }
 
-void setnodeattributes(char const* /*first*/, char const* /*last*/)
+void setnodeattributes(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
 //   kDebug() << "setnodeattributes with z = " << phelper->z;
   if (phelper) 
@@ -291,7 +279,7 @@ void setnodeattributes(char const* /*first*/, char const* /*last*/)
   }
 }
 
-void setattributedlist(char const* /*first*/, char const* /*last*/)
+void setattributedlist(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
   if (phelper) 
   {
@@ -299,7 +287,7 @@ void setattributedlist(char const* /*first*/, char const* /*last*/)
   }
 }
 
-void checkedgeop(char const* first, char const* last)
+void checkedgeop(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
   std::string str(first,last);
   if (phelper) 
@@ -312,7 +300,7 @@ void checkedgeop(char const* first, char const* last)
   }
 }
 
-void edgebound(char const* first, char const* last)
+void edgebound(DotGraphParsingHelper* phelper, char const* first, char const* last)
 {
 //   kDebug() << "edgebound: " << QString::fromStdString(std::string(first,last));
   if (phelper) 
@@ -324,7 +312,7 @@ void edgebound(char const* first, char const* last)
   }
 }
 
-void createedges(char const* /*first*/, char const* /*last*/)
+void createedges(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
   if (phelper) 
   {
@@ -332,7 +320,7 @@ void createedges(char const* /*first*/, char const* /*last*/)
   }
 }
 
-void finalactions(char const* /*first*/, char const* /*last*/)
+void finalactions(DotGraphParsingHelper* phelper, char const* /*first*/, char const* /*last*/)
 {
   if (phelper) 
   {
@@ -342,16 +330,16 @@ void finalactions(char const* /*first*/, char const* /*last*/)
 
 bool parse_point(char const* str, QPoint& p)
 {
-  int x,y;
+  double x,y;
   bool res;
   res = parse(str,
               (
-                int_p[assign_a(x)] >> ',' >> int_p[assign_a(y)]
+                real_p[assign_a(x)] >> ',' >> real_p[assign_a(y)]
               )
               ,
               +space_p).full;
   if (!res) return false;
-  p = QPoint(x,y);
+  p = QPoint(qRound(x),qRound(y));
   return true;
 }
 
@@ -412,22 +400,32 @@ bool parse_integers(char const* str, std::vector<int>& v)
                +space_p).full;
 }
 
+bool parse_reals(char const* str, std::vector<double>& v)
+{
+  return parse(str,
+               (
+                 real_p[push_back_a(v)] >> *(',' >> real_p[push_back_a(v)])
+               )
+               ,
+               +space_p).full;
+}
+
 bool parse_spline(char const* str, QVector< QPair< float, float > >& points)
 {
 //   kDebug() << "Parsing spline..." << QString::fromStdString(str);
   char e = 'n', s = 'n';
-  int sx,sy,ex,ey;
+  float sx,sy,ex,ey;
   QPair< float, float > p;
   bool res;
   res = parse(str,
               (
-                !(ch_p('e')[assign_a(e)] >> ',' >> int_p[assign_a(ex)] >> ',' >> int_p[assign_a(ey)]) 
-                >> !(ch_p('s')[assign_a(s)] >> ',' >> int_p[assign_a(sx)] >> ',' >> int_p[assign_a(sy)])
-                >> ((int_p[assign_a(p.first)] >> ',' >> int_p[assign_a(p.second)]))[push_back_a(points,p)] 
+                !(ch_p('e')[assign_a(e)] >> ',' >> real_p[assign_a(ex)] >> ',' >> real_p[assign_a(ey)]) 
+                >> !(ch_p('s')[assign_a(s)] >> ',' >> real_p[assign_a(sx)] >> ',' >> real_p[assign_a(sy)])
+                >> ((real_p[assign_a(p.first)] >> ',' >> real_p[assign_a(p.second)]))[push_back_a(points,p)] 
                 >> +(
-                      (int_p[assign_a(p.first)] >> ',' >> int_p[assign_a(p.second)])[push_back_a(points,p)] >> 
-                      (int_p[assign_a(p.first)] >> ',' >> int_p[assign_a(p.second)])[push_back_a(points,p)] >> 
-                      (int_p[assign_a(p.first)] >> ',' >> int_p[assign_a(p.second)])[push_back_a(points,p)]
+                      (real_p[assign_a(p.first)] >> ',' >> real_p[assign_a(p.second)])[push_back_a(points,p)] >> 
+                      (real_p[assign_a(p.first)] >> ',' >> real_p[assign_a(p.second)])[push_back_a(points,p)] >> 
+                      (real_p[assign_a(p.first)] >> ',' >> real_p[assign_a(p.second)])[push_back_a(points,p)]
                     )
               )
               ,
@@ -436,7 +434,7 @@ bool parse_spline(char const* str, QVector< QPair< float, float > >& points)
   if (s == 's')
   {
 //     kDebug() << "inserting the s point";
-    points.insert(points.begin(), qMakePair(float(sx),float(sy)));
+    points.insert(points.begin(), qMakePair(sx,sy));
   }
   if (e == 'e')
   {
@@ -445,37 +443,60 @@ bool parse_spline(char const* str, QVector< QPair< float, float > >& points)
   return true;
 }
 
-DotRenderOp renderop ;
+/**
+ * The state of one parse_renderop call: the operation being read and the
+ * vector receiving the completed ones
+ */
+struct RenderOpParsingContext
+{
+  RenderOpParsingContext(DotRenderOpVec& vec, DotStringPool* pool) :
+    renderopvec(vec), strings(pool) {}
 
-DotRenderOpVec* renderopvec = 0;
+  std::vector< float > integers;
+  std::string therenderop;
+  std::string thestr;
+  DotRenderOpVec& renderopvec;
+  DotStringPool* strings;
+};
 
-void init_op()
+/** Semantic action storing the render operation read in its context */
+struct ValidOp
 {
-  renderop = DotRenderOp();
-}
+  explicit ValidOp(RenderOpParsingContext& context) : ctx(context) {}
 
-void valid_op(char const* first, char const* last)
-{
-  std::string s(first, last);
-  renderop.renderop = QString::fromUtf8(therenderop.c_str());
-  renderop.str = QString::fromUtf8(thestr.c_str());
+  void operator()(char const* /*first*/, char const* /*last*/) const
+  {
+    DotRenderOp::Opcode op = DotRenderOp::opcodeOf(ctx.therenderop.empty() ? 0 : ctx.therenderop[0]);
+    QString str;
+    if (!ctx.thestr.empty())
+    {
+      str = (ctx.strings != 0)
+          ? ctx.strings->intern(ctx.thestr.data(), ctx.thestr.data() + ctx.thestr.size())
+          : QString::fromUtf8(ctx.thestr.c_str());
+    }
 
-//   kDebug() << "Validating render operation '"<<QString::fromStdString(s)<<"': '"<<renderop.renderop<<"/"<<renderop.str<<"'";
-  renderopvec->push_back(renderop);
-  renderop.renderop = "";
-  renderop.integers = QList<int>();
-  renderop.str = "";
-}
+//     kDebug() << "Validating render operation '"<<QString::fromStdString(ctx.therenderop)<<"/"<<str<<"'";
+    ctx.renderopvec.append(op, ctx.integers.empty() ? 0 : &ctx.integers[0], ctx.integers.size(), str);
+    ctx.therenderop.clear();
+    ctx.integers.clear();
+    ctx.thestr.clear();
+  }
+
+  RenderOpParsingContext& ctx;
+};
 
-bool parse_renderop(const std::string& str, DotRenderOpVec& arenderopvec)
+bool parse_renderop_spirit(const std::string& str, DotRenderOpVec& arenderopvec, DotStringPool* strings)
 {
 //   kDebug() << QString::fromUtf8(str.c_str()) << str.size();
   if (str.empty())
   {
     return false;
   }
-  init_op();
-  renderopvec = &arenderopvec;
+  RenderOpParsingContext ctx(arenderopvec, strings);
+  std::vector< float >& integers = ctx.integers;
+  std::string& therenderop = ctx.therenderop;
+  std::string& thestr = ctx.thestr;
+  ValidOp valid_op(ctx);
   bool res;
   int c;
   res = parse(str.c_str(),
@@ -483,54 +504,300 @@ bool parse_renderop(const std::string& str, DotRenderOpVec& arenderopvec)
                 +(
                    (
                      (ch_p('E')|ch_p('e'))[assign_a(therenderop)] >> +space_p >>
-                     repeat_p(4)[int_p[push_back_a(renderop.integers)] >> +space_p]
-                   )[&valid_op] 
+                     repeat_p(4)[int_p[push_back_a(integers)] >> +space_p]
+                   )[valid_op] 
                    | (
                        (ch_p('P')|ch_p('p')|ch_p('L')|ch_p('B')|ch_p('b'))[assign_a(therenderop)] >> +space_p >>
-                       int_p[assign_a(c)][push_back_a(renderop.integers)] >> +space_p >> 
+                       int_p[assign_a(c)][push_back_a(integers)] >> +space_p >> 
                        repeat_p(boost::ref(c))[
-                                                int_p[push_back_a(renderop.integers)] >> +space_p >> 
-                                                int_p[push_back_a(renderop.integers)] >> +space_p
+                                                int_p[push_back_a(integers)] >> +space_p >> 
+                                                int_p[push_back_a(integers)] >> +space_p
                                               ] 
-                     )[&valid_op]
+                     )[valid_op]
   // "T 1537 228 0 40 9 -#1 (== 0) T 1537 217 0 90 19 -MAIN:./main/main.pl "
                    | (
                        ch_p('T')[assign_a(therenderop)] >> +space_p >>
-                       int_p[push_back_a(renderop.integers)] >> +space_p >> 
-                       int_p[push_back_a(renderop.integers)] >> +space_p >> 
-                       int_p[push_back_a(renderop.integers)] >> +space_p >> 
-                       int_p[push_back_a(renderop.integers)] >> +space_p >> 
+                       int_p[push_back_a(integers)] >> +space_p >> 
+                       int_p[push_back_a(integers)] >> +space_p >> 
+                       int_p[push_back_a(integers)] >> +space_p >> 
+                       int_p[push_back_a(integers)] >> +space_p >> 
                        int_p[assign_a(c)] >> +space_p >> '-' >> 
                        (repeat_p(boost::ref(c))[anychar_p])[assign_a(thestr)] >> +space_p
-                     )[&valid_op]
+                     )[valid_op]
   // c 9 -#000000ff 
                      | (
                        (ch_p('C')|ch_p('c')|ch_p('S'))[assign_a(therenderop)] >> +space_p >>
                        int_p[assign_a(c)] >> +space_p >> '-' >> 
                        (repeat_p(boost::ref(c))[anychar_p])[assign_a(thestr)] >> +space_p
-                     )[&valid_op] 
+                     )[valid_op] 
   // F 14,000000 11 -Times-Roman 
                     | (
                        ch_p('F')[assign_a(therenderop)] >> +space_p >>
-                       int_p[push_back_a(renderop.integers)] >> (ch_p(',')|ch_p('.')) >> int_p >> +space_p >>
+                       int_p[push_back_a(integers)] >> (ch_p(',')|ch_p('.')) >> int_p >> +space_p >>
                        int_p[assign_a(c)] >> +space_p >> '-' >> 
                        (repeat_p(boost::ref(c))[anychar_p])[assign_a(thestr)] >> +space_p
-                     )[&valid_op]
+                     )[valid_op]
                  )
                  ) >> !end_p
              ).full;
   if (res ==false)
   {
-    kError() << "ERROR: parse_renderop failed on "<< QString::fromStdString(str);
+    kError() << "ERROR: parse_renderop_spirit failed on "<< QString::fromStdString(str);
     kError() << "       Last renderop string is "<<QString::fromStdString(str.c_str());
   }
 //   delete renderop; renderop = 0;
   return res;
 }
 
-bool parse(const std::string& str)
+static const double powersOf10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline void skipSpaces(const char*& p, const char* last)
+{
+  while (p != last && isSpace(*p))
+  {
+    p++;
+  }
+}
+
+/**
+ * Reads the decimal number starting at p, with an optional fraction and
+ * exponent, and moves p after it. Unlike strtod or streams, it does not
+ * depend on the locale. A comma can also be accepted as the decimal point,
+ * as written in font sizes by some graphviz versions.
+ */
+static bool scanNumber(const char*& p, const char* last, float& value, bool commaIsPoint = false)
+{
+  const char* s = p;
+  bool negative = false;
+  if (s != last && (*s == '-' || *s == '+'))
+  {
+    negative = (*s == '-');
+    s++;
+  }
+  double mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  while (s != last && isDigit(*s))
+  {
+    mantissa = mantissa * 10 + (*s - '0');
+    digits++;
+    s++;
+  }
+  if (s != last && (*s == '.' || (commaIsPoint && *s == ',')))
+  {
+    s++;
+    while (s != last && isDigit(*s))
+    {
+      mantissa = mantissa * 10 + (*s - '0');
+      exponent--;
+      digits++;
+      s++;
+    }
+  }
+  if (digits == 0)
+  {
+    return false;
+  }
+  if (s != last && (*s == 'e' || *s == 'E'))
+  {
+    const char* e = s + 1;
+    bool negativeExponent = false;
+    if (e != last && (*e == '-' || *e == '+'))
+    {
+      negativeExponent = (*e == '-');
+      e++;
+    }
+    if (e != last && isDigit(*e))
+    {
+      int n = 0;
+      while (e != last && isDigit(*e))
+      {
+        if (n < 1000)
+        {
+          n = n * 10 + (*e - '0');
+        }
+        e++;
+      }
+      exponent += negativeExponent ? -n : n;
+      s = e;
+    }
+  }
+  // exact for the usual xdot numbers, which have less than 16 digits
+  double result = mantissa;
+  if (exponent < 0)
+  {
+    result = (exponent >= -22) ? result / powersOf10[-exponent] : result * pow(10.0, exponent);
+  }
+  else if (exponent > 0)
+  {
+    result = (exponent <= 22) ? result * powersOf10[exponent] : result * pow(10.0, exponent);
+  }
+  value = float(negative ? -result : result);
+  p = s;
+  return true;
+}
+
+/** Reads a points or bytes count */
+static bool scanCount(const char*& p, const char* last, int& count)
+{
+  if (p == last || !isDigit(*p))
+  {
+    return false;
+  }
+  count = 0;
+  while (p != last && isDigit(*p))
+  {
+    if (count > (INT_MAX - 9) / 10)
+    {
+      return false;
+    }
+    count = count * 10 + (*p - '0');
+    p++;
+  }
+  return true;
+}
+
+static bool scanNumbers(const char*& p, const char* last, int count, std::vector< float >& numbers)
+{
+  for (int i = 0; i < count; i++)
+  {
+    skipSpaces(p, last);
+    float value;
+    if (!scanNumber(p, last, value))
+    {
+      return false;
+    }
+    numbers.push_back(value);
+  }
+  return true;
+}
+
+/** Reads the "n -bytes" text ending the C, c, F, S and T operations */
+static bool scanText(const char*& p, const char* last, DotStringPool* strings, QString& text)
 {
-  DotGrammar g;
+  int size;
+  skipSpaces(p, last);
+  if (!scanCount(p, last, size))
+  {
+    return false;
+  }
+  skipSpaces(p, last);
+  if (p == last || *p != '-' || last - (p + 1) < size)
+  {
+    return false;
+  }
+  p++;
+  if (size > 0)
+  {
+    text = (strings != 0) ? strings->intern(p, p + size) : QString::fromUtf8(p, size);
+  }
+  p += size;
+  return true;
+}
+
+bool parse_renderop(const char* first, const char* last, DotRenderOpVec& arenderopvec, DotStringPool* strings)
+{
+  std::vector< float > numbers;
+  int ops = 0;
+  const char* p = first;
+  skipSpaces(p, last);
+  while (p != last)
+  {
+    DotRenderOp::Opcode op = DotRenderOp::opcodeOf(*p);
+    p++;
+    numbers.clear();
+    QString text;
+    // the opcode and each operation are followed by blanks
+    bool ok = (p != last && isSpace(*p));
+    if (ok)
+    {
+      switch (op)
+      {
+        case DotRenderOp::FilledEllipse:
+        case DotRenderOp::Ellipse:
+          ok = scanNumbers(p, last, 4, numbers);
+          break;
+        case DotRenderOp::FilledPolygon:
+        case DotRenderOp::Polygon:
+        case DotRenderOp::Polyline:
+        case DotRenderOp::BSpline:
+        case DotRenderOp::FilledBSpline:
+        {
+          int count;
+          skipSpaces(p, last);
+          ok = scanCount(p, last, count) && count <= (last - p) / 2;
+          if (ok)
+          {
+            numbers.reserve(2 * count + 1);
+            numbers.push_back(count);
+            ok = scanNumbers(p, last, 2 * count, numbers);
+          }
+          break;
+        }
+        case DotRenderOp::Text:
+          ok = scanNumbers(p, last, 4, numbers) && scanText(p, last, strings, text);
+          break;
+        case DotRenderOp::FillColor:
+        case DotRenderOp::PenColor:
+        case DotRenderOp::Style:
+          ok = scanText(p, last, strings, text);
+          break;
+        case DotRenderOp::Font:
+        {
+          float size;
+          skipSpaces(p, last);
+          ok = scanNumber(p, last, size, true);
+          if (ok)
+          {
+            numbers.push_back(size);
+            ok = scanText(p, last, strings, text);
+          }
+          break;
+        }
+        default:
+          ok = false;
+      }
+    }
+    if (!ok || (p != last && !isSpace(*p)))
+    {
+      kError() << "ERROR: parse_renderop failed on" << QString::fromUtf8(first, last - first)
+          << "at" << (p - first);
+      return false;
+    }
+    arenderopvec.append(op, numbers.empty() ? 0 : &numbers[0], numbers.size(), text);
+    ops++;
+    skipSpaces(p, last);
+  }
+  return ops > 0;
+}
+
+bool parse_renderop(const std::string& str, DotRenderOpVec& arenderopvec, DotStringPool* strings)
+{
+  return parse_renderop(str.data(), str.data() + str.size(), arenderopvec, strings);
+}
+
+// Spirit classic grammars share their definitions cache between instances
+// without locking: only the semantic actions state can be per parse
+static QMutex grammarMutex;
+
+bool parse(const std::string& str, DotGraphParsingHelper* phelper)
+{
+  QMutexLocker locker(&grammarMutex);
+
+  DotGrammar g(phelper);
   return boost::spirit::classic::parse(str.c_str(), g >> end_p, (+boost::spirit::classic::space_p|boost::spirit::classic::comment_p("/*", "*/"))).full;
 }
 
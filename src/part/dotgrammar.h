@@ -24,6 +24,7 @@
 #define DOT_GRAMMAR_H
 
 #include "dotrenderop.h"
+#include "kgraphviewer_export.h"
 
 #include <boost/throw_exception.hpp>
 #include <boost/spirit/include/classic_core.hpp>
@@ -40,46 +41,66 @@
 #include <string>
 #include <sstream>
 
-bool parse(const std::string& str);
-
-void gotid(char const* first, char const* last);
-void dump(char const* first, char const* last);
-void strict(char const* first, char const* last);
-void undigraph(char const* first, char const* last);
-void digraph(char const* first, char const* last);
-void graphid(char const* first, char const* last);
-void attrid(char const* first, char const* last);
-void subgraphid(char const* first, char const* last);
-void valid(char const* first, char const* last);
-void addattr(char const* first, char const* last);
-void pushAttrListC(char const c);
-void popAttrListC(char const c);
-void pushAttrList(char const* first, char const* last);
-void popAttrList(char const* first, char const* last);
-void createsubgraph(char const);
-void createnode(char const* first, char const* last);
-void setgraphattributes(char const* first, char const* last);
-void setsubgraphattributes(char const* first, char const* last);
-void setnodeattributes(char const* first, char const* last);
-void setattributedlist(char const* first, char const* last);
-void checkedgeop(char const* first, char const* last);
-void edgebound(char const* first, char const* last);
-void createedges(char const* first, char const* last);
-void incrz(char const);
-void decrz(char const);
-void finalactions(char const* first, char const* last);
+namespace KGraphViewer
+{
+struct DotGraphParsingHelper;
+}
+
+bool parse(const std::string& str, KGraphViewer::DotGraphParsingHelper* phelper);
+
+void gotid(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void dump(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void strict(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void undigraph(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void digraph(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void graphid(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void attrid(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void subgraphid(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void valid(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void addattr(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void pushAttrListC(KGraphViewer::DotGraphParsingHelper* phelper, char const c);
+void popAttrListC(KGraphViewer::DotGraphParsingHelper* phelper, char const c);
+void pushAttrList(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void popAttrList(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void createsubgraph(KGraphViewer::DotGraphParsingHelper* phelper, char const);
+void createnode(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void setgraphattributes(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void setsubgraphattributes(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void setnodeattributes(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void setattributedlist(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void checkedgeop(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void edgebound(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void createedges(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
+void incrz(KGraphViewer::DotGraphParsingHelper* phelper, char const);
+void decrz(KGraphViewer::DotGraphParsingHelper* phelper, char const);
+void finalactions(KGraphViewer::DotGraphParsingHelper* phelper, char const* first, char const* last);
 
 bool parse_point(char const* str, QPoint& p);
 bool parse_real(char const* str, double& d);
 bool parse_integers(char const* str, std::vector<int>& v);
+bool parse_reals(char const* str, std::vector<double>& v);
 bool parse_spline(char const* str, QVector< QPair< float, float > >& points);
-void init_op();
-void valid_op(char const* first, char const* last);
-bool parse_renderop(const std::string& str, DotRenderOpVec& arenderopvec);
+/**
+ * Appends the xdot render operations described by [first, last) to
+ * arenderopvec. Coordinates can be fractional. When a pool is given, the
+ * operations strings are shared through it.
+ */
+bool KGRAPHVIEWER_EXPORT parse_renderop(const char* first, const char* last,
+                                        DotRenderOpVec& arenderopvec, DotStringPool* strings = 0);
+bool KGRAPHVIEWER_EXPORT parse_renderop(const std::string& str, DotRenderOpVec& arenderopvec,
+                                        DotStringPool* strings = 0);
+/**
+ * The former Spirit based decoder, only accepting integer coordinates. It is
+ * kept to compare both decoders in the parser benchmark.
+ */
+bool KGRAPHVIEWER_EXPORT parse_renderop_spirit(const std::string& str, DotRenderOpVec& arenderopvec,
+                                               DotStringPool* strings = 0);
 bool parse_numeric_color(char const* str, QColor& c);
 
 struct DotGrammar : public boost::spirit::classic::grammar<DotGrammar>
 {
+  explicit DotGrammar(KGraphViewer::DotGraphParsingHelper* helper) : phelper(helper) {}
+
   template <typename ScannerT>
   struct definition
   {
@@ -95,7 +116,9 @@ struct DotGrammar : public boost::spirit::classic::grammar<DotGrammar>
       return graph;
     }
   };
-  
+
+  /** The parsing state the semantic actions work on */
+  KGraphViewer::DotGraphParsingHelper* phelper;
 };
 
 
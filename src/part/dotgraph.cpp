@@ -20,6 +20,8 @@
 #include "dotgrammar.h"
 #include "graphexporter.h"
 #include "DotGraphParsingHelper.h"
+#include "layoutcache.h"
+#include "dotparser.h"
 #include "canvasedge.h"
 #include "canvassubgraph.h"
 
@@ -27,8 +29,8 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "fdstream.hpp"
-#include <boost/spirit/include/classic_confix.hpp>
 #include <graphviz/gvc.h>
 
 #include <kdebug.h>
@@ -39,66 +41,233 @@
 #include <QByteArray>
 #include <QProcess>
 #include <QMutexLocker>
-#include <QUuid>
-
-using namespace boost;
-using namespace boost::spirit::classic;
-
-extern KGraphViewer::DotGraphParsingHelper* phelper;
+#include <QThreadPool>
+#include <QtConcurrentMap>
 
 
 namespace KGraphViewer
 {
   
   
-const distinct_parser<> keyword_p("0-9a-zA-Z_");
+
+static void initParsingHelper(DotGraphParsingHelper& helper, DotGraph* graph)
+{
+  helper.graph = graph;
+  helper.z = 1;
+  helper.maxZ = 1;
+  helper.uniq = 0;
+}
+
+/**
+ * The result of a layout program run, parsed as its output arrives
+ */
+struct DotGraph::StreamedLayout
+{
+  explicit StreamedLayout(DotGraph* model) :
+    graph(model->layoutCommand(), model->dotFileName()),
+    helper(),
+    parser(&helper)
+  {
+    initParsingHelper(helper, &graph);
+    graph.setDeferRenderOperations(model->deferRenderOperations());
+  }
+
+  DotGraph graph;
+  DotGraphParsingHelper helper;
+  DotParser parser;
+};
 
 DotGraph::DotGraph() :
-  GraphElement(),
+  QObject(),
+  GraphElement(Graph),
   m_dotFileName(""),m_width(0.0), m_height(0.0),m_scale(1.0),
   m_directed(true),m_strict(false),
   m_layoutCommand(""),
   m_horizCellFactor(0), m_vertCellFactor(0),
+  m_cellsMark(0), m_cellsValid(false),
   m_wdhcf(0), m_hdvcf(0),
   m_readWrite(false),
-  m_dot(0),
+  m_layoutJob(),
+  m_layoutTimeout(0),
+  m_layoutArguments(),
+  m_layoutPriority(LayoutJob::Normal),
+  m_cacheLookup(0),
+  m_cacheWriter(0),
+  m_streamedLayout(0),
   m_phase(Initial),
-  m_useLibrary(false)
+  m_useLibrary(false),
+  m_parserEngine(HandWrittenParser),
+  m_deferRenderOperations(false),
+  m_shadowedElementsCounts(),
+  m_elementsIndexValid(false),
+  m_changedElements(),
+  m_forgottenChanges(),
+  m_updatingLayout(false),
+  m_recordingLayoutChanges(false),
+  m_layoutChanges()
 {
   setId("unnamed");
 }
 
 DotGraph::DotGraph(const QString& command, const QString& fileName) :
-  GraphElement(),
+  QObject(),
+  GraphElement(Graph),
   m_dotFileName(fileName),m_width(0.0), m_height(0.0),m_scale(1.0),
   m_directed(true),m_strict(false),
   m_layoutCommand(command),
   m_horizCellFactor(0), m_vertCellFactor(0),
+  m_cellsMark(0), m_cellsValid(false),
   m_wdhcf(0), m_hdvcf(0),
   m_readWrite(false),
-  m_dot(0),
+  m_layoutJob(),
+  m_layoutTimeout(0),
+  m_layoutArguments(),
+  m_layoutPriority(LayoutJob::Normal),
+  m_cacheLookup(0),
+  m_cacheWriter(0),
+  m_streamedLayout(0),
   m_phase(Initial),
-  m_useLibrary(false)
+  m_useLibrary(false),
+  m_parserEngine(HandWrittenParser),
+  m_deferRenderOperations(false),
+  m_shadowedElementsCounts(),
+  m_elementsIndexValid(false),
+  m_changedElements(),
+  m_forgottenChanges(),
+  m_updatingLayout(false),
+  m_recordingLayoutChanges(false),
+  m_layoutChanges()
 {
   setId("unnamed");
 }
 
 DotGraph::~DotGraph()  
 {
-  GraphNodeMap::iterator itn, itn_end;
-  itn = m_nodesMap.begin(); itn_end = m_nodesMap.end();
-  for (; itn != itn_end; itn++)
+  cancelLayout();
+  delete m_streamedLayout;
+  // the elements are freed with their arenas
+}
+
+/**
+ * Reads a dot file header block by block, so that only the start of the
+ * file is read to find its graph keyword
+ */
+class DotHeaderReader
+{
+public:
+  explicit DotHeaderReader(QIODevice& device) : m_device(device), m_buffer(), m_pos(0) {}
+
+  /** Returns false at the end of the file */
+  bool fill()
   {
-    delete *itn;
+    if (m_pos < m_buffer.size())
+    {
+      return true;
+    }
+    m_buffer = m_device.read(4096);
+    m_pos = 0;
+    return !m_buffer.isEmpty();
   }
 
-  GraphEdgeMap::iterator ite, ite_end;
-  ite = m_edgesMap.begin(); ite_end = m_edgesMap.end();
-  for (; ite != ite_end; ite++)
+  inline char peek() const {return m_buffer.at(m_pos);}
+  inline void next() {m_pos++;}
+
+  /** Skips the UTF-8 byte order mark the file may start with */
+  void skipByteOrderMark()
   {
-    delete (*ite);
+    if (fill() && m_buffer.startsWith("\xEF\xBB\xBF"))
+    {
+      m_pos = 3;
+    }
   }
-}
+
+  /** Skips blanks and comments */
+  void skipBlanksAndComments()
+  {
+    while (fill())
+    {
+      char c = peek();
+      if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v')
+      {
+        next();
+      }
+      else if (c == '#')
+      {
+        skipLine();
+      }
+      else if (c == '/')
+      {
+        next();
+        if (!fill())
+        {
+          return;
+        }
+        if (peek() == '/')
+        {
+          skipLine();
+        }
+        else if (peek() == '*')
+        {
+          next();
+          skipBlockComment();
+        }
+        else
+        {
+          return;
+        }
+      }
+      else
+      {
+        return;
+      }
+    }
+  }
+
+  /** Reads the keyword starting at the current position, lower cased */
+  QByteArray keyword()
+  {
+    QByteArray word;
+    while (fill() && word.size() < 16)
+    {
+      char c = peek();
+      if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+      {
+        break;
+      }
+      word.append(c);
+      next();
+    }
+    return word.toLower();
+  }
+
+private:
+  void skipLine()
+  {
+    while (fill() && peek() != '\n')
+    {
+      next();
+    }
+  }
+
+  void skipBlockComment()
+  {
+    bool star = false;
+    while (fill())
+    {
+      char c = peek();
+      next();
+      if (star && c == '/')
+      {
+        return;
+      }
+      star = (c == '*');
+    }
+  }
+
+  QIODevice& m_device;
+  QByteArray m_buffer;
+  int m_pos;
+};
 
 QString DotGraph::chooseLayoutProgramForFile(const QString& str)
 {
@@ -110,19 +279,25 @@ QString DotGraph::chooseLayoutProgramForFile(const QString& str)
     return "dot";// -Txdot";
   }
 
-  QByteArray fileContent = iFILE.readAll();
-  if (fileContent.isEmpty()) return "";
-  std::string s =  fileContent.data();
-  std::string cmd = "dot";
-  parse(s.c_str(),
-        (
-          !(keyword_p("strict")) >> (keyword_p("graph")[assign_a(cmd,"neato")])
-        ), (space_p|comment_p("/*", "*/")) );
-
-  return  QString::fromStdString(cmd);// + " -Txdot" ;
+  // undirected graphs are laid out with neato: "[strict] graph"
+  QString cmd;
+  DotHeaderReader reader(iFILE);
+  if (reader.fill())
+  {
+    reader.skipByteOrderMark();
+    reader.skipBlanksAndComments();
+    QByteArray keyword = reader.keyword();
+    if (keyword == "strict")
+    {
+      reader.skipBlanksAndComments();
+      keyword = reader.keyword();
+    }
+    cmd = (keyword == "graph") ? "neato" : "dot";
+  }
+  return cmd;// + " -Txdot" ;
 }
 
-bool DotGraph::parseDot(const QString& str)
+bool DotGraph::parseDot(const QString& str, LayoutJob::Priority priority)
 {
   kDebug() << str;
   m_useLibrary = false;
@@ -131,7 +306,6 @@ bool DotGraph::parseDot(const QString& str)
     m_layoutCommand = chooseLayoutProgramForFile(str);
     if (m_layoutCommand.isEmpty())
     {
-      m_layoutCommand = chooseLayoutProgramForFile(str);
       return false;
     }
   }
@@ -147,24 +321,82 @@ bool DotGraph::parseDot(const QString& str)
 //  {
     options << "-Txdot";
 //   }
-  options << str;
 
-  kDebug() << "m_dot is " << m_dot  << ". Acquiring mutex";
-  QMutexLocker locker(&m_dotProcessMutex);
-  kDebug() << "mutex acquired ";
-  if (m_dot != 0)
+  // a reload or edit following quickly the previous one replaces its run
+  cancelLayout();
+  m_layoutArguments = options;
+  m_layoutArguments << str;
+  m_layoutPriority = priority;
+  if (LayoutCache::single().isEnabled())
+  {
+    // the file is hashed and the layout read in a worker thread
+    m_cacheLookup = new LayoutCacheLookup(str, m_layoutCommand, options, this);
+    connect(m_cacheLookup, SIGNAL(done()), this, SLOT(slotCacheLookupDone()));
+    return true;
+  }
+  startLayoutJob(QByteArray());
+  return true;
+}
+
+void DotGraph::startLayoutJob(const QByteArray& cacheKey)
+{
+  m_layoutJob = LayoutService::changeable().submit(m_layoutCommand, m_layoutArguments,
+                                                   m_layoutPriority, m_layoutTimeout);
+  connect(m_layoutJob,SIGNAL(finished(int,QProcess::ExitStatus)),this,SLOT(slotDotRunningDone(int,QProcess::ExitStatus)));
+  connect(m_layoutJob,SIGNAL(failed(QProcess::ProcessError)),this,SLOT(slotDotRunningError(QProcess::ProcessError)));
+  connect(m_layoutJob,SIGNAL(progress(qint64,int)),this,SIGNAL(layoutProgress(qint64,int)));
+  if (m_parserEngine == HandWrittenParser)
+  {
+    // parse the layout while it is output instead of once the program exits
+    m_streamedLayout = new StreamedLayout(this);
+    connect(m_layoutJob,SIGNAL(outputAvailable()),this,SLOT(slotDotOutputAvailable()));
+  }
+  if (!cacheKey.isEmpty())
+  {
+    m_cacheWriter = new LayoutCacheWriter(cacheKey);
+  }
+  kDebug() << "layout queued";
+}
+
+void DotGraph::slotCacheLookupDone()
+{
+  LayoutCacheLookup* lookup = m_cacheLookup;
+  m_cacheLookup = 0;
+  lookup->deleteLater();
+  QByteArray layout = lookup->takeLayout();
+  if (layout.isEmpty())
+  {
+    startLayoutJob(lookup->key());
+    return;
+  }
+  kDebug() << "layout found in the cache:" << layout.size();
+  if (!updateWithXdot(layout))
+  {
+    kError() << "parsing the cached layout failed: laying the graph out again";
+    LayoutCache::changeable().remove(lookup->key());
+    startLayoutJob(lookup->key());
+    return;
+  }
+  emit(readyToDisplay());
+}
+
+void DotGraph::cancelLayout()
+{
+  if (m_layoutJob != 0)
+  {
+    m_layoutJob->cancel();
+    m_layoutJob = 0;
+  }
+  if (m_cacheLookup != 0)
   {
-    disconnect(m_dot,SIGNAL(finished(int,QProcess::ExitStatus)),this,SLOT(slotDotRunningDone(int,QProcess::ExitStatus)));
-    disconnect(m_dot,SIGNAL(error(QProcess::ProcessError)),this,SLOT(slotDotRunningError(QProcess::ProcessError)));
-    m_dot->kill();
-    delete m_dot;
+    m_cacheLookup->disconnect(this);
+    m_cacheLookup->deleteLater();
+    m_cacheLookup = 0;
   }
-  m_dot = new QProcess();
-  connect(m_dot,SIGNAL(finished(int,QProcess::ExitStatus)),this,SLOT(slotDotRunningDone(int,QProcess::ExitStatus)));
-  connect(m_dot,SIGNAL(error(QProcess::ProcessError)),this,SLOT(slotDotRunningError(QProcess::ProcessError)));
-  m_dot->start(m_layoutCommand, options);
-  kDebug() << "process started";
- return true;
+  delete m_cacheWriter;
+  m_cacheWriter = 0;
+  delete m_streamedLayout;
+  m_streamedLayout = 0;
 }
 
 bool DotGraph::update()
@@ -174,7 +406,8 @@ bool DotGraph::update()
   {
     kDebug() << "command";
     QString str = exporter.writeDot(this);
-    return parseDot(str);
+    // the edits are waited for, before the reloads
+    return parseDot(str, LayoutJob::High);
   }
   else
   {
@@ -198,32 +431,43 @@ QByteArray DotGraph::getDotResult(int , QProcess::ExitStatus )
 {
   kDebug();
 
-  QMutexLocker locker(&m_dotProcessMutex);
-  if (m_dot == 0)
+  if (m_layoutJob == 0)
   {
     return QByteArray();
   }
-  QByteArray result = m_dot->readAll();
-  delete m_dot;
-  m_dot = 0;
+  QByteArray result = m_layoutJob->readOutput();
+  m_layoutJob = 0;
   return result;
 }
 
+void DotGraph::slotDotOutputAvailable()
+{
+  if (m_layoutJob == 0 || m_streamedLayout == 0)
+  {
+    return;
+  }
+  QByteArray chunk = m_layoutJob->readOutput();
+  if (m_cacheWriter != 0)
+  {
+    m_cacheWriter->write(chunk);
+  }
+  m_streamedLayout->parser.feed(chunk.constData(), chunk.size());
+}
+
 void DotGraph::slotDotRunningDone(int exitCode, QProcess::ExitStatus exitStatus)
 {
   kDebug();
   
   QByteArray result = getDotResult(exitCode, exitStatus);
-  result.replace("\\\n","");
-
-  kDebug() << "string content is:" << endl << result << endl << "=====================" << result.size();
-  std::string s =  result.data();
-  //   std::cerr << "stdstring content is:" << std::endl << s << std::endl << "===================== " << s.size() << std::endl;
-  if (phelper != 0)
+  StreamedLayout* layout = m_streamedLayout;
+  m_streamedLayout = 0;
+  LayoutCacheWriter* cacheWriter = m_cacheWriter;
+  m_cacheWriter = 0;
+  if (cacheWriter != 0)
   {
-    phelper->graph = 0;
-    delete phelper;
+    cacheWriter->write(result);
   }
+
 //   if (parsingResult)
 //   {
 //     if (m_readWrite)
@@ -234,29 +478,38 @@ void DotGraph::slotDotRunningDone(int exitCode, QProcess::ExitStatus exitStatus)
 //     computeCells();
 //   }
 
-  DotGraph newGraph(m_layoutCommand, m_dotFileName);
-  phelper = new DotGraphParsingHelper;
-  phelper->graph = &newGraph;
-  phelper->z = 1;
-  phelper->maxZ = 1;
-  phelper->uniq = 0;
-
-  kDebug() << "parsing new dot";
-  bool parsingResult = parse(s);
-  delete phelper;
-  phelper = 0;
-  kDebug() << "phelper deleted";
-
-  if (parsingResult)
+  bool parsingResult;
+  if (layout != 0)
   {
-    kDebug() << "calling updateWithGraph";
-    updateWithGraph(newGraph);
+    kDebug() << "parsing the end of the streamed dot:" << result.size();
+    layout->parser.feed(result.constData(), result.size());
+    parsingResult = layout->parser.finish();
+    if (parsingResult && !m_deferRenderOperations)
+    {
+      layout->graph.decodePendingRenderOperations();
+    }
+    if (parsingResult)
+    {
+      kDebug() << "calling updateWithParsedGraph";
+      updateWithParsedGraph(layout->graph);
+    }
+    delete layout;
   }
   else
+  {
+    parsingResult = updateWithXdot(result);
+  }
+
+  if (!parsingResult)
   {
     kDebug() << "parsing failed";
     kError() << "parsing failed";
   }
+  else if (exitCode == 0 && cacheWriter != 0)
+  {
+    cacheWriter->commit();
+  }
+  delete cacheWriter;
 //   return parsingResult;
 //   if (m_readWrite && m_phase == Initial)
 //   {
@@ -270,9 +523,56 @@ void DotGraph::slotDotRunningDone(int exitCode, QProcess::ExitStatus exitStatus)
 //   }
 }
 
+bool DotGraph::updateWithXdot(QByteArray xdot)
+{
+  xdot.replace("\\\n","");
+
+  kDebug() << "string content is:" << endl << xdot << endl << "=====================" << xdot.size();
+
+  DotGraph newGraph(m_layoutCommand, m_dotFileName);
+  newGraph.setParserEngine(m_parserEngine);
+  newGraph.setDeferRenderOperations(m_deferRenderOperations);
+
+  kDebug() << "parsing new dot";
+  bool parsingResult = newGraph.parseXdot(xdot);
+  if (parsingResult)
+  {
+    kDebug() << "calling updateWithParsedGraph";
+    updateWithParsedGraph(newGraph);
+  }
+  return parsingResult;
+}
+
+bool DotGraph::parseXdot(const QByteArray& xdot)
+{
+  DotGraphParsingHelper helper;
+  initParsingHelper(helper, this);
+
+  bool result;
+  if (m_parserEngine == SpiritParser)
+  {
+    result = parse(std::string(xdot.constData(), xdot.size()), &helper);
+  }
+  else
+  {
+    DotParser parser(&helper);
+    result = parser.parse(xdot.constData(), xdot.constData() + xdot.size());
+  }
+  if (result && !m_deferRenderOperations)
+  {
+    decodePendingRenderOperations();
+  }
+  return result;
+}
+
 void DotGraph::slotDotRunningError(QProcess::ProcessError error)
 {
   kError() << "DotGraph::slotDotRunningError" << error;
+  m_layoutJob = 0;
+  delete m_streamedLayout;
+  m_streamedLayout = 0;
+  delete m_cacheWriter;
+  m_cacheWriter = 0;
   switch (error)
   {
     case QProcess::FailedToStart:
@@ -295,78 +595,260 @@ void DotGraph::slotDotRunningError(QProcess::ProcessError error)
   }
 }
 
-unsigned int DotGraph::cellNumber(int x, int y)
+unsigned int DotGraph::cellNumber(qreal x, qreal y) const
 {
-/*  kDebug() << "x= " << x << ", y= " << y << ", m_width= " << m_width << ", m_height= " << m_height << ", m_horizCellFactor= " << m_horizCellFactor << ", m_vertCellFactor= " << m_vertCellFactor  << ", m_wdhcf= " << m_wdhcf << ", m_hdvcf= " << m_hdvcf;*/
-  
-  unsigned int nx = (unsigned int)(( x - ( x % int(m_wdhcf) ) ) / m_wdhcf);
-  unsigned int ny = (unsigned int)(( y - ( y % int(m_hdvcf) ) ) / m_hdvcf);
-/*  kDebug() << "nx = " << (unsigned int)(( x - ( x % int(m_wdhcf) ) ) / m_wdhcf);
-  kDebug() << "ny = " << (unsigned int)(( y - ( y % int(m_hdvcf) ) ) / m_hdvcf);
-  kDebug() << "res = " << ny * m_horizCellFactor + nx;*/
-  
-  unsigned int res = ny * m_horizCellFactor + nx;
-  return res;
+  int nx = qBound(0, int((x - m_cellsOrigin.x()) / m_wdhcf), int(m_horizCellFactor) - 1);
+  int ny = qBound(0, int((y - m_cellsOrigin.y()) / m_hdvcf), int(m_vertCellFactor) - 1);
+  return ny * m_horizCellFactor + nx;
 }
 
-#define MAXCELLWEIGHT 800
+/** The average number of elements overlapping a cell */
+#define MAXCELLWEIGHT 8
+/** Elements overlapping more cells are not listed in each one */
+#define MAXCELLSPAN 64
+
+void DotGraph::addToCells(GraphElement* element)
+{
+  QRectF box;
+  if (element->layoutBoundingBox(box))
+  {
+    m_cellsElements.push_back(element);
+    m_cellsBoxes.push_back(box);
+  }
+}
 
 void DotGraph::computeCells()
 {
-  return;
-  kDebug() << m_width << m_height << endl;
-  m_horizCellFactor = m_vertCellFactor = 1;
-  m_wdhcf = (int)ceil(((double)m_width) / m_horizCellFactor)+1;
-  m_hdvcf = (int)ceil(((double)m_height) / m_vertCellFactor)+1;
-  bool stop = true;
-  do
-  {
-    stop = true;
-    m_cells.clear();
-//     m_cells.resize(m_horizCellFactor * m_vertCellFactor);
-    
-    GraphNodeMap::iterator it, it_end;
-    it = m_nodesMap.begin(); it_end = m_nodesMap.end();
-    for (; it != it_end; it++)
+  m_cells.clear();
+  m_cellsElements.clear();
+  m_cellsBoxes.clear();
+  m_largeCellsElements.clear();
+  m_horizCellFactor = m_vertCellFactor = 0;
+  m_cellsValid = true;
+
+  foreach (GraphNode* node, m_nodesMap)
+  {
+    addToCells(node);
+  }
+  foreach (GraphEdge* edge, m_edgesMap)
+  {
+    addToCells(edge);
+  }
+  // the nested subgraphs are also in the subgraphs map
+  foreach (GraphSubgraph* subgraph, m_subgraphsMap)
+  {
+    addToCells(subgraph);
+    foreach (GraphElement* element, subgraph->content())
     {
-      GraphNode* gn = *it;
-//       int cellNum = cellNumber(int(gn->x()), int(gn->y()));
-      int cellNum = cellNumber(0,0);
-      kDebug() << "Found cell number " << cellNum;
+      if (element->kind() != Subgraph)
+      {
+        addToCells(element);
+      }
+    }
+  }
+  int count = m_cellsElements.size();
+  m_cellsMarks.fill(0, count);
+  m_cellsMark = 0;
+  if (count == 0)
+  {
+    return;
+  }
 
-      if (m_cells.size() <= cellNum)
+  QRectF area = m_cellsBoxes[0];
+  for (int i = 1; i < count; i++)
+  {
+    area = area.united(m_cellsBoxes[i]);
+  }
+  qreal width = qMax(area.width(), qreal(1));
+  qreal height = qMax(area.height(), qreal(1));
+  int cellsCount = qMax(count / MAXCELLWEIGHT, 1);
+  int columns = qBound(1, int(ceil(sqrt(cellsCount * width / height))), cellsCount);
+  int rows = (cellsCount + columns - 1) / columns;
+  m_horizCellFactor = columns;
+  m_vertCellFactor = rows;
+  m_wdhcf = width / columns;
+  m_hdvcf = height / rows;
+  m_cellsOrigin = area.topLeft();
+  m_cells.resize(columns * rows);
+
+  for (int i = 0; i < count; i++)
+  {
+    const QRectF& box = m_cellsBoxes[i];
+    unsigned int first = cellNumber(box.left(), box.top());
+    unsigned int last = cellNumber(box.right(), box.bottom());
+    int left = first % columns, right = last % columns;
+    int bottom = first / columns, top = last / columns;
+    if ((right - left + 1) * (top - bottom + 1) > MAXCELLSPAN)
+    {
+      m_largeCellsElements.push_back(i);
+      continue;
+    }
+    for (int row = bottom; row <= top; row++)
+    {
+      for (int column = left; column <= right; column++)
       {
-        m_cells.resize(cellNum+1);
+        m_cells[row * columns + column].push_back(i);
       }
-      m_cells[cellNum].insert(gn);
-      
-      kDebug() << "after insert";
-      if ( m_cells[cellNum].size() > MAXCELLWEIGHT )
+    }
+  }
+  kDebug() << count << "elements in" << columns << "x" << rows << "cells of" << m_wdhcf << "x" << m_hdvcf
+      << "," << m_largeCellsElements.size() << "large ones";
+}
+
+/** Like QRectF::intersects(), but also true for the flat boxes of straight edges */
+static inline bool boxesOverlap(const QRectF& a, const QRectF& b)
+{
+  return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+void DotGraph::cellsElementsIn(const QRectF& rect, QVector< int >& found)
+{
+  if (!m_cellsValid)
+  {
+    computeCells();
+  }
+  if (m_cells.isEmpty())
+  {
+    return;
+  }
+  if (++m_cellsMark == 0)
+  {
+    m_cellsMarks.fill(0);
+    m_cellsMark = 1;
+  }
+  QRectF area = rect.normalized();
+  unsigned int first = cellNumber(area.left(), area.top());
+  unsigned int last = cellNumber(area.right(), area.bottom());
+  for (unsigned int row = first / m_horizCellFactor; row <= last / m_horizCellFactor; row++)
+  {
+    for (unsigned int column = first % m_horizCellFactor; column <= last % m_horizCellFactor; column++)
+    {
+      foreach (int i, m_cells[row * m_horizCellFactor + column])
       {
-        kDebug() << "cell number " << cellNum  << " contains " << m_cells[cellNum].size() << " nodes";
-        if ((m_width/m_horizCellFactor) > (m_height/m_vertCellFactor))
-        {
-          m_horizCellFactor++;
-          m_wdhcf = m_width / m_horizCellFactor;
-        }
-        else
+        if (m_cellsMarks[i] != m_cellsMark)
         {
-          m_vertCellFactor++;
-          m_hdvcf = m_height / m_vertCellFactor;
+          m_cellsMarks[i] = m_cellsMark;
+          if (boxesOverlap(m_cellsBoxes[i], area))
+          {
+            found.push_back(i);
+          }
         }
-        kDebug() << "cell factor is now " << m_horizCellFactor << " / " << m_vertCellFactor;
-        stop = false;
-        break;
       }
     }
-  } while (!stop);
-  kDebug() << "m_wdhcf=" << m_wdhcf << "; m_hdvcf=" << m_hdvcf << endl;
-  kDebug() << "finished" << endl;
+  }
+  foreach (int i, m_largeCellsElements)
+  {
+    if (boxesOverlap(m_cellsBoxes[i], area))
+    {
+      found.push_back(i);
+    }
+  }
+}
+
+QList< GraphElement* > DotGraph::elementsIn(const QRectF& rect)
+{
+  QVector< int > found;
+  cellsElementsIn(rect, found);
+  QList< GraphElement* > elements;
+  foreach (int i, found)
+  {
+    elements.push_back(m_cellsElements[i]);
+  }
+  return elements;
+}
+
+GraphElement* DotGraph::elementNearestTo(const QPointF& point, qreal maxDistance)
+{
+  QVector< int > found;
+  cellsElementsIn(QRectF(point.x() - maxDistance, point.y() - maxDistance, 2 * maxDistance, 2 * maxDistance), found);
+  GraphElement* nearest = 0;
+  qreal nearestDistance = 0, nearestArea = 0;
+  foreach (int i, found)
+  {
+    const QRectF& box = m_cellsBoxes[i];
+    qreal dx = qMax(qMax(box.left() - point.x(), point.x() - box.right()), qreal(0));
+    qreal dy = qMax(qMax(box.top() - point.y(), point.y() - box.bottom()), qreal(0));
+    qreal distance = sqrt(dx * dx + dy * dy);
+    qreal area = box.width() * box.height();
+    if (distance <= maxDistance
+        && (nearest == 0 || distance < nearestDistance || (distance == nearestDistance && area < nearestArea)))
+    {
+      nearest = m_cellsElements[i];
+      nearestDistance = distance;
+      nearestArea = area;
+    }
+  }
+  return nearest;
+}
+
+GraphMemoryUsage DotGraph::memoryUsage() const
+{
+  GraphMemoryUsage usage;
+  GraphElement::addMemoryUsage(usage);
+  usage.add(GraphMemoryUsage::Elements,
+            m_nodesArena.memoryUsage() + m_edgesArena.memoryUsage() + m_subgraphsArena.memoryUsage());
+
+  const int mapEntrySize = sizeof(QString) + sizeof(void*);
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_nodesMap.size(), mapEntrySize);
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_edgesMap.size(), mapEntrySize);
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_subgraphsMap.size(), mapEntrySize);
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_elementsIndex.size(), mapEntrySize);
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_shadowedElementsCounts.size(), sizeof(QString) + sizeof(int));
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_parallelEdgesCounts.size(), 2 * sizeof(QString) + sizeof(int));
+  usage.addStrings(GraphMemoryUsage::Structure, m_nodesMap.keys());
+  usage.addStrings(GraphMemoryUsage::Structure, m_edgesMap.keys());
+  usage.addStrings(GraphMemoryUsage::Structure, m_subgraphsMap.keys());
+  usage.add(GraphMemoryUsage::Structure, m_changedElements.size() * sizeof(GraphElement*));
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_forgottenChanges.size(), sizeof(GraphElement*));
+  usage.add(GraphMemoryUsage::Structure, m_cells.capacity() * sizeof(QVector< int >)
+      + m_cellsElements.capacity() * sizeof(GraphElement*) + m_cellsBoxes.capacity() * sizeof(QRectF)
+      + (m_largeCellsElements.capacity() + m_cellsMarks.capacity()) * sizeof(int));
+  foreach (const QVector< int >& cell, m_cells)
+  {
+    usage.add(GraphMemoryUsage::Structure, cell.capacity() * sizeof(int));
+  }
+
+  foreach (const GraphNode* node, m_nodesMap)
+  {
+    node->addMemoryUsage(usage);
+  }
+  foreach (const GraphEdge* edge, m_edgesMap)
+  {
+    edge->addMemoryUsage(usage);
+  }
+  // the nested subgraphs are also in the subgraphs map
+  foreach (const GraphSubgraph* subgraph, m_subgraphsMap)
+  {
+    subgraph->addMemoryUsage(usage);
+    foreach (const GraphElement* element, subgraph->content())
+    {
+      if (element->kind() != Subgraph)
+      {
+        element->addMemoryUsage(usage);
+      }
+    }
+  }
+  return usage;
 }
 
-QSet< GraphNode* >& DotGraph::nodesOfCell(unsigned int id)
+QList< GraphNode* > DotGraph::nodesOfCell(unsigned int id)
 {
-  return m_cells[id];
+  if (!m_cellsValid)
+  {
+    computeCells();
+  }
+  QList< GraphNode* > nodes;
+  if (id < (unsigned int)m_cells.size())
+  {
+    foreach (int i, m_cells[id])
+    {
+      if (m_cellsElements[i]->kind() == Node)
+      {
+        nodes.push_back(static_cast<GraphNode*>(m_cellsElements[i]));
+      }
+    }
+  }
+  return nodes;
 }
 
 void DotGraph::storeOriginalAttributes()
@@ -394,28 +876,55 @@ void DotGraph::saveTo(const QString& fileName)
   exporter.writeDot(this, fileName);
 }
 
+/** The attributes of element, read without invalidating its content hashes */
+static inline QMap<QString,QString> attributesOf(const GraphElement* element)
+{
+  return element->attributes();
+}
+
+/** The id of an edge of a graphviz layout, counting the parallel edges met before it */
+static QString layoutEdgeId(edge_t* edge, QHash< QPair< QString, QString >, int >& parallelEdgesCounts)
+{
+  int& ordinal = parallelEdgesCounts[qMakePair(QString(edge->tail->name), QString(edge->head->name))];
+  return GraphEdge::anonymousId(edge->tail->name, edge->head->name, ordinal++);
+}
+
 void DotGraph::updateWithGraph(graph_t* newGraph)
 {
   kDebug();
+  m_updatingLayout = true;
+  m_recordingLayoutChanges = !isEmpty();
 
-  // copy global graph render operations and attributes
-  DotRenderOpVec ops;
-  // decrease mem peak
-  setRenderOperations(ops);
-
-  if (agget(newGraph, (char*)"_draw_") != NULL)
+  QSet<QString> nodeIds;
+  QSet<QString> edgeIds;
+  QSet<QString> subgraphIds;
+  QHash< QPair< QString, QString >, int > parallelEdgesCounts;
+  for (edge_t* e = agfstout(newGraph->meta_node->graph, newGraph->meta_node); e;
+      e = agnxtout(newGraph->meta_node->graph, e))
   {
-    parse_renderop(agget(newGraph, (char*)"_draw_"), ops);
-    kDebug() << "_draw_: element renderOperations size is now " << ops.size();
+    subgraphIds.insert(agusergraph(e->head)->name);
   }
-  if (agget(newGraph, (char*)"_ldraw_") != NULL)
+  for (node_t* n = agfstnode(newGraph); n != NULL; n = agnxtnode(newGraph, n))
   {
-    parse_renderop(agget(newGraph, (char*)"_ldraw_"), ops);
-    kDebug() << "_ldraw_: element renderOperations size is now " << ops.size();
+    nodeIds.insert(n->name);
+    for (edge_t* e = agfstout(newGraph, n); e != NULL; e = agnxtedge(newGraph, e, n))
+    {
+      edgeIds.insert(layoutEdgeId(e, parallelEdgesCounts));
+    }
+  }
+  purgeMissingElements(nodeIds, edgeIds, subgraphIds);
+  for (edge_t* e = agfstout(newGraph->meta_node->graph, newGraph->meta_node); e;
+      e = agnxtout(newGraph->meta_node->graph, e))
+  {
+    graph_t* sg = agusergraph(e->head);
+    GraphSubgraph* subgraph = m_subgraphsMap.value(sg->name, 0);
+    if (subgraph != 0)
+    {
+      purgeMissingContent(subgraph, sg, nodeIds);
+    }
   }
 
-  setRenderOperations(ops);
-
+  // copy global graph render operations and attributes
   Agsym_t *attr = agfstattr(newGraph);
   while(attr)
   {
@@ -423,6 +932,9 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
     m_attributes[attr->name] = agxget(newGraph,attr->index);
     attr = agnxtattr(newGraph,attr);
   }
+  invalidatePaintAttributes();
+  // decoded from the drawing attributes when first used
+  setRenderOperationsPending();
   
   // copy subgraphs
   for (edge_t* e = agfstout(newGraph->meta_node->graph, newGraph->meta_node); e;
@@ -435,7 +947,9 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
       kDebug() << "known";
       // ???
       //       nodes()[ngn->name]->setZ(ngn->z());
-      subgraphs()[sg->name]->updateWithSubgraph(sg);
+      QMap<QString,QString> previous = attributesOf(subgraphs()[sg->name]);
+      subgraphs()[sg->name]->updateWithSubgraph(sg, this);
+      recordLayoutUpdate(subgraphs()[sg->name], previous);
       if (subgraphs()[sg->name]->canvasElement()!=0)
       {
         //         nodes()[ngn->id()]->canvasElement()->setGh(m_height);
@@ -444,13 +958,19 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
     else
     {
       kDebug() << "new";
-      GraphSubgraph* newsg = new GraphSubgraph(sg);
+      GraphSubgraph* newsg = createSubgraph();
+      newsg->updateWithSubgraph(sg, this);
       //       kDebug() << "new created";
       subgraphs().insert(sg->name, newsg);
       //       kDebug() << "new inserted";
     }
 
   }
+  // the subgraphs contents changed
+  invalidateElementsIndex();
+
+  // edges ranks between their ends, restarting at each layout to match the known edges
+  parallelEdgesCounts.clear();
 
   // copy nodes
   node_t* ngn = agfstnode(newGraph);
@@ -465,7 +985,9 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
       kDebug() << "known";
 // ???
 //       nodes()[ngn->name]->setZ(ngn->z());
+      QMap<QString,QString> previous = attributesOf(nodes()[ngn->name]);
       nodes()[ngn->name]->updateWithNode(ngn);
+      recordLayoutUpdate(nodes()[ngn->name], previous);
       if (nodes()[ngn->name]->canvasElement()!=0)
       {
         //         nodes()[ngn->id()]->canvasElement()->setGh(m_height);
@@ -474,9 +996,10 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
     else
     {
       kDebug() << "new";
-      GraphNode* newgn = new GraphNode(ngn);
+      GraphNode* newgn = createNode(ngn);
       //       kDebug() << "new created";
       nodes().insert(ngn->name, newgn);
+      indexElement(ngn->name, newgn);
       //       kDebug() << "new inserted";
     }
 
@@ -485,12 +1008,14 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
     while (nge != NULL)
     {
       kDebug() << "edge " << nge->id;
-      QString edgeName = QString(nge->head->name) + nge->tail->name;
+      QString edgeName = layoutEdgeId(nge, parallelEdgesCounts);
       if (edges().contains(edgeName))
       {
         kDebug() << "edge known" << nge->id;
 //         edges()[nge->name]->setZ(nge->z());
+        QMap<QString,QString> previous = attributesOf(edges()[edgeName]);
         edges()[edgeName]->updateWithEdge(nge);
+        recordLayoutUpdate(edges()[edgeName], previous);
         if (edges()[edgeName]->canvasEdge()!=0)
         {
           //         edges()[nge->id()]->canvasEdge()->setGh(m_height);
@@ -500,52 +1025,174 @@ void DotGraph::updateWithGraph(graph_t* newGraph)
       {
         kDebug() << "new edge" << edgeName;
         {
-          GraphEdge* newEdge = new GraphEdge();
+          GraphEdge* newEdge = createEdge();
           newEdge->setId(edgeName);
           newEdge->updateWithEdge(nge);
           if (elementNamed(nge->tail->name) == 0)
           {
-            GraphNode* newgn = new GraphNode();
+            GraphNode* newgn = createNode();
+            newgn->setId(nge->tail->name);
             //       kDebug() << "new created";
             nodes().insert(nge->tail->name, newgn);
+            indexElement(nge->tail->name, newgn);
           }
           newEdge->setFromNode(elementNamed(nge->tail->name));
           if (elementNamed(nge->head->name) == 0)
           {
-            GraphNode* newgn = new GraphNode();
+            GraphNode* newgn = createNode();
+            newgn->setId(nge->head->name);
             //       kDebug() << "new created";
             nodes().insert(nge->head->name, newgn);
+            indexElement(nge->head->name, newgn);
           }
           newEdge->setToNode(elementNamed(nge->head->name));
           edges().insert(edgeName, newEdge);
+          indexElement(edgeName, newEdge);
         }
       }
       nge = agnxtedge(newGraph, nge, ngn);
     }
     ngn = agnxtnode(newGraph, ngn);
   }
+  m_updatingLayout = false;
+  m_recordingLayoutChanges = false;
+  if (!m_deferRenderOperations)
+  {
+    decodePendingRenderOperations();
+  }
+  computeCells();
   kDebug() << "Done";
   emit readyToDisplay();
-  computeCells();
+}
+
+/** A part of the elements whose render operations are decoded by one task */
+struct RenderOperationsChunk
+{
+  GraphElement* const* first;
+  int size;
+};
+
+static void decodeRenderOperationsChunk(RenderOperationsChunk& chunk)
+{
+  // string pools cannot be shared between threads: one per task
+  DotStringPool strings;
+  for (int i = 0; i < chunk.size; i++)
+  {
+    chunk.first[i]->decodeRenderOperations(&strings);
+  }
+}
+
+static void collectPendingSubgraphs(const GraphSubgraphMap& subgraphs,
+                                    QSet< GraphElement* >& visited,
+                                    QVector< GraphElement* >& elements);
+
+/** Collects subgraph, its content and its nested subgraphs, once each */
+static void collectPendingSubgraph(GraphSubgraph* subgraph,
+                                   QSet< GraphElement* >& visited,
+                                   QVector< GraphElement* >& elements)
+{
+  if (visited.contains(subgraph))
+  {
+    return;
+  }
+  visited.insert(subgraph);
+  if (subgraph->renderOperationsPending())
+  {
+    elements.push_back(subgraph);
+  }
+  foreach (GraphElement* element, subgraph->content())
+  {
+    if (element->kind() == GraphElement::Subgraph)
+    {
+      collectPendingSubgraph(static_cast<GraphSubgraph*>(element), visited, elements);
+    }
+    else if (element->renderOperationsPending() && !visited.contains(element))
+    {
+      visited.insert(element);
+      elements.push_back(element);
+    }
+  }
+  collectPendingSubgraphs(subgraph->subgraphs(), visited, elements);
+}
+
+static void collectPendingSubgraphs(const GraphSubgraphMap& subgraphs,
+                                    QSet< GraphElement* >& visited,
+                                    QVector< GraphElement* >& elements)
+{
+  foreach (GraphSubgraph* subgraph, subgraphs)
+  {
+    collectPendingSubgraph(subgraph, visited, elements);
+  }
+}
+
+void DotGraph::decodePendingRenderOperations()
+{
+  QVector< GraphElement* > elements;
+  elements.reserve(m_nodesMap.size() + m_edgesMap.size() + m_subgraphsMap.size() + 1);
+  if (renderOperationsPending())
+  {
+    elements.push_back(this);
+  }
+  QSet< GraphElement* > visited;
+  collectPendingSubgraphs(m_subgraphsMap, visited, elements);
+  foreach (GraphNode* node, m_nodesMap)
+  {
+    // the nodes of the subgraphs contents were collected with them
+    if (node->renderOperationsPending() && !visited.contains(node))
+    {
+      elements.push_back(node);
+    }
+  }
+  foreach (GraphEdge* edge, m_edgesMap)
+  {
+    if (edge->renderOperationsPending())
+    {
+      elements.push_back(edge);
+    }
+  }
+
+  // several chunks per thread balance the load, but each has to be large
+  // enough for its strings pool to pay off
+  int threads = qMax(QThreadPool::globalInstance()->maxThreadCount(), 1);
+  int chunkSize = qMax(64, elements.size() / (4 * threads) + 1);
+  QVector< RenderOperationsChunk > chunks;
+  for (int i = 0; i < elements.size(); i += chunkSize)
+  {
+    RenderOperationsChunk chunk;
+    chunk.first = elements.constData() + i;
+    chunk.size = qMin(chunkSize, elements.size() - i);
+    chunks.push_back(chunk);
+  }
+  kDebug() << "decoding the render operations of" << elements.size() << "elements in" << chunks.size() << "chunks";
+  if (chunks.size() == 1)
+  {
+    decodeRenderOperationsChunk(chunks[0]);
+  }
+  else
+  {
+    QtConcurrent::blockingMap(chunks, decodeRenderOperationsChunk);
+  }
 }
 
 void DotGraph::updateWithGraph(const DotGraph& newGraph)
 {
   kDebug();
+  m_updatingLayout = true;
+  m_recordingLayoutChanges = !isEmpty();
+  purgeMissingElements(newGraph);
   GraphElement::updateWithElement(newGraph);
   m_width=newGraph.width();
   m_height=newGraph.height();
   m_scale=newGraph.scale();
   m_directed=newGraph.directed();
   m_strict=newGraph.strict();
-  computeCells();
   foreach (GraphSubgraph* nsg, newGraph.subgraphs())
   {
     kDebug() << "subgraph" << nsg->id();
     if (subgraphs().contains(nsg->id()))
     {
       kDebug() << "subgraph known" << nsg->id();
-      subgraphs().value(nsg->id())->updateWithSubgraph(*nsg);
+      subgraphs().value(nsg->id())->updateWithSubgraph(*nsg, this);
       if (subgraphs().value(nsg->id())->canvasElement()!=0)
       {
 //         subgraphs().value(nsg->id())->canvasElement()->setGh(m_height);
@@ -554,12 +1201,14 @@ void DotGraph::updateWithGraph(const DotGraph& newGraph)
     else
     {
       kDebug() << "new subgraph" << nsg->id();
-      GraphSubgraph* newSubgraph = new GraphSubgraph();
-      newSubgraph->updateWithSubgraph(*nsg);
+      GraphSubgraph* newSubgraph = createSubgraph();
+      newSubgraph->updateWithSubgraph(*nsg, this);
       newSubgraph->setZ(0);
       subgraphs().insert(nsg->id(), newSubgraph);
     }
   }
+  // the subgraphs contents changed
+  invalidateElementsIndex();
   foreach (GraphNode* ngn, newGraph.nodes())
   {
     kDebug() << "node " << ngn->id();
@@ -576,9 +1225,10 @@ void DotGraph::updateWithGraph(const DotGraph& newGraph)
     else
     {
       kDebug() << "new";
-      GraphNode* newgn = new GraphNode(*ngn);
+      GraphNode* newgn = createNode(*ngn);
 //       kDebug() << "new created";
       nodes().insert(ngn->id(), newgn);
+      indexElement(ngn->id(), newgn);
 //       kDebug() << "new inserted";
     }
   }
@@ -599,15 +1249,67 @@ void DotGraph::updateWithGraph(const DotGraph& newGraph)
     {
       kDebug() << "new edge" << nge->id();
       {
-        GraphEdge* newEdge = new GraphEdge();
+        GraphEdge* newEdge = createEdge();
         newEdge->setId(nge->id());
         newEdge->updateWithEdge(*nge);
         newEdge->setFromNode(elementNamed(nge->fromNode()->id()));
         newEdge->setToNode(elementNamed(nge->toNode()->id()));
         edges().insert(nge->id(), newEdge);
+        indexElement(nge->id(), newEdge);
       }
     }
   }
+  m_updatingLayout = false;
+  m_recordingLayoutChanges = false;
+  kDebug() << "Done";
+  computeCells();
+}
+
+void DotGraph::updateWithParsedGraph(DotGraph& newGraph)
+{
+  if (!isEmpty())
+  {
+    updateWithGraph(newGraph);
+    return;
+  }
+  kDebug() << "moving the elements of the new graph";
+  m_updatingLayout = true;
+  m_recordingLayoutChanges = false;
+  GraphElement::updateWithElement(newGraph);
+  m_width=newGraph.width();
+  m_height=newGraph.height();
+  m_scale=newGraph.scale();
+  m_directed=newGraph.directed();
+  m_strict=newGraph.strict();
+  // resets the changes flags of the moved elements
+  newGraph.takeChangedElements();
+  qSwap(m_nodesMap, newGraph.m_nodesMap);
+  qSwap(m_edgesMap, newGraph.m_edgesMap);
+  qSwap(m_subgraphsMap, newGraph.m_subgraphsMap);
+  m_nodesArena.swap(newGraph.m_nodesArena);
+  m_edgesArena.swap(newGraph.m_edgesArena);
+  m_subgraphsArena.swap(newGraph.m_subgraphsArena);
+  qSwap(m_parallelEdgesCounts, newGraph.m_parallelEdgesCounts);
+  foreach (GraphNode* node, m_nodesMap)
+  {
+    node->setGraph(this);
+  }
+  foreach (GraphEdge* edge, m_edgesMap)
+  {
+    edge->setGraph(this);
+  }
+  foreach (GraphSubgraph* subgraph, m_subgraphsMap)
+  {
+    subgraph->setGraph(this);
+    foreach (GraphElement* element, subgraph->content())
+    {
+      element->setGraph(this);
+    }
+  }
+  invalidateElementsIndex();
+  newGraph.invalidateElementsIndex();
+  newGraph.m_cellsValid = false;
+  m_updatingLayout = false;
   kDebug() << "Done";
   computeCells();
 }
@@ -615,44 +1317,284 @@ void DotGraph::updateWithGraph(const DotGraph& newGraph)
 void DotGraph::removeNodeNamed(const QString& nodeName)
 {
   kDebug() << nodeName;
-  GraphNode* node = dynamic_cast<GraphNode*>(elementNamed(nodeName));
+  GraphNode* node = nodeNamed(nodeName);
   if (node == 0)
   {
     kError() << "No such node " << nodeName;
     return;
   }
   
-  GraphEdgeMap::iterator it, it_end;
-  it = m_edgesMap.begin(); it_end = m_edgesMap.end();
-  while (it != it_end)
+  removeIncidentEdges(node);
+
+  if (node->canvasNode() != 0)
+  {
+    node->canvasNode()->hide();
+    delete node->canvasNode();
+    node->setCanvasNode(0);
+  }
+  unindexElement(nodeName, node);
+  nodes().remove(nodeName);
+  destroyElement(node);
+
+}
+
+void DotGraph::removeIncidentEdges(GraphElement* element)
+{
+  foreach (GraphEdge* edge, GraphEdge::takeIncidentEdges(element))
   {
-    if ( it.value()->fromNode() == node
-        || it.value()->toNode() == node )
+    // the edges map key is the edge id, unless it was changed since
+    GraphEdgeMap::iterator it = m_edgesMap.find(edge->id());
+    if (it == m_edgesMap.end() || it.value() != edge)
     {
-      GraphEdge* edge = it.value();
-      if (edge->canvasEdge() != 0)
-      {
-        edge->canvasEdge()->hide();
-        delete edge->canvasEdge();
-        delete edge;
-      }
-      it = edges().erase(it);
+      it = m_edgesMap.find(m_edgesMap.key(edge));
     }
-    else
+    if (it != m_edgesMap.end() && it.value() == edge)
+    {
+      unindexElement(it.key(), edge);
+      m_edgesMap.erase(it);
+    }
+    discardElement(edge);
+  }
+}
+
+void DotGraph::discardElement(GraphElement* element)
+{
+  if (m_recordingLayoutChanges)
+  {
+    m_layoutChanges.removed.push_back(element->id());
+  }
+  if (element->kind() == Edge)
+  {
+    GraphEdge* edge = static_cast<GraphEdge*>(element);
+    if (edge->canvasEdge() != 0)
+    {
+      edge->canvasEdge()->hide();
+      delete edge->canvasEdge();
+    }
+    destroyElement(edge);
+    return;
+  }
+  removeIncidentEdges(element);
+  if (element->canvasElement() != 0)
+  {
+    element->canvasElement()->hide();
+    delete element->canvasElement();
+  }
+  if (element->kind() == Node)
+  {
+    destroyElement(static_cast<GraphNode*>(element));
+  }
+  else if (element->kind() == Subgraph)
+  {
+    destroyElement(static_cast<GraphSubgraph*>(element));
+  }
+}
+
+void DotGraph::purgeMissingElements(const DotGraph& newGraph)
+{
+  QSet<QString> nodeIds = QSet<QString>::fromList(newGraph.nodes().keys());
+  purgeMissingElements(nodeIds,
+                       QSet<QString>::fromList(newGraph.edges().keys()),
+                       QSet<QString>::fromList(newGraph.subgraphs().keys()));
+  foreach (GraphSubgraph* newSubgraph, newGraph.subgraphs())
+  {
+    GraphSubgraph* subgraph = m_subgraphsMap.value(newSubgraph->id(), 0);
+    if (subgraph != 0)
+    {
+      purgeMissingContent(subgraph, *newSubgraph, nodeIds);
+    }
+  }
+}
+
+void DotGraph::purgeMissingContent(GraphSubgraph* subgraph, const GraphSubgraph& newSubgraph,
+                                   const QSet<QString>& nodeIds)
+{
+  QList< GraphElement* > missing;
+  foreach (GraphElement* element, subgraph->content())
+  {
+    GraphElement* updating = newSubgraph.contentElement(element->id());
+    if (updating == 0 || updating->kind() != element->kind())
+    {
+      missing.push_back(element);
+    }
+    else if (element->kind() == Subgraph)
     {
+      purgeMissingContent(static_cast<GraphSubgraph*>(element), *static_cast<GraphSubgraph*>(updating), nodeIds);
+    }
+  }
+  foreach (GraphElement* element, missing)
+  {
+    purgeContentElement(subgraph, element, nodeIds);
+  }
+
+  GraphSubgraphMap::iterator it = subgraph->subgraphs().begin();
+  while (it != subgraph->subgraphs().end())
+  {
+    GraphSubgraph* newNested = newSubgraph.subgraphs().value(it.key(), 0);
+    if (newNested != 0)
+    {
+      purgeMissingContent(it.value(), *newNested, nodeIds);
       ++it;
+      continue;
+    }
+    GraphSubgraph* nested = it.value();
+    it = subgraph->subgraphs().erase(it);
+    if (m_subgraphsMap.value(nested->id(), 0) != nested)
+    {
+      unindexElement(nested->id(), nested);
+      discardSubgraph(nested, nodeIds);
     }
   }
+}
 
-  if (node->canvasNode() != 0)
+void DotGraph::purgeMissingContent(GraphSubgraph* subgraph, graph_t* newSubgraph, const QSet<QString>& nodeIds)
+{
+  QList< GraphElement* > missing;
+  foreach (GraphElement* element, subgraph->content())
   {
-    node->canvasNode()->hide();
-    delete node->canvasNode();
-    node->setCanvasNode(0);
+    if (element->kind() != Node || agfindnode(newSubgraph, element->id().toUtf8().data()) == 0)
+    {
+      missing.push_back(element);
+    }
   }
-  nodes().remove(nodeName);
-  delete node;
+  foreach (GraphElement* element, missing)
+  {
+    purgeContentElement(subgraph, element, nodeIds);
+  }
+
+  QHash< QString, graph_t* > newNested;
+  for (edge_t* e = agfstout(newSubgraph->meta_node->graph, newSubgraph->meta_node); e;
+      e = agnxtout(newSubgraph->meta_node->graph, e))
+  {
+    graph_t* sg = agusergraph(e->head);
+    newNested.insert(sg->name, sg);
+  }
+  GraphSubgraphMap::iterator it = subgraph->subgraphs().begin();
+  while (it != subgraph->subgraphs().end())
+  {
+    graph_t* sg = newNested.value(it.key(), 0);
+    if (sg != 0)
+    {
+      purgeMissingContent(it.value(), sg, nodeIds);
+      ++it;
+      continue;
+    }
+    GraphSubgraph* nested = it.value();
+    it = subgraph->subgraphs().erase(it);
+    if (m_subgraphsMap.value(nested->id(), 0) != nested)
+    {
+      unindexElement(nested->id(), nested);
+      discardSubgraph(nested, nodeIds);
+    }
+  }
+}
+
+void DotGraph::purgeContentElement(GraphSubgraph* subgraph, GraphElement* element, const QSet<QString>& nodeIds)
+{
+  subgraph->removeElement(element);
+  if (element->kind() == Node && nodeIds.contains(element->id()) && !m_nodesMap.contains(element->id()))
+  {
+    // now laid out in the main graph
+    m_nodesMap.insert(element->id(), static_cast<GraphNode*>(element));
+    return;
+  }
+  if (element->kind() == Subgraph && m_subgraphsMap.value(element->id(), 0) == element)
+  {
+    // still a top level subgraph
+    return;
+  }
+  unindexElement(element->id(), element);
+  if (element->kind() == Subgraph)
+  {
+    discardSubgraph(static_cast<GraphSubgraph*>(element), nodeIds);
+  }
+  else
+  {
+    discardElement(element);
+  }
+}
 
+void DotGraph::discardSubgraph(GraphSubgraph* subgraph, const QSet<QString>& nodeIds)
+{
+  foreach (GraphSubgraph* nested, subgraph->subgraphs())
+  {
+    if (m_subgraphsMap.value(nested->id(), 0) != nested)
+    {
+      unindexElement(nested->id(), nested);
+      discardSubgraph(nested, nodeIds);
+    }
+  }
+  subgraph->subgraphs().clear();
+  foreach (GraphElement* element, subgraph->content())
+  {
+    purgeContentElement(subgraph, element, nodeIds);
+  }
+  discardElement(subgraph);
+}
+
+void DotGraph::purgeMissingElements(const QSet<QString>& nodeIds, const QSet<QString>& edgeIds,
+                                    const QSet<QString>& subgraphIds)
+{
+  GraphEdgeMap::iterator ite = m_edgesMap.begin();
+  while (ite != m_edgesMap.end())
+  {
+    if (edgeIds.contains(ite.key()))
+    {
+      ++ite;
+      continue;
+    }
+    GraphEdge* edge = ite.value();
+    unindexElement(ite.key(), edge);
+    ite = m_edgesMap.erase(ite);
+    discardElement(edge);
+  }
+
+  GraphNodeMap::iterator itn = m_nodesMap.begin();
+  while (itn != m_nodesMap.end())
+  {
+    if (nodeIds.contains(itn.key()))
+    {
+      ++itn;
+      continue;
+    }
+    GraphNode* node = itn.value();
+    unindexElement(itn.key(), node);
+    itn = m_nodesMap.erase(itn);
+    discardElement(node);
+  }
+
+  QList< GraphSubgraph* > missing;
+  GraphSubgraphMap::iterator its = m_subgraphsMap.begin();
+  while (its != m_subgraphsMap.end())
+  {
+    if (subgraphIds.contains(its.key()))
+    {
+      ++its;
+      continue;
+    }
+    unindexElement(its.key(), its.value());
+    missing.push_back(its.value());
+    its = m_subgraphsMap.erase(its);
+  }
+  // the canvas items of the nested subgraphs are children of their parent's
+  foreach (GraphSubgraph* subgraph, missing)
+  {
+    foreach (GraphSubgraph* nested, subgraph->subgraphs())
+    {
+      if (nested->canvasSubgraph() != 0)
+      {
+        nested->canvasSubgraph()->setParentItem(0);
+      }
+    }
+  }
+  foreach (GraphSubgraph* subgraph, missing)
+  {
+    foreach (GraphSubgraph* parent, m_subgraphsMap)
+    {
+      parent->subgraphs().remove(subgraph->id());
+    }
+    discardSubgraph(subgraph, nodeIds);
+  }
 }
 
 void DotGraph::removeNodeFromSubgraph(
@@ -660,7 +1602,7 @@ void DotGraph::removeNodeFromSubgraph(
     const QString& subgraphName)
 {
   kDebug() << nodeName << subgraphName;
-  GraphNode* node = dynamic_cast<GraphNode*>(elementNamed(nodeName));
+  GraphNode* node = nodeNamed(nodeName);
   if (node == 0)
   {
     kError() << "No such node " << nodeName;
@@ -691,27 +1633,7 @@ void DotGraph::removeSubgraphNamed(const QString& subgraphName)
     kError() << "Subgraph" << subgraphName << "not found";
     return;
   }
-  GraphEdgeMap::iterator it, it_end;
-  it = m_edgesMap.begin(); it_end = m_edgesMap.end();
-  while (it != it_end)
-  {
-    if ( it.value()->fromNode() == subgraph
-        || it.value()->toNode() == subgraph )
-    {
-      GraphEdge* edge = it.value();
-      if (edge->canvasEdge() != 0)
-      {
-        edge->canvasEdge()->hide();
-        delete edge->canvasEdge();
-        delete edge;
-      }
-      it = edges().erase(it);
-    }
-    else
-    {
-      ++it;
-    }
-  }
+  removeIncidentEdges(subgraph);
 
   if (subgraph->canvasSubgraph() != 0)
   {
@@ -721,23 +1643,24 @@ void DotGraph::removeSubgraphNamed(const QString& subgraphName)
   }
   foreach(GraphElement* element, subgraph->content())
   {
-    if (dynamic_cast<GraphNode*>(element) != 0)
+    if (element->kind() == Node)
     {
       kDebug() << "Adding" << element->id() << "to main graph";
-      nodes()[element->id()] = dynamic_cast<GraphNode*>(element);
+      nodes()[element->id()] = static_cast<GraphNode*>(element);
     }
-    else if (dynamic_cast<GraphSubgraph*>(element) != 0)
+    else if (element->kind() == Subgraph)
     {
-      subgraphs()[element->id()] = dynamic_cast<GraphSubgraph*>(element);
+      subgraphs()[element->id()] = static_cast<GraphSubgraph*>(element);
     }
     else
     {
       kError() << "Don't know how to handle" << element->id();
     }
   }
-  subgraph->content().clear();
+  subgraph->clearContent();
+  unindexElement(subgraphName, subgraph);
   subgraphs().remove(subgraphName);
-  delete subgraph;
+  destroyElement(subgraph);
 }
 
 void DotGraph::removeEdge(const QString& id)
@@ -749,12 +1672,13 @@ void DotGraph::removeEdge(const QString& id)
     GraphEdge* edge = it.value();
     if (edge->id() ==id)
     {
+      unindexElement(id, edge);
       if (edge->canvasEdge() != 0)
       {
         edge->canvasEdge()->hide();
         delete edge->canvasEdge();
-        delete edge;
       }
+      destroyElement(edge);
       edges().remove(id);
       break;
     }
@@ -796,8 +1720,80 @@ void DotGraph::removeElement(const QString& id)
   }
 }
 
+void DotGraph::recordChange(GraphElement* element, int changes)
+{
+  m_cellsValid = false;
+  if (m_updatingLayout)
+  {
+    // the new elements are displayed as a whole
+    if (m_recordingLayoutChanges && !m_layoutChanges.added.contains(element))
+    {
+      if (changes & GraphElement::Moved)
+      {
+        m_layoutChanges.restyled.remove(element);
+        m_layoutChanges.moved.insert(element);
+      }
+      else if (!m_layoutChanges.moved.contains(element))
+      {
+        m_layoutChanges.restyled.insert(element);
+      }
+    }
+    return;
+  }
+  if (element->changeRecorded())
+  {
+    return;
+  }
+  element->setChangeRecorded(true);
+  // an element created where a forgotten one was destroyed
+  m_forgottenChanges.remove(element);
+  m_changedElements.push_back(element);
+  if (m_changedElements.size() == 1)
+  {
+    QMetaObject::invokeMethod(this, "slotNotifyChanges", Qt::QueuedConnection);
+  }
+}
+
+QList< GraphElement* > DotGraph::takeChangedElements()
+{
+  QList< GraphElement* > changed;
+  changed.reserve(m_changedElements.size() - m_forgottenChanges.size());
+  foreach (GraphElement* element, m_changedElements)
+  {
+    // an element recorded again at the address of a forgotten one appears twice
+    if (!m_forgottenChanges.contains(element) && element->changeRecorded())
+    {
+      element->setChangeRecorded(false);
+      changed.push_back(element);
+    }
+  }
+  m_changedElements.clear();
+  m_forgottenChanges.clear();
+  return changed;
+}
+
+GraphChangeSet DotGraph::takeLayoutChanges()
+{
+  GraphChangeSet changes = m_layoutChanges;
+  m_layoutChanges = GraphChangeSet();
+  return changes;
+}
+
+void DotGraph::slotNotifyChanges()
+{
+  // the changes could have been taken since they were recorded
+  if (m_changedElements.size() > m_forgottenChanges.size())
+  {
+    emit elementsChanged();
+  }
+}
+
 void DotGraph::setAttribute(const QString& elementId, const QString& attributeName, const QString& attributeValue)
 {
+  if (attributeName == "id")
+  {
+    invalidateElementsIndex();
+  }
   if (nodes().contains(elementId))
   {
     nodes()[elementId]->attributes()[attributeName] = attributeValue;
@@ -814,21 +1810,182 @@ void DotGraph::setAttribute(const QString& elementId, const QString& attributeNa
 
 GraphElement* DotGraph::elementNamed(const QString& id)
 {
-  GraphElement* ret = 0;
-  if ((ret = m_nodesMap.value(id, 0))) {
-    return ret;
+  if (!m_elementsIndexValid)
+  {
+    buildElementsIndex();
+  }
+  return m_elementsIndex.value(id, 0);
+}
+
+void DotGraph::indexElement(const QString& id, GraphElement* element)
+{
+  if (!m_elementsIndexValid)
+  {
+    return;
+  }
+  QHash< QString, GraphElement* >::iterator it = m_elementsIndex.find(id);
+  if (it == m_elementsIndex.end())
+  {
+    m_elementsIndex.insert(id, element);
+  }
+  else if (element->kind() == it.value()->kind())
+  {
+    // replaced in its map
+    it.value() = element;
+  }
+  else if (element->kind() != Subgraph && (element->kind() == Node || it.value()->kind() == Subgraph))
+  {
+    // a node shadows the edges and the subgraphs, an edge the subgraphs
+    it.value() = element;
+    m_shadowedElementsCounts[id]++;
+  }
+  else
+  {
+    m_shadowedElementsCounts[id]++;
+  }
+}
+
+void DotGraph::unindexElement(const QString& id, GraphElement* element)
+{
+  if (!m_elementsIndexValid)
+  {
+    return;
+  }
+  QHash< QString, GraphElement* >::iterator it = m_elementsIndex.find(id);
+  if (it == m_elementsIndex.end())
+  {
+    return;
+  }
+  QHash< QString, int >::iterator shadowed = m_shadowedElementsCounts.find(id);
+  if (it.value() != element)
+  {
+    if (shadowed != m_shadowedElementsCounts.end() && --shadowed.value() == 0)
+    {
+      m_shadowedElementsCounts.erase(shadowed);
+    }
+    return;
+  }
+  if (shadowed == m_shadowedElementsCounts.end())
+  {
+    m_elementsIndex.erase(it);
+    return;
+  }
+  // only the element shadowed by this one is looked for
+  GraphElement* owner = elementNamedOtherThan(id, element);
+  if (owner == 0)
+  {
+    m_elementsIndex.erase(it);
+    m_shadowedElementsCounts.erase(shadowed);
+    return;
+  }
+  it.value() = owner;
+  if (--shadowed.value() == 0)
+  {
+    m_shadowedElementsCounts.erase(shadowed);
+  }
+}
+
+GraphElement* DotGraph::elementNamedOtherThan(const QString& id, const GraphElement* excluded) const
+{
+  GraphNode* node = m_nodesMap.value(id, 0);
+  if (node != 0 && node != excluded)
+  {
+    return node;
+  }
+  GraphEdge* edge = m_edgesMap.value(id, 0);
+  if (edge != 0 && edge != excluded)
+  {
+    return edge;
+  }
+  foreach (GraphSubgraph* subgraph, m_subgraphsMap)
+  {
+    GraphElement* element = subgraphElementNamedOtherThan(subgraph, id, excluded);
+    if (element != 0)
+    {
+      return element;
+    }
   }
-  if ((ret = m_edgesMap.value(id, 0))) {
-    return ret;
+  return 0;
+}
+
+GraphElement* DotGraph::subgraphElementNamedOtherThan(const GraphSubgraph* subgraph, const QString& id,
+                                                      const GraphElement* excluded) const
+{
+  if (subgraph != excluded && subgraph->id() == id)
+  {
+    return const_cast<GraphSubgraph*>(subgraph);
   }
-  foreach(GraphSubgraph* subGraph, m_subgraphsMap) {
-    if ((ret = subGraph->elementNamed(id))) {
-      return ret;
+  foreach (GraphElement* element, subgraph->content())
+  {
+    if (element->kind() == Subgraph)
+    {
+      GraphElement* found = subgraphElementNamedOtherThan(static_cast<GraphSubgraph*>(element), id, excluded);
+      if (found != 0)
+      {
+        return found;
+      }
+    }
+    else if (element != excluded && element->id() == id)
+    {
+      return element;
     }
   }
   return 0;
 }
 
+void DotGraph::buildElementsIndex()
+{
+  kDebug();
+  m_elementsIndex.clear();
+  m_shadowedElementsCounts.clear();
+  m_elementsIndex.reserve(m_nodesMap.size() + m_edgesMap.size() + m_subgraphsMap.size());
+  // the first element found keeps the id, as with the former recursive lookup
+  GraphNodeMap::const_iterator itn = m_nodesMap.constBegin();
+  for (; itn != m_nodesMap.constEnd(); itn++)
+  {
+    m_elementsIndex.insert(itn.key(), itn.value());
+  }
+  GraphEdgeMap::const_iterator ite = m_edgesMap.constBegin();
+  for (; ite != m_edgesMap.constEnd(); ite++)
+  {
+    indexShadowableElement(ite.key(), ite.value());
+  }
+  foreach (GraphSubgraph* subgraph, m_subgraphsMap)
+  {
+    indexSubgraph(subgraph);
+  }
+  m_elementsIndexValid = true;
+}
+
+void DotGraph::indexSubgraph(GraphSubgraph* subgraph)
+{
+  indexShadowableElement(subgraph->id(), subgraph);
+  foreach (GraphElement* element, subgraph->content())
+  {
+    if (element->kind() == Subgraph)
+    {
+      indexSubgraph(static_cast<GraphSubgraph*>(element));
+    }
+    else
+    {
+      indexShadowableElement(element->id(), element);
+    }
+  }
+}
+
+void DotGraph::indexShadowableElement(const QString& id, GraphElement* element)
+{
+  QHash< QString, GraphElement* >::iterator it = m_elementsIndex.find(id);
+  if (it == m_elementsIndex.end())
+  {
+    m_elementsIndex.insert(id, element);
+  }
+  else if (it.value() != element)
+  {
+    m_shadowedElementsCounts[id]++;
+  }
+}
+
 void DotGraph::setGraphAttributes(QMap<QString,QString> attribs)
 {
   kDebug() << attribs;
@@ -839,27 +1996,30 @@ void DotGraph::setGraphAttributes(QMap<QString,QString> attribs)
 void DotGraph::addNewNode(QMap<QString,QString> attribs)
 {
   kDebug() << attribs;
-  GraphNode* newNode = new GraphNode();
+  GraphNode* newNode = createNode();
   newNode->attributes() = attribs;
   nodes().insert(newNode->id(), newNode);
+  indexElement(newNode->id(), newNode);
   kDebug() << "node added as" << newNode->id();
 }
 
 void DotGraph::addNewSubgraph(QMap<QString,QString> attribs)
 {
   kDebug() << attribs;
-  GraphSubgraph* newSG = new GraphSubgraph();
+  GraphSubgraph* newSG = createSubgraph();
   newSG->attributes() = attribs;
   subgraphs()[newSG->id()] = newSG;
+  indexElement(newSG->id(), newSG);
   kDebug() << "subgraph added as" << newSG->id();
 }
 
 void DotGraph::addNewNodeToSubgraph(QMap<QString,QString> attribs, QString subgraph)
 {
   kDebug() << attribs << "to" << subgraph;
-  GraphNode* newNode = new GraphNode();
+  GraphNode* newNode = createNode();
   newNode->attributes() = attribs;
-  subgraphs()[subgraph]->content().push_back(newNode);
+  subgraphs()[subgraph]->appendElement(newNode);
+  indexElement(newNode->id(), newNode);
 
   kDebug() << "node added as" << newNode->id() << "in" << subgraph;
 }
@@ -867,7 +2027,7 @@ void DotGraph::addNewNodeToSubgraph(QMap<QString,QString> attribs, QString subgr
 void DotGraph::addExistingNodeToSubgraph(QMap<QString,QString> attribs,QString subgraph)
 {
   kDebug() << attribs << "to" << subgraph;
-  GraphNode* node = dynamic_cast<GraphNode*>(elementNamed(attribs["id"]));
+  GraphNode* node = nodeNamed(attribs["id"]);
   if (node == 0)
   {
     kError() << "No such node" << attribs["id"];
@@ -877,28 +2037,19 @@ void DotGraph::addExistingNodeToSubgraph(QMap<QString,QString> attribs,QString s
   {
     nodes().remove(attribs["id"]);
     node->attributes() = attribs;
-    subgraphs()[subgraph]->content().push_back(node);
+    subgraphs()[subgraph]->appendElement(node);
     kDebug() << "node " << node->id() << " added in " << subgraph;
   }
   else
   {
     foreach(GraphSubgraph* gs, subgraphs())
     {
-      GraphElement* elt = 0;
-      foreach(GraphElement* element, gs->content())
+      if (gs->contentElement(node->id()) == node)
       {
-        if (element == node)
-        {
-          elt = element;
-          break;
-        }
-      }
-      if (elt != 0)
-      {
-        kDebug() << "removing node " << elt->id() << " from " << gs->id();
-        gs->removeElement(elt);
-        subgraphs()[subgraph]->content().push_back(elt);
-        kDebug() << "node " << elt->id() << " added in " << subgraph;
+        kDebug() << "removing node " << node->id() << " from " << gs->id();
+        gs->removeElement(node);
+        subgraphs()[subgraph]->appendElement(node);
+        kDebug() << "node " << node->id() << " added in " << subgraph;
         break;
       }
     }
@@ -908,7 +2059,7 @@ void DotGraph::addExistingNodeToSubgraph(QMap<QString,QString> attribs,QString s
 void DotGraph::moveExistingNodeToMainGraph(QMap<QString,QString> attribs)
 {
   kDebug() << attribs;
-  GraphNode* node = dynamic_cast<GraphNode*>(elementNamed(attribs["id"]));
+  GraphNode* node = nodeNamed(attribs["id"]);
   if (node == 0)
   {
     kError() << "No such node" << attribs["id"];
@@ -923,16 +2074,7 @@ void DotGraph::moveExistingNodeToMainGraph(QMap<QString,QString> attribs)
   {
     foreach(GraphSubgraph* gs, subgraphs())
     {
-      bool found = false;
-      foreach(GraphElement* element, gs->content())
-      {
-        if (element == node)
-        {
-          found = true;
-          break;
-        }
-      }
-      if (found)
+      if (gs->contentElement(node->id()) == node)
       {
         kDebug() << "removing node " << node->id() << " from " << gs->id();
         gs->removeElement(node);
@@ -947,7 +2089,7 @@ void DotGraph::moveExistingNodeToMainGraph(QMap<QString,QString> attribs)
 void DotGraph::addNewEdge(QString src, QString tgt, QMap<QString,QString> attribs)
 {
   kDebug() << src << tgt << attribs;
-  GraphEdge* newEdge = new GraphEdge();
+  GraphEdge* newEdge = createEdge();
   newEdge->attributes() = attribs;
   GraphElement* srcElement = elementNamed(src);
   if (srcElement == 0)
@@ -963,6 +2105,7 @@ void DotGraph::addNewEdge(QString src, QString tgt, QMap<QString,QString> attrib
   if (srcElement == 0 || tgtElement == 0)
   {
     kError() << src << "or" << tgt << "missing";
+    destroyElement(newEdge);
     return;
   }
   if (attribs.contains("id"))
@@ -971,11 +2114,24 @@ void DotGraph::addNewEdge(QString src, QString tgt, QMap<QString,QString> attrib
   }
   else
   {
-    newEdge->setId(src+tgt+QUuid::createUuid().toString().remove('{').remove('}').remove('-'));
+    newEdge->setId(anonymousEdgeId(src, tgt));
   }
   newEdge->setFromNode(srcElement);
   newEdge->setToNode(tgtElement);
   edges().insert(newEdge->id(), newEdge);
+  indexElement(newEdge->id(), newEdge);
+}
+
+QString DotGraph::anonymousEdgeId(const QString& tail, const QString& head)
+{
+  int& ordinal = m_parallelEdgesCounts[qMakePair(tail, head)];
+  QString id = GraphEdge::anonymousId(tail, head, ordinal++);
+  // an explicit id or names containing "->" could already use it
+  while (edges().contains(id))
+  {
+    id = GraphEdge::anonymousId(tail, head, ordinal++);
+  }
+  return id;
 }
 
 void DotGraph::removeAttribute(const QString& nodeName, const QString& attribName)
@@ -984,6 +2140,10 @@ void DotGraph::removeAttribute(const QString& nodeName, const QString& attribNam
   GraphElement* element = elementNamed(nodeName);
   if (element != 0)
   {
+    if (attribName == "id")
+    {
+      unindexElement(nodeName, element);
+    }
     element->removeAttribute(attribName);
   }
 }
@@ -995,17 +2155,19 @@ void DotGraph::renameNode(const QString& oldNodeName, const QString& newNodeName
     kDebug() << "Renaming " << oldNodeName << " into " << newNodeName;
     GraphNode* node = nodes()[oldNodeName];
     nodes().remove(oldNodeName);
+    unindexElement(oldNodeName, node);
     node->setId(newNodeName);
     nodes()[newNodeName] = node;
+    indexElement(newNodeName, node);
   }
 }
 
 QString DotGraph::backColor() const
 {
   kDebug();
-  if (m_attributes.find("bgcolor") != m_attributes.end())
+  if (hasAttribute("bgcolor"))
   {
-    return m_attributes["bgcolor"];
+    return attribute("bgcolor");
   }
   else
   {
@@ -23,11 +23,16 @@
 #ifndef DOT_GRAPH_H
 #define DOT_GRAPH_H
 
+#include <QHash>
 #include <QList>
+#include <QPair>
 #include <QSet>
 #include <QString>
+#include <QStringList>
+#include <QPointer>
 #include <QProcess>
-#include <QMutex>
+#include <QRectF>
+#include <QVector>
 
 #include <graphviz/gvc.h>
 
@@ -36,27 +41,79 @@
 #include "graphsubgraph.h"
 #include "graphnode.h"
 #include "graphedge.h"
+#include "graphelementarena.h"
+#include "graphmemoryusage.h"
+#include "layoutservice.h"
 #include "dotdefaults.h"
 
 namespace KGraphViewer
 {
-  
+
+class LayoutCacheLookup;
+class LayoutCacheWriter;
+
+/**
+ * The changes made to the elements of a graph by its updates with new
+ * layouts, for the views to update only the canvas items concerned
+ */
+struct GraphChangeSet
+{
+  /** Elements new in the graph, without canvas items yet */
+  QSet< GraphElement* > added;
+  /** Elements whose layout attributes changed */
+  QSet< GraphElement* > moved;
+  /** Elements whose other attributes only changed */
+  QSet< GraphElement* > restyled;
+  /** Ids of the elements missing from the new layouts, destroyed with their canvas items */
+  QStringList removed;
+
+  inline bool isEmpty() const
+  {
+    return added.isEmpty() && moved.isEmpty() && restyled.isEmpty() && removed.isEmpty();
+  }
+};
+
 /**
   * A class representing the model of a GraphViz dot graph
   */
-class DotGraph : public GraphElement
+class DotGraph : public QObject, public GraphElement
 {
   Q_OBJECT
 public:
   enum ParsePhase {Initial, Final};
+  enum ParserEngine {SpiritParser, HandWrittenParser};
   
-  DotGraph();
-  DotGraph(const QString& command, const QString& fileName);
+  KGRAPHVIEWER_EXPORT DotGraph();
+  KGRAPHVIEWER_EXPORT DotGraph(const QString& command, const QString& fileName);
 
-  virtual ~DotGraph();
+  virtual KGRAPHVIEWER_EXPORT ~DotGraph();
   
-  QString chooseLayoutProgramForFile(const QString& str);
-  bool parseDot(const QString& str);
+  /**
+   * Returns neato for the files holding an undirected graph and dot for the
+   * other ones, reading only their start.
+   */
+  static QString KGRAPHVIEWER_EXPORT chooseLayoutProgramForFile(const QString& str);
+  /**
+   * Queues a run of the layout command on the given dot file in the
+   * LayoutService, cancelling the run still pending, if any. The graph is
+   * updated with the layout and readyToDisplay() emitted once it is done.
+   * A layout of the same file content by the same command found in the
+   * LayoutCache, looked up in a worker thread, is used instead of running
+   * the command, and the new layouts are written to it while output.
+   */
+  bool parseDot(const QString& str, LayoutJob::Priority priority = LayoutJob::Normal);
+  /** True while a layout program run for this graph is queued or running */
+  inline bool isLayoutRunning() const {return m_layoutJob != 0 || m_cacheLookup != 0;}
+  /** In ms, 0 for no limit. The layout runs exceeding it fail. */
+  inline void setLayoutTimeout(int timeout) {m_layoutTimeout = timeout;}
+  inline int layoutTimeout() const {return m_layoutTimeout;}
+
+  /**
+   * Parses the given xdot layout result into this (empty) graph. The parsing
+   * state is local to the call, so several graphs can be parsed at the same
+   * time from different threads.
+   */
+  bool KGRAPHVIEWER_EXPORT parseXdot(const QByteArray& xdot);
   
   /** Constant accessor to the nodes of this graph */
   inline const GraphNodeMap& nodes() const {return m_nodesMap;}
@@ -68,6 +125,46 @@ public:
   /** Accessor to the edges of this graph */
   inline GraphEdgeMap& edges() {return m_edgesMap;}
   inline GraphSubgraphMap& subgraphs() {return m_subgraphsMap;}
+
+  /**
+   * The elements of the graph are stored in arenas owned by it: they have
+   * to be created with these functions, and are all freed with the graph.
+   * The caller inserts them in the maps or in subgraphs contents, and only
+   * elements removed from the graph before it is destroyed are destroyed
+   * with destroyElement().
+   */
+  inline GraphNode* createNode() {return adopt(m_nodesArena.create());}
+  inline GraphNode* createNode(const GraphNode& node) {return adopt(m_nodesArena.create(node));}
+  inline GraphNode* createNode(node_t* node) {return adopt(m_nodesArena.create(node));}
+  inline GraphEdge* createEdge() {return adopt(m_edgesArena.create());}
+  inline GraphSubgraph* createSubgraph() {return adopt(m_subgraphsArena.create());}
+  inline void destroyElement(GraphNode* node) {forgetChange(node); m_nodesArena.destroy(node);}
+  inline void destroyElement(GraphEdge* edge)
+  {
+    forgetChange(edge);
+    edge->setFromNode(0);
+    edge->setToNode(0);
+    m_edgesArena.destroy(edge);
+  }
+  inline void destroyElement(GraphSubgraph* subgraph) {forgetChange(subgraph); m_subgraphsArena.destroy(subgraph);}
+
+  /**
+   * Records that an element of this graph changed, changes being
+   * GraphElement::ContentChange flags. Outside of the updates with new
+   * layouts, the elementsChanged() signal is emitted once in the next event
+   * loop iteration, however many elements changed until then.
+   */
+  void recordChange(GraphElement* element, int changes = GraphElement::Restyled);
+  /**
+   * Returns the elements changed since the last call, each one once, and
+   * empties the changes journal
+   */
+  QList< GraphElement* > KGRAPHVIEWER_EXPORT takeChangedElements();
+  /**
+   * Returns the changes made by the updates with new layouts since the last
+   * call, and forgets them
+   */
+  GraphChangeSet KGRAPHVIEWER_EXPORT takeLayoutChanges();
   double width() const {return m_width;}
   double height() const {return m_height;}
   double scale() const {return m_scale;}
@@ -81,8 +178,27 @@ public:
   inline bool strict() const {return m_strict;}
   inline bool directed() const {return m_directed;}
 
-  QSet< GraphNode* >& nodesOfCell(unsigned int id);
-  
+  /**
+   * Builds the spatial index of the nodes, edges and subgraphs: a grid of
+   * horizCellFactor() x vertCellFactor() cells of wdhcf() x hdvcf() points
+   * over their layout bounding boxes, each cell listing the elements it
+   * overlaps. It is built after each new layout, and again at the next
+   * query when elements were added, removed or changed since.
+   */
+  void KGRAPHVIEWER_EXPORT computeCells();
+  /**
+   * Returns the elements whose bounding box overlaps rect, in graph
+   * coordinates (points, y going up), each one once and in no given order
+   */
+  QList< GraphElement* > KGRAPHVIEWER_EXPORT elementsIn(const QRectF& rect);
+  /**
+   * Returns the element whose bounding box is the nearest to point and not
+   * farther than maxDistance, the smallest one among those containing point
+   * (a node before the cluster holding it), or 0
+   */
+  GraphElement* KGRAPHVIEWER_EXPORT elementNearestTo(const QPointF& point, qreal maxDistance = 0);
+  QList< GraphNode* > nodesOfCell(unsigned int id);
+
   inline unsigned int horizCellFactor() const {return m_horizCellFactor;}
   inline unsigned int vertCellFactor() const {return m_vertCellFactor;}
   inline double wdhcf() const {return m_wdhcf;}
@@ -104,15 +220,65 @@ public:
   void KGRAPHVIEWER_EXPORT saveTo(const QString& fileName);
 
   virtual void updateWithGraph(graph_t* newGraph);
-  virtual void updateWithGraph(const DotGraph& graph);
+  virtual KGRAPHVIEWER_EXPORT void updateWithGraph(const DotGraph& graph);
+  /**
+   * Updates this graph with graph, a layout of it just read. When this graph
+   * is still empty, the elements of graph are moved to it instead of being
+   * copied, leaving graph empty.
+   */
+  void KGRAPHVIEWER_EXPORT updateWithParsedGraph(DotGraph& graph);
 
   void KGRAPHVIEWER_EXPORT setAttribute(const QString& elementId, const QString& attributeName, const QString& attributeValue);
 
-  GraphElement* elementNamed(const QString& id);
+  /**
+   * Returns the node, edge or subgraph with the given id at any nesting
+   * level, or 0. The lookup uses an index built when first needed and kept
+   * up to date by the mutators below and by the parser. Code changing the
+   * elements maps or the subgraphs contents directly has to call
+   * indexElement() and unindexElement() or invalidateElementsIndex().
+   */
+  GraphElement* KGRAPHVIEWER_EXPORT elementNamed(const QString& id);
+  /** The node with the given id at any nesting level, or 0 */
+  inline GraphNode* nodeNamed(const QString& id)
+  {
+    GraphElement* element = elementNamed(id);
+    return (element != 0 && element->kind() == Node) ? static_cast<GraphNode*>(element) : 0;
+  }
+  /**
+   * Makes elementNamed() find element under id, its key in the nodes, edges
+   * or subgraphs map. Nodes shadow the edges and subgraphs with the same id
+   * and edges the subgraphs, as when the index is built.
+   */
+  void indexElement(const QString& id, GraphElement* element);
+  /**
+   * To call before element is removed or its id changed. When it shadowed
+   * other elements, the first of them is indexed in its place.
+   */
+  void unindexElement(const QString& id, GraphElement* element);
+  /** The index will be built again at the next lookup */
+  inline void invalidateElementsIndex() {m_elementsIndexValid = false;}
 
   inline void setUseLibrary(bool value) {m_useLibrary = value;}
   inline bool useLibrary() {return m_useLibrary;}
 
+  inline void setParserEngine(ParserEngine engine) {m_parserEngine = engine;}
+  inline ParserEngine parserEngine() const {return m_parserEngine;}
+
+  /**
+   * If true, the elements of the graphs read later keep their xdot drawing
+   * attributes and decode their render operations only when first used
+   */
+  inline void setDeferRenderOperations(bool defer) {m_deferRenderOperations = defer;}
+  inline bool deferRenderOperations() const {return m_deferRenderOperations;}
+  /**
+   * Decodes the render operations of all the elements still pending, sharing
+   * the work between the threads of the global thread pool
+   */
+  void KGRAPHVIEWER_EXPORT decodePendingRenderOperations();
+
+  /** The bytes used by the model of this graph, its display not included */
+  GraphMemoryUsage KGRAPHVIEWER_EXPORT memoryUsage() const;
+
   void KGRAPHVIEWER_EXPORT setGraphAttributes(QMap<QString,QString> attribs);
   void KGRAPHVIEWER_EXPORT addNewNode(QMap<QString,QString> attribs);
   void KGRAPHVIEWER_EXPORT addNewSubgraph(QMap<QString,QString> attribs);
@@ -120,6 +286,12 @@ public:
   void KGRAPHVIEWER_EXPORT addExistingNodeToSubgraph(QMap<QString,QString> attribs,QString subgraph);
   void KGRAPHVIEWER_EXPORT moveExistingNodeToMainGraph(QMap<QString,QString> attribs);
   void KGRAPHVIEWER_EXPORT addNewEdge(QString src, QString tgt, QMap<QString,QString> attribs);
+  /**
+   * Returns the id of a new edge from tail to head without id attribute. Its
+   * ordinal counts the edges between them already given an id this way, so
+   * that loading the same graph again gives the same ids.
+   */
+  QString KGRAPHVIEWER_EXPORT anonymousEdgeId(const QString& tail, const QString& head);
   void KGRAPHVIEWER_EXPORT removeAttribute(const QString& nodeName, const QString& attribName);
   void KGRAPHVIEWER_EXPORT renameNode(const QString& oldNodeName, const QString& newNodeName);
   void KGRAPHVIEWER_EXPORT removeNodeNamed(const QString& nodeName);
@@ -128,22 +300,125 @@ public:
   void KGRAPHVIEWER_EXPORT removeEdge(const QString& id);
   void KGRAPHVIEWER_EXPORT removeElement(const QString& id);
 
+public Q_SLOTS:
+  /** Cancels the layout run still pending, if any: the graph is not updated */
+  void KGRAPHVIEWER_EXPORT cancelLayout();
+
 Q_SIGNALS:
   void readyToDisplay();
+  /** Emitted periodically while the layout program runs, elapsed being in ms */
+  void layoutProgress(qint64 bytesRead, int elapsed);
+  /** Some elements changed: they are given by takeChangedElements() */
+  void elementsChanged();
 
 private Q_SLOTS:
+  void slotNotifyChanges();
+  void slotDotOutputAvailable();
   void slotDotRunningDone(int,QProcess::ExitStatus);
   void slotDotRunningError(QProcess::ProcessError);
+  void slotCacheLookupDone();
   
 private:
-  unsigned int cellNumber(int x, int y);
-  void computeCells();
+  struct StreamedLayout;
+
+  template <typename T>
+  inline T* adopt(T* element)
+  {
+    element->setGraph(this);
+    m_cellsValid = false;
+    if (m_recordingLayoutChanges)
+    {
+      m_layoutChanges.added.insert(element);
+    }
+    return element;
+  }
+  inline void forgetChange(GraphElement* element)
+  {
+    m_cellsValid = false;
+    if (element->changeRecorded())
+    {
+      // its entry in m_changedElements is skipped, without searching it now
+      m_forgottenChanges.insert(element);
+    }
+    m_layoutChanges.added.remove(element);
+    m_layoutChanges.moved.remove(element);
+    m_layoutChanges.restyled.remove(element);
+  }
+
+  inline bool isEmpty() const
+  {
+    return m_nodesMap.isEmpty() && m_edgesMap.isEmpty() && m_subgraphsMap.isEmpty();
+  }
+  /**
+   * Records the changes of an element updated from a graphviz layout, its
+   * previous attributes confirming the hashes found unchanged
+   */
+  inline void recordLayoutUpdate(GraphElement* element, const QMap<QString,QString>& previous)
+  {
+    int changes = element->updateContentHashes(*element);
+    if (changes != (GraphElement::Moved | GraphElement::Restyled))
+    {
+      changes |= element->attributesChanges(previous);
+    }
+    if (changes != GraphElement::Unchanged)
+    {
+      recordChange(element, changes);
+    }
+  }
+  /** Destroys the elements missing from newGraph before updating with it */
+  void purgeMissingElements(const DotGraph& newGraph);
+  /** Destroys the nodes, edges and top level subgraphs whose id is not given */
+  void purgeMissingElements(const QSet<QString>& nodeIds, const QSet<QString>& edgeIds,
+                            const QSet<QString>& subgraphIds);
+  /**
+   * Destroys the content and nested subgraphs of subgraph missing from the
+   * ones of newSubgraph, recursively. The missing nodes whose id is in
+   * nodeIds, the top level nodes of the new layout, move to the nodes map.
+   */
+  void purgeMissingContent(GraphSubgraph* subgraph, const GraphSubgraph& newSubgraph,
+                           const QSet<QString>& nodeIds);
+  void purgeMissingContent(GraphSubgraph* subgraph, graph_t* newSubgraph, const QSet<QString>& nodeIds);
+  /** Removes element from the content of subgraph, then moves it to the nodes map or destroys it */
+  void purgeContentElement(GraphSubgraph* subgraph, GraphElement* element, const QSet<QString>& nodeIds);
+  /** Destroys a subgraph already removed from its parent, with its content and nested subgraphs */
+  void discardSubgraph(GraphSubgraph* subgraph, const QSet<QString>& nodeIds);
+  /**
+   * Destroys an element already removed from the maps and subgraphs, with
+   * its canvas item and the edges of a node or subgraph
+   */
+  void discardElement(GraphElement* element);
+
+  /** Removes the edges leaving or reaching the given node or subgraph */
+  void removeIncidentEdges(GraphElement* element);
+  unsigned int cellNumber(qreal x, qreal y) const;
+  void addToCells(GraphElement* element);
+  /** Appends to found the positions in m_cellsElements of the elements overlapping rect */
+  void cellsElementsIn(const QRectF& rect, QVector< int >& found);
+  void buildElementsIndex();
+  void indexSubgraph(GraphSubgraph* subgraph);
+  /** Indexes element under id unless an element found before has this id */
+  void indexShadowableElement(const QString& id, GraphElement* element);
+  /** An element with the given id other than excluded, in the index order */
+  GraphElement* elementNamedOtherThan(const QString& id, const GraphElement* excluded) const;
+  GraphElement* subgraphElementNamedOtherThan(const GraphSubgraph* subgraph, const QString& id,
+                                              const GraphElement* excluded) const;
+  /**
+   * Queues the layout program run prepared by parseDot(), its output being
+   * stored in the cache under cacheKey if not empty
+   */
+  void startLayoutJob(const QByteArray& cacheKey);
+  /** Parses a whole layout program output and updates this graph with it */
+  bool updateWithXdot(QByteArray xdot);
+  /** Reads the end of the layout output and forgets the finished run */
   QByteArray getDotResult(int exitCode, QProcess::ExitStatus exitStatus);
     
   QString m_dotFileName;
   GraphSubgraphMap m_subgraphsMap;
   GraphNodeMap m_nodesMap;
   GraphEdgeMap m_edgesMap;
+  GraphElementArena< GraphNode > m_nodesArena;
+  GraphElementArena< GraphEdge > m_edgesArena;
+  GraphElementArena< GraphSubgraph > m_subgraphsArena;
   double m_width, m_height;
   double m_scale;
   bool m_directed;
@@ -151,18 +426,57 @@ private:
   QString m_layoutCommand;
   
   unsigned int m_horizCellFactor, m_vertCellFactor;
-  QVector< QSet< GraphNode* > > m_cells;
-  
+  /** The positions in m_cellsElements of the elements overlapping each cell */
+  QVector< QVector< int > > m_cells;
+  QVector< GraphElement* > m_cellsElements;
+  QVector< QRectF > m_cellsBoxes;
+  /** The elements overlapping too many cells to be listed in each one */
+  QVector< int > m_largeCellsElements;
+  /** The query which last found each element, not to return it twice */
+  QVector< uint > m_cellsMarks;
+  uint m_cellsMark;
+  QPointF m_cellsOrigin;
+  bool m_cellsValid;
+
   double m_wdhcf, m_hdvcf;
 
   bool m_readWrite;
-  QProcess* m_dot;
+  /** The layout program run pending, deleted by the LayoutService once ended */
+  QPointer< LayoutJob > m_layoutJob;
+  int m_layoutTimeout;
+  /** The arguments and priority of the layout program run once the cache missed */
+  QStringList m_layoutArguments;
+  LayoutJob::Priority m_layoutPriority;
+  /** The search of the layout in the LayoutCache, pending before the run */
+  LayoutCacheLookup* m_cacheLookup;
+  /** Stores the output of the layout program run in the cache, if enabled */
+  LayoutCacheWriter* m_cacheWriter;
+  /** The graph read while the layout program runs, with the handwritten parser */
+  StreamedLayout* m_streamedLayout;
 
   ParsePhase m_phase;
 
-  QMutex m_dotProcessMutex;
-
   bool m_useLibrary;
+
+  ParserEngine m_parserEngine;
+  bool m_deferRenderOperations;
+
+  QHash< QPair< QString, QString >, int > m_parallelEdgesCounts;
+
+  QHash< QString, GraphElement* > m_elementsIndex;
+  /** The number of the other elements with the id of an indexed one */
+  QHash< QString, int > m_shadowedElementsCounts;
+  bool m_elementsIndexValid;
+
+  QList< GraphElement* > m_changedElements;
+  /** The destroyed elements of m_changedElements, which are not dereferenced */
+  QSet< GraphElement* > m_forgottenChanges;
+
+  /** True while updating with a new layout */
+  bool m_updatingLayout;
+  /** False when the first layout is read: all the elements are new */
+  bool m_recordingLayoutChanges;
+  GraphChangeSet m_layoutChanges;
 };
 
 }
@@ -44,8 +44,10 @@
 #include "kgraphviewer_partsettings.h"
 #include "simpleprintingcommand.h"
 #include "graphexporter.h"
+#include "graphmemoryusage.h"
 #include "loadagraphthread.h"
-#include "layoutagraphthread.h"
+#include "layoutagraphprocess.h"
+#include "layoutcache.h"
 
 #include <stdlib.h>
 #include <math.h>
@@ -66,9 +68,10 @@
 #include <QMenu>
 #include <QGraphicsSimpleTextItem>
 #include <QScrollBar>
-#include <QUuid>
 #include <QSvgGenerator>
 #include <QApplication>
+#include <QLineF>
+#include <QPolygonF>
 
 #include <kdebug.h>
 #include <klocale.h>
@@ -111,16 +114,29 @@ public:
     m_newEdgeDraft(0),
     m_readWrite(false),
     m_leavedTimer(std::numeric_limits<int>::max()),
+    m_reloadTimer(std::numeric_limits<int>::max()),
+    m_changedFileName(),
+    m_askingReload(false),
+    m_loadingLabel(0),
     m_highlighting(false),
     m_loadThread(),
-    m_layoutThread(),
+    m_libraryFileName(),
+    m_libraryLoadPending(false),
+    m_libraryLayoutCommand(),
+    m_libraryCacheKey(),
+    m_libraryCacheLookup(0),
+    m_layoutProcess(),
     m_backgroundColor(QColor("white")),
+    m_graphDisplayed(false),
+    m_elementsZValue(-1),
     q_ptr( parent )
   {
     
   }
   virtual ~DotGraphViewPrivate()
   {
+    // the layout process is killed with m_layoutProcess
+    m_loadThread.wait();
     delete m_birdEyeView;
     m_birdEyeView = 0;
     if (m_popup != 0)
@@ -146,6 +162,27 @@ public:
   void exportToImage();
   KActionCollection* actionCollection() {return m_actions;}
   int displaySubgraph(GraphSubgraph* gsubgraph, int zValue, CanvasElement* parent = 0);
+  void displayNode(GraphNode* gnode, int zValue);
+  void displayEdge(GraphEdge* gedge, int zValue);
+  void displayGraphLabels();
+  /** Updates only the canvas items of the elements changed by a new layout */
+  void displayLayoutChanges(const GraphChangeSet& changes);
+  /** Unlinks the elements from their canvas items before the canvas is cleared */
+  void forgetCanvasItems();
+  /** The scale of the canvas items at the current detail level */
+  double detailScale() const;
+  /** Scene coordinates to the graph ones, in points with y going up */
+  QPointF sceneToGraph(const QPointF& point) const;
+  QRectF sceneToGraph(const QRectF& rect) const;
+  /** The number of graph elements overlapping a rectangle of the view */
+  int elementsCountIn(const QRect& rect);
+  /** The graph element under a point of the view, or 0 */
+  GraphElement* elementAt(const QPoint& pos);
+  /** True while the graph is read or laid out, by a program or the library */
+  bool isLayoutRunning() const;
+  /** Reads m_libraryFileName with the graphviz library, after the file being read if any */
+  void readLibraryFile();
+  void cancelLibraryCacheLookup();
 
 
   QSet<QGraphicsSimpleTextItem*> m_labelViews;
@@ -192,6 +229,16 @@ public:
   /// edge drawing
   int m_leavedTimer;
 
+  /// identifier of the timer started when the file changes, reloading it
+  /// once the changes stop
+  int m_reloadTimer;
+  QString m_changedFileName;
+  /// true while the user is asked whether to reload the changed file
+  bool m_askingReload;
+
+  /// the text shown while the graph is laid out, deleted with the canvas
+  QGraphicsSimpleTextItem* m_loadingLabel;
+
   DotGraphView::ScrollDirection m_scrollDirection;
 
   QPoint m_pressPos;
@@ -203,12 +250,27 @@ public:
   /// A thread to load graphviz agraph files
   LoadAGraphThread m_loadThread;
 
-  /// A thread to layout graphviz agraph files
-  LayoutAGraphThread m_layoutThread;
+  /// the file to load with the library, the newest request, or empty if cancelled
+  QString m_libraryFileName;
+  /// true when a file was requested while the thread was loading another one
+  bool m_libraryLoadPending;
+  /// the layout command of the newest request and the key of its layout in the cache
+  QString m_libraryLayoutCommand;
+  QByteArray m_libraryCacheKey;
+  /// The search of the layout of m_libraryFileName in the LayoutCache, pending before reading it
+  LayoutCacheLookup* m_libraryCacheLookup;
+
+  /// Runs the layout program on the graphviz agraph files, killed by a new layout
+  LayoutAGraphProcess m_layoutProcess;
 
   /// The graph background color
   QColor m_backgroundColor;
 
+  /// true once the graph is displayed: its new layouts only update the changed elements
+  bool m_graphDisplayed;
+  /// the z value under the nodes and edges, above the subgraphs
+  int m_elementsZValue;
+
   DotGraphView * const q_ptr;
   Q_DECLARE_PUBLIC(DotGraphView);
 };
@@ -297,19 +359,10 @@ void DotGraphViewPrivate::updateBirdEyeView()
   KGraphViewerInterface::PannerPosition zp = m_zoomPosition;
   if (zp == KGraphViewerInterface::Auto)
   {
-    QPointF tl1Pos = q->mapToScene(QPoint(0,0));
-    QPointF tl2Pos = q->mapToScene(QPoint(cvW,cvH));
-    QPointF tr1Pos = q->mapToScene(QPoint(x,0));
-    QPointF tr2Pos = q->mapToScene(QPoint(x+cvW,cvH));
-    QPointF bl1Pos = q->mapToScene(QPoint(0,y));
-    QPointF bl2Pos = q->mapToScene(QPoint(cvW,y+cvH));
-    QPointF br1Pos = q->mapToScene(QPoint(x,y));
-    QPointF br2Pos = q->mapToScene(QPoint(x+cvW,y+cvH));
-    int tlCols = m_canvas->items(QRectF(tl1Pos.x(),tl1Pos.y(),tl2Pos.x(),tl2Pos.y())).count();
-    kDebug() << tr1Pos.x() << tr1Pos.y() << tr2Pos.x() << tr2Pos.y();
-    int trCols = m_canvas->items(QRectF(tr1Pos.x(),tr1Pos.y(),tr2Pos.x(),tr2Pos.y())).count();
-    int blCols = m_canvas->items(QRectF(bl1Pos.x(),bl1Pos.y(),bl2Pos.x(),bl2Pos.y())).count();
-    int brCols = m_canvas->items(QRectF(br1Pos.x(),br1Pos.y(),br2Pos.x(),br2Pos.y())).count();
+    int tlCols = elementsCountIn(QRect(0, 0, int(cvW), int(cvH)));
+    int trCols = elementsCountIn(QRect(int(x), 0, int(cvW), int(cvH)));
+    int blCols = elementsCountIn(QRect(0, int(y), int(cvW), int(cvH)));
+    int brCols = elementsCountIn(QRect(int(x), int(y), int(cvW), int(cvH)));
     int minCols = tlCols;
     zp = m_lastAutoPosition;
     switch(zp)
@@ -375,22 +428,10 @@ int DotGraphViewPrivate::displaySubgraph(GraphSubgraph* gsubgraph, int zValue, C
   }
   foreach (GraphElement* element, gsubgraph->content())
   {
-    GraphNode* gnode = dynamic_cast<GraphNode*>(element);
-    if (gnode->canvasNode()==0)
+    if (element->kind() == GraphElement::Node)
     {
-      kDebug() << "Creating canvas node for:" << gnode->id();
-      CanvasNode *cnode = new CanvasNode(q, gnode, m_canvas);
-      if (cnode == 0) continue;
-      cnode->initialize(
-        scaleX, scaleY, m_xMargin, m_yMargin, gh,
-        m_graph->wdhcf(), m_graph->hdvcf());
-      gnode->setCanvasNode(cnode);
-      m_canvas->addItem(cnode);
-      //       cnode->setZValue(gnode->z());
-      cnode->setZValue(zValue+1);
-      cnode->show();
+      displayNode(static_cast<GraphNode*>(element), zValue);
     }
-    gnode->canvasNode()->computeBoundingRect();
   }
   gsubgraph->canvasSubgraph()->computeBoundingRect();
   
@@ -404,6 +445,225 @@ int DotGraphViewPrivate::displaySubgraph(GraphSubgraph* gsubgraph, int zValue, C
   return newZvalue;
 }
 
+double DotGraphViewPrivate::detailScale() const
+{
+  if (m_detailLevel == 0)      return m_graph->scale() * 0.7;
+  else if (m_detailLevel == 2) return m_graph->scale() * 1.3;
+  else                         return m_graph->scale() * 1.0;
+}
+
+QPointF DotGraphViewPrivate::sceneToGraph(const QPointF& point) const
+{
+  double scale = detailScale();
+  return QPointF((point.x() - m_xMargin) / scale, m_graph->height() - (point.y() - m_yMargin) / scale);
+}
+
+QRectF DotGraphViewPrivate::sceneToGraph(const QRectF& rect) const
+{
+  QPolygonF corners;
+  corners << sceneToGraph(rect.topLeft()) << sceneToGraph(rect.bottomRight());
+  return corners.boundingRect();
+}
+
+int DotGraphViewPrivate::elementsCountIn(const QRect& rect)
+{
+  Q_Q(DotGraphView);
+  if (m_graph == 0)
+  {
+    return 0;
+  }
+  return m_graph->elementsIn(sceneToGraph(q->mapToScene(rect).boundingRect())).size();
+}
+
+GraphElement* DotGraphViewPrivate::elementAt(const QPoint& pos)
+{
+  Q_Q(DotGraphView);
+  if (m_graph == 0)
+  {
+    return 0;
+  }
+  QPointF point = sceneToGraph(q->mapToScene(pos));
+  // a few pixels around, not to miss the thin edges
+  qreal tolerance = QLineF(point, sceneToGraph(q->mapToScene(pos + QPoint(3, 0)))).length();
+  return m_graph->elementNearestTo(point, tolerance);
+}
+
+void DotGraphViewPrivate::displayNode(GraphNode* gnode, int zValue)
+{
+  Q_Q(DotGraphView);
+  if (gnode->canvasNode()==0)
+  {
+    kDebug() << "Creating canvas node for" << gnode->id();
+    double scale = detailScale();
+    CanvasNode *cnode = new CanvasNode(q, gnode, m_canvas);
+    cnode->initialize(
+      scale, scale, m_xMargin, m_yMargin, m_graph->height(),
+      m_graph->wdhcf(), m_graph->hdvcf());
+    gnode->setCanvasNode(cnode);
+    m_canvas->addItem(cnode);
+//       cnode->setZValue(gnode->z());
+    cnode->setZValue(zValue+1);
+    cnode->show();
+  }
+  gnode->canvasNode()->computeBoundingRect();
+}
+
+void DotGraphViewPrivate::displayEdge(GraphEdge* gedge, int zValue)
+{
+  Q_Q(DotGraphView);
+  if (gedge->canvasEdge() == 0
+    && gedge->fromNode() != 0
+    && gedge->toNode() != 0)
+  {
+    kDebug() << "New CanvasEdge for" << gedge->id();
+    double scale = detailScale();
+    CanvasEdge* cedge = new CanvasEdge(q, gedge, scale, scale, m_xMargin,
+        m_yMargin, m_graph->height(), m_graph->wdhcf(), m_graph->hdvcf());
+
+    gedge->setCanvasEdge(cedge);
+//     std::cerr << "setting z = " << gedge->z() << std::endl;
+//    cedge->setZValue(gedge->z());
+    cedge->setZValue(zValue+2);
+    cedge->show();
+    m_canvas->addItem(cedge);
+  }
+  if (gedge->canvasEdge() != 0)
+    gedge->canvasEdge()->computeBoundingRect();
+}
+
+void DotGraphViewPrivate::displayGraphLabels()
+{
+  foreach (QGraphicsSimpleTextItem* labelView, m_labelViews)
+  {
+    delete labelView;
+  }
+  m_labelViews.clear();
+  double scaleX = detailScale(), scaleY = scaleX;
+  qreal gh = m_graph->height();
+  kDebug() << "Adding graph render operations: " << m_graph->renderOperations().size();
+  foreach (const DotRenderOp& dro, m_graph->renderOperations())
+  {
+    if ( dro.opcode == DotRenderOp::Text )
+    {
+//       std::cerr << "Adding graph label '"<<dro.str<<"'" << std::endl;
+      const QString& str = dro.str;
+      int stringWidthGoal = int(dro.integers[3] * scaleX);
+      int fontSize = m_graph->fontSize();
+      QFont* font = FontsCache::changeable().fromName(m_graph->fontName());
+      font->setPointSize(fontSize);
+      QFontMetrics fm(*font);
+      while (fm.width(str) > stringWidthGoal && fontSize > 1)
+      {
+        fontSize--;
+        font->setPointSize(fontSize);
+        fm = QFontMetrics(*font);
+      }
+      QGraphicsSimpleTextItem* labelView = new QGraphicsSimpleTextItem(str, 0, m_canvas);
+      labelView->setFont(*font);
+      labelView->setPos(
+                  (scaleX *
+                       (
+                         (dro.integers[0])
+                         + (((dro.integers[2])*(dro.integers[3]))/2)
+                         - ( (dro.integers[3])/2 )
+                       )
+                      + m_xMargin ),
+                      ((gh - (dro.integers[1]))*scaleY)+ m_yMargin);
+      /// @todo port that ; how to set text color ?
+      labelView->setPen(QPen(Dot2QtConsts::componentData().qtColor(m_graph->fontColor())));
+      labelView->setFont(*font);
+      m_labelViews.insert(labelView);
+    }
+  }
+}
+
+void DotGraphViewPrivate::displayLayoutChanges(const GraphChangeSet& changes)
+{
+  Q_Q(DotGraphView);
+  kDebug() << changes.added.size() << "added," << changes.moved.size() << "moved,"
+      << changes.restyled.size() << "restyled," << changes.removed.size() << "removed";
+  q->viewport()->setUpdatesEnabled(false);
+  if (m_graph->backColor().size() != 0)
+  {
+    q->setBackgroundColor(QColor(m_graph->backColor()));
+  }
+  // the new edges can be bound to new nodes
+  foreach (GraphElement* element, changes.added)
+  {
+    if (element->kind() == GraphElement::Node)
+    {
+      displayNode(static_cast<GraphNode*>(element), m_elementsZValue);
+    }
+  }
+  foreach (GraphElement* element, changes.added)
+  {
+    if (element->kind() == GraphElement::Edge)
+    {
+      displayEdge(static_cast<GraphEdge*>(element), m_elementsZValue);
+    }
+  }
+  foreach (GraphElement* element, changes.moved)
+  {
+    if (element->kind() == GraphElement::Edge)
+    {
+      GraphEdge* gedge = static_cast<GraphEdge*>(element);
+      if (gedge->canvasEdge() != 0)
+      {
+        gedge->canvasEdge()->modelChanged();
+      }
+    }
+    else if (element->canvasElement() != 0)
+    {
+      element->canvasElement()->modelChanged();
+    }
+  }
+  foreach (GraphElement* element, changes.restyled)
+  {
+    if (element->kind() == GraphElement::Edge)
+    {
+      GraphEdge* gedge = static_cast<GraphEdge*>(element);
+      // the edges read their style when painted
+      if (gedge->canvasEdge() != 0)
+      {
+        gedge->canvasEdge()->update();
+      }
+    }
+    else if (element->canvasElement() != 0)
+    {
+      element->canvasElement()->modelChanged();
+    }
+  }
+  displayGraphLabels();
+  updateSizes();
+  q->viewport()->setUpdatesEnabled(true);
+  foreach (QGraphicsSimpleTextItem* labelView, m_labelViews)
+  {
+    labelView->show();
+  }
+  m_canvas->update();
+}
+
+void DotGraphViewPrivate::forgetCanvasItems()
+{
+  foreach (GraphNode* gnode, m_graph->nodes())
+  {
+    gnode->setCanvasNode(0);
+  }
+  foreach (GraphEdge* gedge, m_graph->edges())
+  {
+    gedge->setCanvasEdge(0);
+  }
+  foreach (GraphSubgraph* gsubgraph, m_graph->subgraphs())
+  {
+    gsubgraph->setCanvasSubgraph(0);
+    foreach (GraphElement* element, gsubgraph->content())
+    {
+      element->setCanvasElement(0);
+    }
+  }
+  m_labelViews.clear();
+}
+
 void DotGraphViewPrivate::setupPopup()
 {
   Q_Q(DotGraphView);
@@ -680,7 +940,8 @@ DotGraphView::DotGraphView(KActionCollection* actions, QWidget* parent) :
   setRenderHint(QPainter::Antialiasing);
 
   connect(&d->m_loadThread, SIGNAL(finished()), this, SLOT(slotAGraphReadFinished()));
-  connect(&d->m_layoutThread, SIGNAL(finished()), this, SLOT(slotAGraphLayoutFinished()));
+  connect(&d->m_layoutProcess, SIGNAL(finished()), this, SLOT(slotAGraphLayoutFinished()));
+  connect(&d->m_layoutProcess, SIGNAL(failed()), this, SLOT(slotAGraphLayoutFailed()));
 }
 
 DotGraphView::~DotGraphView()
@@ -719,6 +980,50 @@ void DotGraphView::setBackgroundColor(const QColor& color)
   d->m_canvas->setBackgroundBrush(QBrush(d->m_backgroundColor));
 }
 
+QString DotGraphView::layoutCacheReport() const
+{
+  return LayoutCache::changeable().report();
+}
+
+GraphMemoryUsage DotGraphView::memoryUsage() const
+{
+  Q_D(const DotGraphView);
+  GraphMemoryUsage usage = d->m_graph != 0 ? d->m_graph->memoryUsage() : GraphMemoryUsage();
+  if (d->m_canvas != 0)
+  {
+    QList<QGraphicsItem*> items = d->m_canvas->items();
+    foreach (QGraphicsItem* item, items)
+    {
+      if (CanvasElement* element = dynamic_cast<CanvasElement*>(item))
+      {
+        element->addMemoryUsage(usage);
+      }
+      else if (CanvasEdge* edge = dynamic_cast<CanvasEdge*>(item))
+      {
+        edge->addMemoryUsage(usage);
+      }
+      else if (QGraphicsSimpleTextItem* label = dynamic_cast<QGraphicsSimpleTextItem*>(item))
+      {
+        usage.add(GraphMemoryUsage::CanvasItems, sizeof(QGraphicsSimpleTextItem));
+        usage.addString(GraphMemoryUsage::CanvasItems, label->text());
+      }
+    }
+    // the depth chosen by the scene when it is not set, and its leaves lists
+    int depth = d->m_canvas->bspTreeDepth();
+    if (depth == 0)
+    {
+      depth = qMax(int(log(double(qMax(items.size(), 1))) / log(2.0)), 5);
+    }
+    usage.add(GraphMemoryUsage::SceneIndex,
+              (qint64(1) << depth) * (sizeof(QList<QGraphicsItem*>) + 4 * sizeof(qreal))
+              + items.size() * sizeof(QGraphicsItem*));
+  }
+  const FontsCache& fonts = FontsCache::single();
+  usage.addContainerEntries(GraphMemoryUsage::Caches, fonts.size(), sizeof(QString) + sizeof(QFont*));
+  usage.add(GraphMemoryUsage::Caches, fonts.size() * sizeof(QFont));
+  return usage;
+}
+
 bool DotGraphView::initEmpty()
 {
   kDebug();
@@ -736,6 +1041,11 @@ bool DotGraphView::initEmpty()
     delete d->m_graph;
   d->m_graph = new DotGraph();
   connect(d->m_graph,SIGNAL(readyToDisplay()),this,SLOT(displayGraph()));
+  connect(d->m_graph,SIGNAL(elementsChanged()),this,SLOT(slotGraphElementsChanged()));
+  d->m_graphDisplayed = false;
+  // deleted with the former canvas
+  d->m_labelViews.clear();
+  d->m_loadingLabel = 0;
 
   if (d->m_readWrite)
   {
@@ -783,9 +1093,15 @@ bool DotGraphView::slotLoadLibrary(graph_t* graph)
 
   kDebug() << "layoutCommand:" << layoutCommand;
   d->m_graph = new DotGraph(layoutCommand,"");
+  d->m_graph->setDeferRenderOperations(KGraphViewerPartSettings::deferRenderOperations());
   d->m_graph->setUseLibrary(true);
 
   connect(d->m_graph,SIGNAL(readyToDisplay()),this,SLOT(displayGraph()));
+  connect(d->m_graph,SIGNAL(elementsChanged()),this,SLOT(slotGraphElementsChanged()));
+  d->m_graphDisplayed = false;
+  // deleted with the former canvas
+  d->m_labelViews.clear();
+  d->m_loadingLabel = 0;
   connect(this, SIGNAL(removeEdge(const QString&)), d->m_graph, SLOT(removeEdge(const QString&)));
   connect(this, SIGNAL(removeNodeNamed(const QString&)), d->m_graph, SLOT(removeNodeNamed(const QString&)));
   connect(this, SIGNAL(removeElement(const QString&)), d->m_graph, SLOT(removeElement(const QString&)));
@@ -843,7 +1159,18 @@ bool DotGraphView::loadDot(const QString& dotFileName)
   if (d->m_graph != 0)
     delete d->m_graph;
   d->m_graph = new DotGraph(layoutCommand,dotFileName);
+  d->m_graph->setParserEngine(KGraphViewerPartSettings::parserEngine() == "spirit"
+                              ? DotGraph::SpiritParser : DotGraph::HandWrittenParser);
+  d->m_graph->setDeferRenderOperations(KGraphViewerPartSettings::deferRenderOperations());
+  d->m_graph->setLayoutTimeout(KGraphViewerPartSettings::layoutTimeout() * 1000);
+  LayoutCache::changeable().setMaxSize(qint64(KGraphViewerPartSettings::layoutCacheSize()) * 1024 * 1024);
   connect(d->m_graph,SIGNAL(readyToDisplay()),this,SLOT(displayGraph()));
+  connect(d->m_graph,SIGNAL(elementsChanged()),this,SLOT(slotGraphElementsChanged()));
+  connect(d->m_graph,SIGNAL(layoutProgress(qint64,int)),this,SLOT(slotLayoutProgress(qint64,int)));
+  d->m_graphDisplayed = false;
+  // deleted with the former canvas
+  d->m_labelViews.clear();
+  d->m_loadingLabel = 0;
 
   if (d->m_readWrite)
   {
@@ -872,6 +1199,7 @@ bool DotGraphView::loadDot(const QString& dotFileName)
   QGraphicsSimpleTextItem* loadingLabel = newCanvas->addSimpleText(i18n("graph %1 is getting loaded...", dotFileName));
   loadingLabel->setZValue(100);
   centerOn(loadingLabel);
+  d->m_loadingLabel = loadingLabel;
 
   d->m_cvZoom = 0;
 
@@ -888,17 +1216,68 @@ bool DotGraphView::loadLibrary(const QString& dotFileName)
 {
   kDebug() << "'" << dotFileName << "'";
   Q_D(DotGraphView);
+  // a layout with a former file or algorithm is useless now
+  d->m_layoutProcess.cancel();
+  d->cancelLibraryCacheLookup();
+  // the file still being read is discarded
+  d->m_libraryLoadPending = false;
+
+  QString layoutCommand = (d->m_graph!=0?d->m_graph->layoutCommand():"");
+  if (layoutCommand.isEmpty())
+    layoutCommand = DotGraph::chooseLayoutProgramForFile(dotFileName);
+  if (layoutCommand.isEmpty())
+    layoutCommand = "dot";
+  LayoutCache::changeable().setMaxSize(qint64(KGraphViewerPartSettings::layoutCacheSize()) * 1024 * 1024);
+
   if (d->m_canvas)
     d->m_canvas->clear();
   QGraphicsSimpleTextItem* loadingLabel = d->m_canvas->addSimpleText(i18n("graph %1 is getting loaded...", dotFileName));
   loadingLabel->setZValue(100);
   centerOn(loadingLabel);
+  d->m_loadingLabel = loadingLabel;
 
-  d->m_loadThread.loadFile(dotFileName);
-  
+  d->m_libraryFileName = dotFileName;
+  d->m_libraryLayoutCommand = layoutCommand;
+  d->m_libraryCacheKey.clear();
+  if (LayoutCache::single().isEnabled())
+  {
+    // the file is hashed and the layout read in a worker thread
+    d->m_libraryCacheLookup = new LayoutCacheLookup(dotFileName, layoutCommand, QStringList() << "library",
+                                                    this, LayoutCacheLookup::ReadGraph);
+    connect(d->m_libraryCacheLookup, SIGNAL(done()), this, SLOT(slotLibraryCacheLookupDone()));
+    return true;
+  }
+  d->readLibraryFile();
   return true;
 }
 
+void DotGraphView::slotLibraryCacheLookupDone()
+{
+  Q_D(DotGraphView);
+  LayoutCacheLookup* lookup = d->m_libraryCacheLookup;
+  d->m_libraryCacheLookup = 0;
+  lookup->deleteLater();
+  d->m_libraryCacheKey = lookup->key();
+  // read by the lookup in its worker thread
+  graph_t* cachedGraph = lookup->takeGraph();
+  if (cachedGraph == 0)
+  {
+    if (!lookup->takeLayout().isEmpty())
+    {
+      kError() << "reading the cached layout failed: laying the graph out again";
+      LayoutCache::changeable().remove(d->m_libraryCacheKey);
+    }
+    d->readLibraryFile();
+    return;
+  }
+  kDebug() << "layout found in the cache";
+  QString dotFileName = d->m_libraryFileName;
+  d->m_libraryFileName.clear();
+  if (loadLibrary(cachedGraph, d->m_libraryLayoutCommand))
+    d->m_graph->dotFileName(dotFileName);
+  agclose(cachedGraph);
+}
+
 bool DotGraphView::loadLibrary(graph_t* graph, const QString& layoutCommand)
 {
   kDebug() << "graph_t";
@@ -916,9 +1295,15 @@ bool DotGraphView::loadLibrary(graph_t* graph, const QString& layoutCommand)
 
   kDebug() << "layoutCommand:" << layoutCommand;
   d->m_graph = new DotGraph(layoutCommand,"");
+  d->m_graph->setDeferRenderOperations(KGraphViewerPartSettings::deferRenderOperations());
   d->m_graph->setUseLibrary(true);
   
   connect(d->m_graph,SIGNAL(readyToDisplay()),this,SLOT(displayGraph()));
+  connect(d->m_graph,SIGNAL(elementsChanged()),this,SLOT(slotGraphElementsChanged()));
+  d->m_graphDisplayed = false;
+  // deleted with the former canvas
+  d->m_labelViews.clear();
+  d->m_loadingLabel = 0;
   
   if (d->m_readWrite)
   {
@@ -952,6 +1337,27 @@ bool DotGraphView::displayGraph()
 {
   Q_D(DotGraphView);
   kDebug() << d->m_graph->backColor();
+  GraphChangeSet changes = d->m_graph->takeLayoutChanges();
+  if (d->m_graphDisplayed)
+  {
+    bool subgraphAdded = false;
+    foreach (GraphElement* element, changes.added)
+    {
+      if (element->kind() == GraphElement::Subgraph)
+      {
+        subgraphAdded = true;
+        break;
+      }
+    }
+    if (!subgraphAdded)
+    {
+      d->displayLayoutChanges(changes);
+      emit graphLoaded();
+      return true;
+    }
+    // the subgraphs are stacked in the order of the whole graph
+    d->forgetCanvasItems();
+  }
 //   hide();
   viewport()->setUpdatesEnabled(false);
 
@@ -960,20 +1366,13 @@ bool DotGraphView::displayGraph()
     setBackgroundColor(QColor(d->m_graph->backColor()));
   }
   d->m_canvas->clear();
+  d->m_loadingLabel = 0;
 
   if (d->m_graph->nodes().size() > KGV_MAX_PANNER_NODES)
   {
     d->m_birdEyeView->setDrawingEnabled(false);
   }
   //  QCanvasEllipse* eItem;
-  double scaleX = 1.0, scaleY = 1.0;
-
-  if (d->m_detailLevel == 0)      { scaleX = d->m_graph->scale() * 0.7; scaleY = d->m_graph->scale() * 0.7; }
-  else if (d->m_detailLevel == 1) { scaleX = d->m_graph->scale() * 1.0; scaleY = d->m_graph->scale() * 1.0; }
-  else if (d->m_detailLevel == 2) { scaleX = d->m_graph->scale() * 1.3; scaleY = d->m_graph->scale() * 1.3; }
-  else                        { scaleX = d->m_graph->scale() * 1.0; scaleY = d->m_graph->scale() * 1.0; }
-
-  qreal gh = d->m_graph->height();
 
   d->m_xMargin = 50;
   d->m_yMargin = 50;
@@ -995,92 +1394,18 @@ bool DotGraphView::displayGraph()
   }
 
   kDebug() << "Creating" << d->m_graph->nodes().size() << "nodes from" << d->m_graph;
-  GraphNodeMap::const_iterator it = d->m_graph->nodes().constBegin();
-  for (; it != d->m_graph->nodes().constEnd();it++)
-  {
-    const QString& id = it.key();
-    GraphNode* gnode = it.value();
-    kDebug() << "Handling" << id << (void*)gnode;
-    kDebug() << "  gnode id=" << gnode->id();
-    kDebug()<<  "  canvasNode=" << (void*)gnode->canvasNode();
-    if (gnode->canvasNode()==0)
-    {
-      kDebug() << "Creating canvas node for" << gnode->id();
-      CanvasNode *cnode = new CanvasNode(this, gnode, d->m_canvas);
-      if (cnode == 0) continue;
-      cnode->initialize(
-        scaleX, scaleY, d->m_xMargin, d->m_yMargin, gh,
-        d->m_graph->wdhcf(), d->m_graph->hdvcf());
-      gnode->setCanvasNode(cnode);
-      d->m_canvas->addItem(cnode);
-//       cnode->setZValue(gnode->z());
-      cnode->setZValue(zvalue+1);
-      cnode->show();
-    }
-    gnode->canvasNode()->computeBoundingRect();
+  d->m_elementsZValue = zvalue;
+  foreach (GraphNode* gnode, d->m_graph->nodes())
+  {
+    d->displayNode(gnode, zvalue);
   }
 
   kDebug() << "Creating" << d->m_graph->edges().size() << "edges from" << d->m_graph;
   foreach (GraphEdge* gedge, d->m_graph->edges())
   {
-    kDebug() << "One GraphEdge:" << gedge->id();
-    if (gedge->canvasEdge() == 0
-      && gedge->fromNode() != 0
-      && gedge->toNode() != 0)
-    {
-      kDebug() << "New CanvasEdge for" << gedge->id();
-      kDebug() << "edge fromNode=" << (void*)gedge->fromNode();
-      kDebug() << "              "<< gedge->fromNode()->id();
-      kDebug() << "edge toNode=" << (void*)gedge->toNode();
-      kDebug() << "              "<< gedge->toNode()->id();
-      CanvasEdge* cedge = new CanvasEdge(this, gedge, scaleX, scaleY, d->m_xMargin,
-          d->m_yMargin, gh, d->m_graph->wdhcf(), d->m_graph->hdvcf());
-
-      gedge->setCanvasEdge(cedge);
-  //     std::cerr << "setting z = " << gedge->z() << std::endl;
-  //    cedge->setZValue(gedge->z());
-      cedge->setZValue(zvalue+2);
-      cedge->show();
-      d->m_canvas->addItem(cedge);
-    }
-    if (gedge->canvasEdge() != 0)
-      gedge->canvasEdge()->computeBoundingRect();
-  }
-  kDebug() << "Adding graph render operations: " << d->m_graph->renderOperations().size();
-  foreach (const DotRenderOp& dro, d->m_graph->renderOperations())
-  {
-    if ( dro.renderop == "T" )
-    {
-//       std::cerr << "Adding graph label '"<<dro.str<<"'" << std::endl;
-      const QString& str = dro.str;
-      int stringWidthGoal = int(dro.integers[3] * scaleX);
-      int fontSize = d->m_graph->fontSize();
-      QFont* font = FontsCache::changeable().fromName(d->m_graph->fontName());
-      font->setPointSize(fontSize);
-      QFontMetrics fm(*font);
-      while (fm.width(str) > stringWidthGoal && fontSize > 1)
-      {
-        fontSize--;
-        font->setPointSize(fontSize);
-        fm = QFontMetrics(*font);
-      }
-      QGraphicsSimpleTextItem* labelView = new QGraphicsSimpleTextItem(str, 0, d->m_canvas);
-      labelView->setFont(*font);
-      labelView->setPos(
-                  (scaleX *
-                       (
-                         (dro.integers[0])
-                         + (((dro.integers[2])*(dro.integers[3]))/2)
-                         - ( (dro.integers[3])/2 )
-                       )
-                      + d->m_xMargin ),
-                      ((gh - (dro.integers[1]))*scaleY)+ d->m_yMargin);
-      /// @todo port that ; how to set text color ?
-      labelView->setPen(QPen(Dot2QtConsts::componentData().qtColor(d->m_graph->fontColor())));
-      labelView->setFont(*font);
-      d->m_labelViews.insert(labelView);
-    }
+    d->displayEdge(gedge, zvalue);
   }
+  d->displayGraphLabels();
 
   kDebug() << "Finalizing";
   d->m_cvZoom = 0;
@@ -1089,14 +1414,13 @@ bool DotGraphView::displayGraph()
   centerOn(d->m_canvas->sceneRect().center());
 
   viewport()->setUpdatesEnabled(true);
-  QSet<QGraphicsSimpleTextItem*>::iterator labelViewsIt, labelViewsIt_end;
-  labelViewsIt = d->m_labelViews.begin(); labelViewsIt_end = d->m_labelViews.end();
-  for (; labelViewsIt != labelViewsIt_end; labelViewsIt++)
+  foreach (QGraphicsSimpleTextItem* labelView, d->m_labelViews)
   {
-    (*labelViewsIt)->show();
+    labelView->show();
   }
   d->m_canvas->update();
-  
+  d->m_graphDisplayed = true;
+
   emit graphLoaded();
 
   return true;
@@ -1142,6 +1466,8 @@ void DotGraphView::keyPressEvent(QKeyEvent* e)
     scrollContentsBy(0,viewport()->height()/10);
   else if (e->key() == Qt::Key_Up)
     scrollContentsBy(0,-viewport()->height()/10);
+  else if (e->key() == Qt::Key_Escape && d->isLayoutRunning())
+    cancelLayout();
   else 
   {
     e->ignore();
@@ -1301,7 +1627,7 @@ void DotGraphView::mousePressEvent(QMouseEvent* e)
     QPointF pos = mapToScene(
         e->pos().x()-d->m_defaultNewElementPixmap.width()/2,
         e->pos().y()-d->m_defaultNewElementPixmap.height()/2);
-    GraphNode* newNode = new GraphNode();
+    GraphNode* newNode = d->m_graph->createNode();
     newNode->attributes() = d->m_newElementAttributes;
     if (newNode->attributes().find("id") == newNode->attributes().end())
     {
@@ -1312,6 +1638,7 @@ void DotGraphView::mousePressEvent(QMouseEvent* e)
       newNode->setLabel(newNode->id());
     }
     d->m_graph->nodes().insert(newNode->id(), newNode);
+    d->m_graph->indexElement(newNode->id(), newNode);
     CanvasNode* newCNode = new CanvasNode(this, newNode, d->m_canvas);
     newCNode->initialize(
       scaleX, scaleY, d->m_xMargin, d->m_yMargin, gh,
@@ -1333,7 +1660,7 @@ void DotGraphView::mousePressEvent(QMouseEvent* e)
   }
   else
   {
-    if (d->m_editingMode != None && itemAt(e->pos()) == 0) // click outside any item: unselect all
+    if (d->m_editingMode != None && d->elementAt(e->pos()) == 0) // click outside any item: unselect all
     {
       if (d->m_editingMode == DrawNewEdge) // was drawing an edge; cancel it
       {
@@ -1626,18 +1953,90 @@ void DotGraphView::dirty(const QString& dotFileName)
 //   std::cerr << "SLOT dirty for " << dotFileName << std::endl;
   if (dotFileName == d->m_graph->dotFileName())
   {
-    if (KMessageBox::questionYesNo(this, 
-                                i18n("The file %1 has been modified on disk.\nDo you want to reload it?",dotFileName),
-                                i18n("Reload Confirmation"),
-                                KStandardGuiItem::yes(),
-                                KStandardGuiItem::no(),
-                                "reloadOnChangeMode"   ) == KMessageBox::Yes)
+    d->m_changedFileName = dotFileName;
+    if (d->m_reloadTimer != std::numeric_limits<int>::max())
     {
-      if (d->m_graph->useLibrary())
-        loadLibrary(dotFileName);
-      else
-        loadDot(dotFileName);
+      killTimer(d->m_reloadTimer);
     }
+    d->m_reloadTimer = startTimer(300);
+  }
+}
+
+void DotGraphView::reloadChangedFile()
+{
+  Q_D(DotGraphView);
+  QString dotFileName = d->m_changedFileName;
+  if (d->m_askingReload || dotFileName != d->m_graph->dotFileName())
+  {
+    return;
+  }
+  d->m_askingReload = true;
+  if (KMessageBox::questionYesNo(this, 
+                              i18n("The file %1 has been modified on disk.\nDo you want to reload it?",dotFileName),
+                              i18n("Reload Confirmation"),
+                              KStandardGuiItem::yes(),
+                              KStandardGuiItem::no(),
+                              "reloadOnChangeMode"   ) == KMessageBox::Yes)
+  {
+    if (d->m_graph->useLibrary())
+      loadLibrary(dotFileName);
+    else
+      loadDot(dotFileName);
+  }
+  d->m_askingReload = false;
+}
+
+void DotGraphViewPrivate::readLibraryFile()
+{
+  if (m_loadThread.isRunning())
+  {
+    // loaded once the current file is read
+    m_libraryLoadPending = true;
+    return;
+  }
+  m_loadThread.loadFile(m_libraryFileName);
+}
+
+void DotGraphViewPrivate::cancelLibraryCacheLookup()
+{
+  if (m_libraryCacheLookup != 0)
+  {
+    m_libraryCacheLookup->disconnect(q_ptr);
+    m_libraryCacheLookup->deleteLater();
+    m_libraryCacheLookup = 0;
+  }
+}
+
+bool DotGraphViewPrivate::isLayoutRunning() const
+{
+  return m_loadThread.isRunning() || m_layoutProcess.isRunning() || m_libraryCacheLookup != 0
+      || (m_graph != 0 && m_graph->isLayoutRunning());
+}
+
+void DotGraphView::cancelLayout()
+{
+  Q_D(DotGraphView);
+  if (!d->isLayoutRunning())
+  {
+    return;
+  }
+  QString fileName = d->m_libraryFileName;
+  d->m_layoutProcess.cancel();
+  d->cancelLibraryCacheLookup();
+  // the file being read is discarded
+  d->m_libraryLoadPending = false;
+  d->m_libraryFileName.clear();
+  if (d->m_graph != 0)
+  {
+    if (!d->m_graph->useLibrary())
+    {
+      fileName = d->m_graph->dotFileName();
+    }
+    d->m_graph->cancelLayout();
+  }
+  if (d->m_loadingLabel != 0)
+  {
+    d->m_loadingLabel->setText(i18n("layout of graph %1 cancelled", fileName));
   }
 }
 
@@ -2166,6 +2565,13 @@ void DotGraphView::timerEvent ( QTimerEvent * event )
 {
   Q_D(DotGraphView);
   kDebug() << event->timerId();
+  if (event->timerId() == d->m_reloadTimer)
+  {
+    killTimer(d->m_reloadTimer);
+    d->m_reloadTimer = std::numeric_limits<int>::max();
+    reloadChangedFile();
+    return;
+  }
   qreal vpercent = verticalScrollBar()->value()*1.0/100;
   qreal hpercent = horizontalScrollBar()->value()*1.0/100;
   if (d->m_scrollDirection == Left)
@@ -2226,32 +2632,101 @@ void DotGraphView::enterEvent ( QEvent * /*event*/ )
 void DotGraphView::slotAGraphReadFinished()
 {
   Q_D(DotGraphView);
-  QString layoutCommand = (d->m_graph!=0?d->m_graph->layoutCommand():"");
-  if (layoutCommand.isEmpty())
+  if (d->m_libraryLoadPending || d->m_libraryFileName.isEmpty() || d->m_libraryCacheLookup != 0)
   {
-    if (!d->m_loadThread.dotFileName().isEmpty())
-      layoutCommand = d->m_graph->chooseLayoutProgramForFile(d->m_loadThread.dotFileName());
-    else
-      layoutCommand = "dot";
+    // superseded by a newer request or cancelled
+    if (d->m_loadThread.g() != 0)
+    {
+      agclose(d->m_loadThread.g());
+    }
+    if (d->m_libraryLoadPending)
+    {
+      d->m_libraryLoadPending = false;
+      d->m_loadThread.loadFile(d->m_libraryFileName);
+    }
+    return;
   }
-  d->m_layoutThread.layoutGraph(d->m_loadThread.g(), layoutCommand);
+  if (d->m_loadThread.g() == 0)
+  {
+    if (d->m_loadingLabel != 0)
+    {
+      d->m_loadingLabel->setText(i18n("error parsing file %1", d->m_loadThread.dotFileName()));
+    }
+    return;
+  }
+  d->m_layoutProcess.layoutGraph(d->m_loadThread.g(), d->m_libraryLayoutCommand);
 }
 
 void DotGraphView::slotAGraphLayoutFinished()
 {
   Q_D(DotGraphView);
-  bool result = loadLibrary(d->m_layoutThread.g(), d->m_layoutThread.layoutCommand());
+  graph_t* graph = d->m_layoutProcess.takeResult();
+  LayoutCache::changeable().insert(d->m_libraryCacheKey, d->m_layoutProcess.xdot());
+  bool result = loadLibrary(graph, d->m_layoutProcess.layoutCommand());
   if (result)
     d->m_graph->dotFileName(d->m_loadThread.dotFileName());
 
-  gvFreeLayout(d->m_layoutThread.gvc(), d->m_layoutThread.g());
-  agclose(d->m_layoutThread.g());
+  agclose(graph);
+}
+
+void DotGraphView::slotAGraphLayoutFailed()
+{
+  Q_D(DotGraphView);
+  if (d->m_loadingLabel != 0)
+  {
+    d->m_loadingLabel->setText(i18n("layout of graph %1 failed", d->m_loadThread.dotFileName()));
+  }
+}
+
+void DotGraphView::slotGraphElementsChanged()
+{
+  Q_D(DotGraphView);
+  foreach (GraphElement* element, d->m_graph->takeChangedElements())
+  {
+    if (element->kind() == GraphElement::Edge)
+    {
+      GraphEdge* edge = static_cast<GraphEdge*>(element);
+      if (edge->canvasEdge() != 0)
+      {
+        edge->canvasEdge()->modelChanged();
+      }
+    }
+    else if (element->canvasElement() != 0)
+    {
+      element->canvasElement()->modelChanged();
+      // the edges not laid out yet are drawn between their bounds
+      updateUnlaidEdges(element->outEdges());
+      updateUnlaidEdges(element->inEdges());
+    }
+  }
+}
+
+void DotGraphView::slotLayoutProgress(qint64 bytesRead, int elapsed)
+{
+  Q_D(DotGraphView);
+  if (d->m_loadingLabel != 0)
+  {
+    d->m_loadingLabel->setText(i18n("graph %1 is getting laid out... (%2 s, %3 KB read)",
+                                    d->m_graph->dotFileName(), elapsed / 1000, bytesRead / 1024));
+  }
+  emit layoutProgress(bytesRead, elapsed);
+}
+
+void DotGraphView::updateUnlaidEdges(const QList<GraphEdge*>& edges)
+{
+  foreach (GraphEdge* edge, edges)
+  {
+    if (edge->canvasEdge() != 0 && edge->renderOperations().isEmpty())
+    {
+      edge->canvasEdge()->modelChanged();
+    }
+  }
 }
 
 void DotGraphView::slotSelectNode(const QString& nodeName)
 {
   kDebug() << nodeName;
-  GraphNode* node = dynamic_cast<GraphNode*>(graph()->elementNamed(nodeName));
+  GraphNode* node = graph()->nodeNamed(nodeName);
   if (node == 0) return;
   node->setSelected(true);
   if (node->canvasNode()!=0)
@@ -2263,7 +2738,7 @@ void DotGraphView::slotSelectNode(const QString& nodeName)
 
 void DotGraphView::centerOnNode(const QString& nodeId)
 {
-  GraphNode* node = dynamic_cast<GraphNode*>(graph()->elementNamed(nodeId));
+  GraphNode* node = graph()->nodeNamed(nodeId);
   if (node == 0) return;
   if (node->canvasNode()!=0)
   {
@@ -60,7 +60,9 @@ namespace KGraphViewer
 class GraphElement;
 class CanvasElement;
 class CanvasEdge;
+class GraphEdge;
 class DotGraph;
+class GraphMemoryUsage;
 
 #define DEFAULT_DETAILLEVEL 1
 
@@ -156,6 +158,11 @@ public:
   void contextMenuEvent(QContextMenuEvent*);
 
   void setBackgroundColor(const QColor& color);
+
+  /** The bytes used by the displayed graph, its canvas items and the scene */
+  GraphMemoryUsage memoryUsage() const;
+  /** The statistics of the cache of the layouts, shared by all the views */
+  QString layoutCacheReport() const;
   
 Q_SIGNALS:
   void zoomed(double factor);
@@ -179,6 +186,8 @@ Q_SIGNALS:
   void contextMenuEvent(const QString&, const QPoint&);
   void hoverEnter(const QString&);
   void hoverLeave(const QString&);
+  /** Emitted periodically while the layout program runs, elapsed being in ms */
+  void layoutProgress(qint64 bytesRead, int elapsed);
   
 public Q_SLOTS:
   void zoomIn();
@@ -188,7 +197,13 @@ public Q_SLOTS:
   bool initEmpty();
   bool slotLoadLibrary(graph_t* graph);
   bool reload();
+  /**
+   * Reloads the file, after asking the user, once it stopped changing for a
+   * moment: a burst of changes gives only one reload
+   */
   void dirty(const QString& dotFileName);
+  /** Stops the layout program run pending, keeping the graph displayed */
+  void cancelLayout();
   void pageSetup();
   void print();
   void printPreview();
@@ -237,14 +252,23 @@ protected:
   void enterEvent ( QEvent * event );
   
 private Q_SLOTS:
+  void slotLibraryCacheLookupDone();
   void slotAGraphReadFinished();
   void slotAGraphLayoutFinished();
+  void slotAGraphLayoutFailed();
+  void slotGraphElementsChanged();
+  void slotLayoutProgress(qint64 bytesRead, int elapsed);
   
 protected:
   DotGraphViewPrivate * const d_ptr;
 
 private:
   Q_DECLARE_PRIVATE(DotGraphView);
+
+  /** Updates the canvas items of the edges drawn between their bounds */
+  void updateUnlaidEdges(const QList<GraphEdge*>& edges);
+  /** Asks the user whether to reload the changed file */
+  void reloadChangedFile();
   
 };
 
@@ -0,0 +1,818 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "dotparser.h"
+#include "dotgraph.h"
+#include "DotGraphParsingHelper.h"
+
+#include <kdebug.h>
+
+#include <QByteArray>
+
+#include <string.h>
+
+namespace KGraphViewer
+{
+
+static inline bool isBlank(char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static inline bool isIdentifierChar(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+      || c == '_' || c == '.' || (unsigned char)c >= 0x80;
+}
+
+static inline bool isIdentifier(const DotToken& tok)
+{
+  return tok.type >= DotToken::Identifier && tok.type <= DotToken::Subgraph;
+}
+
+static DotToken::Type keywordType(const char* first, const char* last)
+{
+  switch (last - first)
+  {
+    case 4:
+      if (qstrnicmp(first, "node", 4) == 0) return DotToken::Node;
+      if (qstrnicmp(first, "edge", 4) == 0) return DotToken::Edge;
+      break;
+    case 5:
+      if (qstrnicmp(first, "graph", 5) == 0) return DotToken::Graph;
+      break;
+    case 6:
+      if (qstrnicmp(first, "strict", 6) == 0) return DotToken::Strict;
+      break;
+    case 7:
+      if (qstrnicmp(first, "digraph", 7) == 0) return DotToken::Digraph;
+      break;
+    case 8:
+      if (qstrnicmp(first, "subgraph", 8) == 0) return DotToken::Subgraph;
+      break;
+  }
+  return DotToken::Identifier;
+}
+
+DotLexer::DotLexer() :
+  m_pos(0), m_end(0), m_tokenStart(0), m_atEnd(true)
+{
+}
+
+void DotLexer::setInput(const char* first, const char* last, bool atEnd)
+{
+  m_pos = m_tokenStart = first;
+  m_end = last;
+  m_atEnd = atEnd;
+}
+
+bool DotLexer::skipLine(const char* from)
+{
+  const char* eol = static_cast<const char*>(memchr(from, '\n', m_end - from));
+  if (eol == 0)
+  {
+    if (!m_atEnd) return false;
+    m_pos = m_end;
+    return true;
+  }
+  m_pos = eol + 1;
+  return true;
+}
+
+/**
+ * Skips white spaces and comments. Returns false if the input ends inside a
+ * comment and more input can come.
+ */
+bool DotLexer::skipBlanks()
+{
+  while (m_pos != m_end)
+  {
+    if (isBlank(*m_pos))
+    {
+      ++m_pos;
+    }
+    else if (*m_pos == '#')
+    {
+      if (!skipLine(m_pos)) return false;
+    }
+    else if (*m_pos == '/')
+    {
+      if (m_pos + 1 == m_end)
+      {
+        return m_atEnd;
+      }
+      if (m_pos[1] == '/')
+      {
+        if (!skipLine(m_pos + 2)) return false;
+      }
+      else if (m_pos[1] == '*')
+      {
+        const char* p = m_pos + 2;
+        while (p + 1 < m_end && !(p[0] == '*' && p[1] == '/'))
+        {
+          ++p;
+        }
+        if (p + 1 >= m_end)
+        {
+          // unterminated comment: the '/' is reported as invalid at the end
+          return m_atEnd;
+        }
+        m_pos = p + 2;
+      }
+      else
+      {
+        return true;
+      }
+    }
+    else
+    {
+      return true;
+    }
+  }
+  return true;
+}
+
+DotToken DotLexer::next()
+{
+  DotToken tok;
+  if (!skipBlanks())
+  {
+    tok.type = DotToken::Incomplete;
+    return tok;
+  }
+  m_tokenStart = m_pos;
+  if (m_pos == m_end)
+  {
+    tok.type = m_atEnd ? DotToken::EndOfInput : DotToken::Incomplete;
+    return tok;
+  }
+
+  const char* p = m_pos;
+  tok.first = p;
+  tok.last = p + 1;
+  switch (*p)
+  {
+    case '{': tok.type = DotToken::OpeningBrace; break;
+    case '}': tok.type = DotToken::ClosingBrace; break;
+    case '[': tok.type = DotToken::OpeningBracket; break;
+    case ']': tok.type = DotToken::ClosingBracket; break;
+    case '=': tok.type = DotToken::Equal; break;
+    case ';': tok.type = DotToken::Semicolon; break;
+    case ',': tok.type = DotToken::Comma; break;
+    case ':': tok.type = DotToken::Colon; break;
+    case '"':
+    {
+      // a double quote after an odd number of backslashes is escaped
+      const char* q = p + 1;
+      while ((q = static_cast<const char*>(memchr(q, '"', m_end - q))) != 0)
+      {
+        const char* backslash = q;
+        while (backslash != p + 1 && backslash[-1] == '\\')
+        {
+          --backslash;
+        }
+        if ((q - backslash) % 2 == 0)
+        {
+          break;
+        }
+        ++q;
+      }
+      if (q == 0)
+      {
+        tok.type = m_atEnd ? DotToken::Invalid : DotToken::Incomplete;
+        return tok;
+      }
+      tok.type = DotToken::Identifier;
+      tok.first = p + 1;
+      tok.last = q;
+      m_pos = q + 1;
+      return tok;
+    }
+    case '<':
+    {
+      // HTML-like labels keep their brackets, as in DotGrammar
+      int depth = 0;
+      const char* q = p;
+      for (; q != m_end; ++q)
+      {
+        if (*q == '<')
+        {
+          ++depth;
+        }
+        else if (*q == '>' && --depth == 0)
+        {
+          break;
+        }
+      }
+      if (q == m_end)
+      {
+        tok.type = m_atEnd ? DotToken::Invalid : DotToken::Incomplete;
+        return tok;
+      }
+      tok.type = DotToken::Identifier;
+      tok.last = q + 1;
+      m_pos = q + 1;
+      return tok;
+    }
+    case '-':
+      if (p + 1 == m_end)
+      {
+        tok.type = m_atEnd ? DotToken::Invalid : DotToken::Incomplete;
+        return tok;
+      }
+      if (p[1] == '>' || p[1] == '-')
+      {
+        tok.type = DotToken::EdgeOp;
+        tok.last = p + 2;
+        m_pos = p + 2;
+        return tok;
+      }
+      if ((p[1] >= '0' && p[1] <= '9') || p[1] == '.')
+      {
+        // a negative numeral
+        ++p;
+      }
+      else
+      {
+        tok.type = DotToken::Invalid;
+        return tok;
+      }
+      // fall through
+    default:
+      if (!isIdentifierChar(*p))
+      {
+        tok.type = DotToken::Invalid;
+        return tok;
+      }
+      while (p != m_end && isIdentifierChar(*p))
+      {
+        ++p;
+      }
+      if (p == m_end && !m_atEnd)
+      {
+        tok.type = DotToken::Incomplete;
+        return tok;
+      }
+      tok.type = keywordType(tok.first, p);
+      tok.last = p;
+      m_pos = p;
+      return tok;
+  }
+  m_pos = tok.last;
+  return tok;
+}
+
+
+DotParser::DotParser(DotGraphParsingHelper* helper) :
+  m_helper(helper),
+  m_lexer(),
+  m_input(0),
+  m_inputOffset(0),
+  m_state(Header),
+  m_scopes(0),
+  m_afterSubgraph(false),
+  m_attributes(),
+  m_bounds(),
+  m_buffer(),
+  m_pendingBackslash(false),
+  m_failed(false)
+{
+}
+
+bool DotParser::parse(const char* first, const char* last)
+{
+  return parseBuffer(first, last, true) && parseEnd();
+}
+
+bool DotParser::feed(const char* data, int size)
+{
+  if (m_failed)
+  {
+    return false;
+  }
+  const char* end = data + size;
+  if (m_pendingBackslash && data != end)
+  {
+    m_pendingBackslash = false;
+    if (*data == '\n')
+    {
+      ++data;
+    }
+    else
+    {
+      m_buffer.append('\\');
+    }
+  }
+  while (data != end)
+  {
+    const char* backslash = static_cast<const char*>(memchr(data, '\\', end - data));
+    if (backslash == 0)
+    {
+      m_buffer.append(data, end - data);
+      break;
+    }
+    m_buffer.append(data, backslash - data);
+    if (backslash + 1 == end)
+    {
+      // the newline it may escape is in the next chunk
+      m_pendingBackslash = true;
+      break;
+    }
+    if (backslash[1] == '\n')
+    {
+      data = backslash + 2;
+    }
+    else
+    {
+      m_buffer.append('\\');
+      data = backslash + 1;
+    }
+  }
+  return parseBuffer(m_buffer.constData(), m_buffer.constData() + m_buffer.size(), false);
+}
+
+bool DotParser::finish()
+{
+  if (m_pendingBackslash)
+  {
+    m_buffer.append('\\');
+    m_pendingBackslash = false;
+  }
+  if (m_failed)
+  {
+    return false;
+  }
+  return parseBuffer(m_buffer.constData(), m_buffer.constData() + m_buffer.size(), true)
+      && parseEnd();
+}
+
+/**
+ * Runs the statements read from [first, last). When more input can follow,
+ * the input of the statement left incomplete is kept in m_buffer.
+ */
+bool DotParser::parseBuffer(const char* first, const char* last, bool atEnd)
+{
+  m_input = first;
+  m_lexer.setInput(first, last, atEnd);
+  while (m_state != Finished)
+  {
+    Result result = parseUnit();
+    if (result == Error)
+    {
+      m_failed = true;
+      return false;
+    }
+    if (result == NeedMore)
+    {
+      break;
+    }
+  }
+  if (!atEnd)
+  {
+    int consumed = m_lexer.position() - first;
+    m_buffer.remove(0, consumed);
+    m_inputOffset += consumed;
+  }
+  return true;
+}
+
+/** Checks that nothing but blanks follow the graph */
+bool DotParser::parseEnd()
+{
+  DotToken tok = m_lexer.next();
+  if (tok.type != DotToken::EndOfInput)
+  {
+    unexpected(tok);
+    m_failed = true;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Reads the next statement and runs its actions. If the input stops in the
+ * middle of the statement, nothing is done and the lexer is put back at the
+ * start of the statement.
+ */
+DotParser::Result DotParser::parseUnit()
+{
+  const char* start = m_lexer.position();
+  bool afterSubgraph = m_afterSubgraph;
+  Result result = (m_state == Header) ? parseHeader() : parseStatement();
+  if (result == NeedMore)
+  {
+    m_lexer.setPosition(start);
+    m_afterSubgraph = afterSubgraph;
+  }
+  return result;
+}
+
+DotParser::Result DotParser::unexpected(const DotToken& tok)
+{
+  if (tok.type == DotToken::Incomplete)
+  {
+    return NeedMore;
+  }
+  if (tok.type == DotToken::EndOfInput)
+  {
+    kError() << "Unexpected end of dot input";
+  }
+  else
+  {
+    kError() << "Unexpected token at offset" << (m_inputOffset + (tok.first - m_input)) << ":"
+        << QByteArray(tok.first, qMin(int(tok.last - tok.first), 40));
+  }
+  return Error;
+}
+
+DotParser::Result DotParser::parseHeader()
+{
+  DotToken tok = m_lexer.next();
+  bool isStrict = (tok.type == DotToken::Strict);
+  if (isStrict)
+  {
+    tok = m_lexer.next();
+  }
+  if (tok.type != DotToken::Graph && tok.type != DotToken::Digraph)
+  {
+    return unexpected(tok);
+  }
+  bool isDirected = (tok.type == DotToken::Digraph);
+  DotToken id;
+  tok = m_lexer.next();
+  if (isIdentifier(tok))
+  {
+    id = tok;
+    tok = m_lexer.next();
+  }
+  if (tok.type != DotToken::OpeningBrace)
+  {
+    return unexpected(tok);
+  }
+
+  m_helper->graph->strict(isStrict);
+  m_helper->graph->directed(isDirected);
+  if (id.type != DotToken::Invalid)
+  {
+    m_helper->graph->setId(QString::fromUtf8(id.first, id.last - id.first));
+  }
+  m_state = Body;
+  return Done;
+}
+
+DotParser::Result DotParser::parseStatement()
+{
+  bool afterSubgraph = m_afterSubgraph;
+  m_afterSubgraph = false;
+
+  DotToken tok = m_lexer.next();
+  switch (tok.type)
+  {
+    case DotToken::Semicolon:
+      return Done;
+    case DotToken::ClosingBrace:
+      closeScope();
+      return Done;
+    case DotToken::OpeningBrace:
+      openScope(DotToken());
+      return Done;
+    case DotToken::Subgraph:
+      return parseSubgraph();
+    case DotToken::Graph:
+    case DotToken::Node:
+    case DotToken::Edge:
+      return parseAttributeStatement(tok.type);
+    case DotToken::Identifier:
+      return parseNodeOrEdgeStatement(tok);
+    case DotToken::EdgeOp:
+      // edges from a subgraph: as in DotGrammar, the subgraph itself is
+      // not an edge bound
+      if (afterSubgraph)
+      {
+        return parseEdgeStatement(DotToken(), tok);
+      }
+      return unexpected(tok);
+    default:
+      return unexpected(tok);
+  }
+}
+
+DotParser::Result DotParser::parseSubgraph()
+{
+  DotToken id;
+  DotToken tok = m_lexer.next();
+  if (isIdentifier(tok))
+  {
+    id = tok;
+    tok = m_lexer.next();
+  }
+  if (tok.type == DotToken::OpeningBrace)
+  {
+    openScope(id);
+    return Done;
+  }
+  if (tok.type == DotToken::Incomplete)
+  {
+    return NeedMore;
+  }
+  // a mere reference to a subgraph
+  m_lexer.pushBack();
+  m_afterSubgraph = true;
+  return Done;
+}
+
+DotParser::Result DotParser::parseAttributeStatement(DotToken::Type type)
+{
+  DotToken tok = m_lexer.next();
+  if (tok.type != DotToken::OpeningBracket)
+  {
+    return unexpected(tok);
+  }
+  m_attributes.clear();
+  Result result = parseAttributeLists(tok);
+  if (result != Done)
+  {
+    return result;
+  }
+
+  m_helper->attributed = (type == DotToken::Graph) ? "graph" : (type == DotToken::Node) ? "node" : "edge";
+  setAttributes();
+  m_helper->setattributedlist();
+  if (type == DotToken::Graph)
+  {
+    if (m_helper->z == 1) // main graph
+    {
+      m_helper->setgraphattributes();
+    }
+    else
+    {
+      m_helper->setsubgraphattributes();
+    }
+  }
+  return Done;
+}
+
+DotParser::Result DotParser::parseNodeOrEdgeStatement(const DotToken& id)
+{
+  DotToken tok = m_lexer.next();
+  if (tok.type == DotToken::Colon)
+  {
+    Result result = skipPort(tok);
+    if (result != Done)
+    {
+      return result;
+    }
+  }
+
+  if (tok.type == DotToken::EdgeOp)
+  {
+    return parseEdgeStatement(id, tok);
+  }
+
+  if (tok.type == DotToken::Equal)
+  {
+    // ID '=' ID sets an attribute of the current graph or subgraph, as with
+    // GraphViz, where the Spirit grammar ignores it
+    DotToken value = m_lexer.next();
+    if (!isIdentifier(value))
+    {
+      return unexpected(value);
+    }
+    m_attributes.clear();
+    m_attributes.push_back(Attribute(id, value));
+    m_helper->attributed = "graph";
+    setAttributes();
+    m_helper->setattributedlist();
+    if (m_helper->z == 1)
+    {
+      m_helper->setgraphattributes();
+    }
+    else
+    {
+      m_helper->setsubgraphattributes();
+    }
+    return Done;
+  }
+
+  m_attributes.clear();
+  Result result = parseAttributeLists(tok);
+  if (result != Done)
+  {
+    return result;
+  }
+
+  m_helper->createnode(m_helper->internedString(id.first, id.last));
+  m_helper->attributed = "node";
+  setAttributes();
+  m_helper->setnodeattributes();
+  return Done;
+}
+
+DotParser::Result DotParser::parseEdgeStatement(const DotToken& firstBound, DotToken tok)
+{
+  m_bounds.clear();
+  if (firstBound.type == DotToken::Identifier)
+  {
+    m_bounds.push_back(firstBound);
+  }
+  bool coherent = true;
+  while (tok.type == DotToken::EdgeOp)
+  {
+    coherent = coherent && ((tok.first[1] == '>') == m_helper->graph->directed());
+    tok = m_lexer.next();
+    if (tok.type == DotToken::Subgraph || tok.type == DotToken::OpeningBrace)
+    {
+      // the subgraph is handled as the next statement
+      m_lexer.pushBack();
+      break;
+    }
+    if (tok.type != DotToken::Identifier)
+    {
+      return unexpected(tok);
+    }
+    m_bounds.push_back(tok);
+    tok = m_lexer.next();
+    if (tok.type == DotToken::Colon)
+    {
+      Result result = skipPort(tok);
+      if (result != Done)
+      {
+        return result;
+      }
+    }
+  }
+
+  m_attributes.clear();
+  if (tok.type != DotToken::Subgraph && tok.type != DotToken::OpeningBrace)
+  {
+    Result result = parseAttributeLists(tok);
+    if (result != Done)
+    {
+      return result;
+    }
+  }
+
+  if (!coherent)
+  {
+    kError() << "Error !! uncoherent relation : directed = '" << m_helper->graph->directed() << "'";
+  }
+  if (m_bounds.empty())
+  {
+    return Done;
+  }
+  std::vector< DotToken >::const_iterator it, it_end;
+  it = m_bounds.begin(); it_end = m_bounds.end();
+  for (; it != it_end; it++)
+  {
+    m_helper->edgebound(m_helper->internedString((*it).first, (*it).last));
+  }
+  m_helper->attributed = "edge";
+  setAttributes();
+  m_helper->createedges();
+  return Done;
+}
+
+/**
+ * Reads the attributes lists starting at the lookahead token @p tok, if any.
+ * The first token following them is left for the next read.
+ */
+DotParser::Result DotParser::parseAttributeLists(DotToken tok)
+{
+  while (tok.type == DotToken::OpeningBracket)
+  {
+    Result result = parseAttributeList();
+    if (result != Done)
+    {
+      return result;
+    }
+    tok = m_lexer.next();
+  }
+  if (tok.type == DotToken::Incomplete)
+  {
+    return NeedMore;
+  }
+  m_lexer.pushBack();
+  return Done;
+}
+
+DotParser::Result DotParser::parseAttributeList()
+{
+  for (;;)
+  {
+    DotToken tok = m_lexer.next();
+    if (tok.type == DotToken::ClosingBracket)
+    {
+      return Done;
+    }
+    if (tok.type == DotToken::Comma || tok.type == DotToken::Semicolon)
+    {
+      continue;
+    }
+    if (!isIdentifier(tok))
+    {
+      return unexpected(tok);
+    }
+    DotToken key = tok;
+    tok = m_lexer.next();
+    if (tok.type == DotToken::Equal)
+    {
+      DotToken value = m_lexer.next();
+      if (!isIdentifier(value))
+      {
+        return unexpected(value);
+      }
+      m_attributes.push_back(Attribute(key, value));
+    }
+    else if (tok.type == DotToken::Incomplete)
+    {
+      return NeedMore;
+    }
+    else
+    {
+      m_attributes.push_back(Attribute(key, DotToken()));
+      m_lexer.pushBack();
+    }
+  }
+}
+
+/**
+ * Skips a port (":" ID [":" compass]) whose colon is @p tok, leaving the
+ * token following it in @p tok
+ */
+DotParser::Result DotParser::skipPort(DotToken& tok)
+{
+  for (int i = 0; i < 2 && tok.type == DotToken::Colon; i++)
+  {
+    tok = m_lexer.next();
+    if (!isIdentifier(tok))
+    {
+      return unexpected(tok);
+    }
+    tok = m_lexer.next();
+  }
+  return (tok.type == DotToken::Incomplete) ? NeedMore : Done;
+}
+
+void DotParser::openScope(const DotToken& id)
+{
+  if (id.type == DotToken::Invalid)
+  {
+    m_helper->subgraphid.clear();
+  }
+  else
+  {
+    m_helper->subgraphid.assign(id.first, id.last);
+  }
+  m_helper->createsubgraph();
+  m_helper->z++;
+  if (m_helper->z > m_helper->maxZ)
+  {
+    m_helper->maxZ = m_helper->z;
+  }
+  m_helper->pushAttrList();
+  m_scopes++;
+}
+
+void DotParser::closeScope()
+{
+  if (m_scopes == 0)
+  {
+    m_helper->finalactions();
+    m_state = Finished;
+    return;
+  }
+  m_scopes--;
+  m_helper->z--;
+  m_helper->gs = 0;
+  m_helper->popAttrList();
+  m_afterSubgraph = true;
+}
+
+void DotParser::setAttributes()
+{
+  std::vector< Attribute >::const_iterator it, it_end;
+  it = m_attributes.begin(); it_end = m_attributes.end();
+  for (; it != it_end; it++)
+  {
+    const DotToken& key = (*it).first;
+    const DotToken& value = (*it).second;
+    m_helper->addAttribute(key.first, key.last, value.first, value.last);
+  }
+}
+
+}
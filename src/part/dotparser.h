@@ -0,0 +1,156 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+/*
+ * Hand-written GraphViz dot parser working directly on the input buffer
+ */
+
+#ifndef DOT_PARSER_H
+#define DOT_PARSER_H
+
+#include <QByteArray>
+
+#include <utility>
+#include <vector>
+
+namespace KGraphViewer
+{
+
+struct DotGraphParsingHelper;
+
+/**
+ * A token of the dot language. Identifiers are ranges over the parsed
+ * buffer, without their enclosing double quotes.
+ */
+struct DotToken
+{
+  enum Type {EndOfInput, Incomplete, Invalid,
+    Identifier, Strict, Graph, Digraph, Node, Edge, Subgraph,
+    OpeningBrace, ClosingBrace, OpeningBracket, ClosingBracket,
+    Equal, Semicolon, Comma, Colon, EdgeOp};
+
+  DotToken() : type(Invalid), first(0), last(0) {}
+
+  Type type;
+  const char* first;
+  const char* last;
+};
+
+/**
+ * Splits a buffer into dot tokens. When the buffer is not known to hold the
+ * whole input, tokens reaching its end are reported as Incomplete.
+ */
+class DotLexer
+{
+public:
+  DotLexer();
+
+  void setInput(const char* first, const char* last, bool atEnd);
+
+  DotToken next();
+  /** Makes the last token returned by next() the next one again */
+  inline void pushBack() {m_pos = m_tokenStart;}
+
+  inline const char* position() const {return m_pos;}
+  inline void setPosition(const char* pos) {m_pos = pos;}
+
+private:
+  bool skipBlanks();
+  bool skipLine(const char* from);
+
+  const char* m_pos;
+  const char* m_end;
+  const char* m_tokenStart;
+  bool m_atEnd;
+};
+
+/**
+ * A recursive descent parser for the dot language, tuned for the xdot output
+ * of the GraphViz layout programs. It drives the same DotGraphParsingHelper
+ * actions as the Spirit based DotGrammar.
+ *
+ * One deliberate difference: a top level ID '=' ID statement, as in
+ * "rankdir=LR;", sets an attribute of the current graph or subgraph, as
+ * GraphViz does, while DotGrammar accepts it without any action.
+ *
+ * Statements are fully read before their actions are run, so parsing can be
+ * stopped at a statement boundary and resumed later: an input arriving piece
+ * by piece, like the output of a running layout program, is given with
+ * feed() and finish().
+ */
+class DotParser
+{
+public:
+  explicit DotParser(DotGraphParsingHelper* helper);
+
+  /** Parses the whole graph contained in [first, last) */
+  bool parse(const char* first, const char* last);
+
+  /**
+   * Parses the complete statements available after appending the given
+   * data to the input. Backslash-newline line continuations are removed on
+   * the fly and only the start of the statement not complete yet is kept.
+   * Returns false once a syntax error has been met.
+   */
+  bool feed(const char* data, int size);
+  /** Ends an input given with feed(). Returns true if it held a whole graph */
+  bool finish();
+
+private:
+  enum State {Header, Body, Finished};
+  enum Result {Done, NeedMore, Error};
+
+  typedef std::pair< DotToken, DotToken > Attribute;
+
+  bool parseBuffer(const char* first, const char* last, bool atEnd);
+  bool parseEnd();
+  Result parseUnit();
+  Result parseHeader();
+  Result parseStatement();
+  Result parseSubgraph();
+  Result parseAttributeStatement(DotToken::Type type);
+  Result parseNodeOrEdgeStatement(const DotToken& id);
+  Result parseEdgeStatement(const DotToken& firstBound, DotToken tok);
+  Result parseAttributeLists(DotToken tok);
+  Result parseAttributeList();
+  Result skipPort(DotToken& tok);
+  Result unexpected(const DotToken& tok);
+
+  void openScope(const DotToken& id);
+  void closeScope();
+  void setAttributes();
+
+  DotGraphParsingHelper* m_helper;
+  DotLexer m_lexer;
+  const char* m_input;
+  qint64 m_inputOffset;
+  State m_state;
+  unsigned int m_scopes;
+  bool m_afterSubgraph;
+
+  std::vector< Attribute > m_attributes;
+  std::vector< DotToken > m_bounds;
+
+  QByteArray m_buffer;
+  bool m_pendingBackslash;
+  bool m_failed;
+};
+
+}
+
+#endif
@@ -0,0 +1,126 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "dotrenderop.h"
+
+#include <QtAlgorithms>
+
+DotRenderOp::DotRenderOp(Opcode op, const float* data, int size, const QString& text) :
+  opcode(op),
+  renderop(nameOf(op)),
+  integers(data, size),
+  str(text)
+{
+}
+
+DotRenderOp::Opcode DotRenderOp::opcodeOf(char c)
+{
+  switch (c)
+  {
+    case 'E': return FilledEllipse;
+    case 'e': return Ellipse;
+    case 'P': return FilledPolygon;
+    case 'p': return Polygon;
+    case 'L': return Polyline;
+    case 'B': return BSpline;
+    case 'b': return FilledBSpline;
+    case 'T': return Text;
+    case 'C': return FillColor;
+    case 'c': return PenColor;
+    case 'F': return Font;
+    case 'S': return Style;
+    default: return Invalid;
+  }
+}
+
+const QString& DotRenderOp::nameOf(Opcode op)
+{
+  // in the Opcode enum order
+  static const QString names[] = {QString(),
+    QString('E'), QString('e'), QString('P'), QString('p'), QString('L'),
+    QString('B'), QString('b'), QString('T'), QString('C'), QString('c'),
+    QString('F'), QString('S')};
+  return names[op];
+}
+
+void DotRenderOpVec::append(DotRenderOp::Opcode op, const float* data, int size, const QString& text)
+{
+  // data can point into m_numbers, which may be reallocated below
+  if (size > 0 && data >= m_numbers.constData()
+      && data < m_numbers.constData() + m_numbers.size())
+  {
+    QVector< float > copy(size);
+    qCopy(data, data + size, copy.begin());
+    append(op, copy.constData(), size, text);
+    return;
+  }
+  DotPackedRenderOp packed;
+  packed.str = text;
+  packed.first = m_numbers.size();
+  packed.size = size;
+  packed.opcode = op;
+  m_ops.push_back(packed);
+  for (int i = 0; i < size; i++)
+  {
+    m_numbers.push_back(data[i]);
+  }
+}
+
+void DotRenderOpVec::append(const DotRenderOp& op)
+{
+  append(op.opcode, op.integers.begin(), op.integers.size(), op.str);
+}
+
+DotRenderOp DotRenderOpVec::at(int i) const
+{
+  const DotPackedRenderOp& packed = m_ops[i];
+  return DotRenderOp(packed.opcode, m_numbers.constData() + packed.first,
+                     packed.size, packed.str);
+}
+
+void DotRenderOpVec::clear()
+{
+  m_ops.clear();
+  m_numbers.clear();
+}
+
+void DotRenderOpVec::squeeze()
+{
+  m_ops.squeeze();
+  m_numbers.squeeze();
+}
+
+int DotRenderOpVec::memoryUsage() const
+{
+  return sizeof(DotRenderOpVec)
+      + m_ops.capacity() * sizeof(DotPackedRenderOp)
+      + m_numbers.capacity() * sizeof(float);
+}
+
+const QString& DotStringPool::intern(const char* first, const char* last)
+{
+  // the raw data key avoids a copy for strings already seen
+  QHash< QByteArray, QString >::const_iterator it =
+      m_strings.constFind(QByteArray::fromRawData(first, last - first));
+  if (it != m_strings.constEnd())
+  {
+    return *it;
+  }
+  return *m_strings.insert(QByteArray(first, last - first),
+                           QString::fromUtf8(first, last - first));
+}
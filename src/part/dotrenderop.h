@@ -19,21 +19,143 @@
 #ifndef DOT_RENDEROP_H
 #define DOT_RENDEROP_H
 
+#include <QByteArray>
+#include <QHash>
 #include <QString>
 #include <QList>
+#include <QVector>
 #include <QTextStream>
 
 /**
  * members are interpreted in function of render operations definitions given at:
  * @URL http://www.graphviz.org/cvs/doc/info/output.html#d:dot
+ *
+ * A DotRenderOp is a view on one operation of a DotRenderOpVec: it is only
+ * valid as long as the vector it comes from is not modified. The renderop,
+ * integers and str members keep the former API: integers[0] is the points
+ * count of polygons, polylines and splines, followed by their coordinates.
+ * Despite their name, the integers are stored as float since the xdot
+ * coordinates can be fractional.
  */
-struct DotRenderOp
+class DotRenderOp
 {
+public:
+  enum Opcode {Invalid,
+    FilledEllipse, Ellipse, FilledPolygon, Polygon, Polyline,
+    BSpline, FilledBSpline, Text, FillColor, PenColor, Font, Style};
+
+  /** Read-only access to the numbers of an operation */
+  class Integers
+  {
+  public:
+    typedef const float* const_iterator;
+
+    Integers(const float* data = 0, int size = 0) : m_data(data), m_size(size) {}
+
+    inline float operator[](int i) const {return m_data[i];}
+    inline float at(int i) const {return m_data[i];}
+    inline int size() const {return m_size;}
+    inline bool isEmpty() const {return m_size == 0;}
+    inline const_iterator begin() const {return m_data;}
+    inline const_iterator end() const {return m_data + m_size;}
+
+  private:
+    const float* m_data;
+    int m_size;
+  };
+
+  DotRenderOp(Opcode op = Invalid, const float* data = 0, int size = 0,
+              const QString& text = QString());
+
+  /** Returns the opcode of the xdot operation letter c, Invalid if unknown */
+  static Opcode opcodeOf(char c);
+  /** Returns the xdot letter of the given opcode as a shared string */
+  static const QString& nameOf(Opcode op);
+
+  Opcode opcode;
   QString renderop;
-  QList< int > integers;
+  Integers integers;
   QString str;
 };
 
-typedef QList< DotRenderOp > DotRenderOpVec;
+/** How a DotRenderOpVec stores each of its operations */
+struct DotPackedRenderOp
+{
+  QString str;
+  int first;
+  int size;
+  DotRenderOp::Opcode opcode;
+};
+
+Q_DECLARE_TYPEINFO(DotPackedRenderOp, Q_MOVABLE_TYPE);
+
+/**
+ * The render operations of a graph element. The numbers of all the
+ * operations are kept in one flat buffer and the strings are shared with
+ * the other operations using the same text when they were interned while
+ * parsing.
+ */
+class DotRenderOpVec
+{
+public:
+  class const_iterator
+  {
+  public:
+    const_iterator(const DotRenderOpVec* vec = 0, int index = 0) : m_vec(vec), m_index(index) {}
+
+    inline DotRenderOp operator*() const {return m_vec->at(m_index);}
+    inline const_iterator& operator++() {++m_index; return *this;}
+    inline const_iterator operator++(int) {const_iterator it(*this); ++m_index; return it;}
+    inline bool operator==(const const_iterator& other) const {return m_index == other.m_index;}
+    inline bool operator!=(const const_iterator& other) const {return m_index != other.m_index;}
+
+  private:
+    const DotRenderOpVec* m_vec;
+    int m_index;
+  };
+  typedef const_iterator iterator;
+
+  void append(DotRenderOp::Opcode op, const float* data, int size,
+              const QString& text = QString());
+  void append(const DotRenderOp& op);
+  inline void push_back(const DotRenderOp& op) {append(op);}
+
+  DotRenderOp at(int i) const;
+  inline DotRenderOp operator[](int i) const {return at(i);}
+  inline DotRenderOp::Opcode opcodeAt(int i) const {return m_ops[i].opcode;}
+
+  inline int size() const {return m_ops.size();}
+  inline bool isEmpty() const {return m_ops.isEmpty();}
+  void clear();
+  /** Releases the unused capacity of the buffers once parsing is done */
+  void squeeze();
+
+  inline const_iterator begin() const {return const_iterator(this, 0);}
+  inline const_iterator end() const {return const_iterator(this, m_ops.size());}
+  inline const_iterator constBegin() const {return begin();}
+  inline const_iterator constEnd() const {return end();}
+
+  /** The bytes allocated for the operations, not counting their shared strings */
+  int memoryUsage() const;
+
+private:
+  QVector< DotPackedRenderOp > m_ops;
+  QVector< float > m_numbers;
+};
+
+/**
+ * Shares the QString of texts met several times: identifiers, attributes
+ * names and render operations colors and fonts repeat a lot. A pool must
+ * only be used from one thread at a time.
+ */
+class DotStringPool
+{
+public:
+  /** Returns the string for the given UTF-8 bytes, converting them only once */
+  const QString& intern(const char* first, const char* last);
+
+private:
+  QHash< QByteArray, QString > m_strings;
+};
 
 #endif
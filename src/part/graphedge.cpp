@@ -29,6 +29,7 @@
 #include "graphsubgraph.h"
 #include "canvasedge.h"
 #include "dotdefaults.h"
+#include "graphmemoryusage.h"
 
 namespace KGraphViewer
 {
@@ -38,7 +39,7 @@ namespace KGraphViewer
  */
 
 GraphEdge::GraphEdge() : 
-    GraphElement(),
+    GraphElement(Edge),
     m_fromNode(0),m_toNode(0),
     m_visible(true),
     m_colors(),
@@ -64,6 +65,48 @@ GraphEdge::GraphEdge(const GraphEdge& edge) :
     m_arrowheads = edge.m_arrowheads;
 }
 
+void GraphEdge::setFromNode(GraphElement* n)
+{
+  if (m_fromNode != 0)
+  {
+    m_fromNode->m_outEdges.removeOne(this);
+  }
+  m_fromNode = n;
+  if (m_fromNode != 0)
+  {
+    m_fromNode->m_outEdges.push_back(this);
+  }
+}
+
+void GraphEdge::setToNode(GraphElement* n)
+{
+  if (m_toNode != 0)
+  {
+    m_toNode->m_inEdges.removeOne(this);
+  }
+  m_toNode = n;
+  if (m_toNode != 0)
+  {
+    m_toNode->m_inEdges.push_back(this);
+  }
+}
+
+QList<GraphEdge*> GraphEdge::takeIncidentEdges(GraphElement* element)
+{
+  QList<GraphEdge*> edges = element->m_outEdges;
+  foreach (GraphEdge* edge, element->m_inEdges)
+  {
+    // the loops are already in the leaving edges
+    if (edge->m_fromNode != element)
+    {
+      edges.push_back(edge);
+    }
+  }
+  element->m_outEdges.clear();
+  element->m_inEdges.clear();
+  return edges;
+}
+
 void GraphEdge::colors(const QString& cs)
 {
   m_colors = cs.split(':');
@@ -72,9 +115,9 @@ void GraphEdge::colors(const QString& cs)
 
 const QString GraphEdge::color(uint i) 
 {
-  if (i >= (uint)m_colors.count() && m_attributes.find("color") != m_attributes.end())
+  if (i >= (uint)m_colors.count() && hasAttribute("color"))
   {
-    colors(m_attributes["color"]);
+    colors(attribute("color"));
   }
   if (i < (uint)m_colors.count())
   {
@@ -96,70 +139,85 @@ void GraphEdge::updateWithEdge(const GraphEdge& edge)
   m_colors = edge.colors();
   m_dir = edge.dir();
   GraphElement::updateWithElement(edge);
-  if (canvasEdge())
-  {
-    canvasEdge()->computeBoundingRect();
-    canvasEdge()->modelChanged();
-  }
 }
 
 void GraphEdge::updateWithEdge(edge_t* edge)
 {
   kDebug();
-  DotRenderOpVec ops;
-  // decrease mem peak
-  setRenderOperations(ops);
-
-  if (agget(edge, (char*)"_draw_") != NULL)
-  {
-    parse_renderop(agget(edge, (char*)"_draw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
-  }
-  if (agget(edge, (char*)"_ldraw_") != NULL)
-  {
-    parse_renderop(agget(edge, (char*)"_ldraw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
-  }
-  if (agget(edge, (char*)"_hdraw_") != NULL)
+  Agsym_t *attr = agfstattr(edge);
+  while(attr)
   {
-    parse_renderop(agget(edge, (char*)"_hdraw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
+    kDebug() /*<< edge->name*/ << ":" << attr->name << agxget(edge,attr->index);
+    m_attributes[attr->name] = agxget(edge,attr->index);
+    attr = agnxtattr(edge,attr);
   }
-  if (agget(edge, (char*)"_tdraw_") != NULL)
+  invalidatePaintAttributes();
+  // decoded from the drawing attributes when first used
+  setRenderOperationsPending();
+  
+}
+
+void GraphEdge::decodeDrawingAttributes(DotStringPool* strings)
+{
+  GraphElement::decodeDrawingAttributes(strings);
+  m_arrowheads.clear();
+  if (hasAttribute("_tdraw_"))
   {
-    parse_renderop(agget(edge, (char*)"_tdraw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
+    QByteArray bytes = attribute("_tdraw_").toAscii();
+    parse_renderop(bytes.constData(), bytes.constData() + bytes.size(), m_arrowheads, strings);
   }
-  if (agget(edge, (char*)"_hldraw_") != NULL)
+  if (hasAttribute("_hdraw_"))
   {
-    parse_renderop(agget(edge, (char*)"_hldraw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
+    QByteArray bytes = attribute("_hdraw_").toAscii();
+    parse_renderop(bytes.constData(), bytes.constData() + bytes.size(), m_arrowheads, strings);
   }
-  if (agget(edge, (char*)"_tldraw_") != NULL)
+}
+
+void GraphEdge::addMemoryUsage(GraphMemoryUsage& usage) const
+{
+  GraphElement::addMemoryUsage(usage);
+  addRenderOperationsMemoryUsage(usage, m_arrowheads);
+}
+
+bool GraphEdge::layoutBoundingBox(QRectF& box) const
+{
+  QPolygonF points;
+  appendLayoutPoints(attribute("pos"), points);
+  appendLayoutPoints(attribute("lp"), points);
+  appendLayoutPoints(attribute("head_lp"), points);
+  appendLayoutPoints(attribute("tail_lp"), points);
+  if (points.isEmpty())
   {
-    parse_renderop(agget(edge, (char*)"_tldraw_"), ops);
-    kDebug() << "element renderOperations size is now " << ops.size();
+    return false;
   }
-  setRenderOperations(ops);
-  Agsym_t *attr = agfstattr(edge);
-  while(attr)
+  box = points.boundingRect();
+  return true;
+}
+
+QString GraphEdge::anonymousId(const QString& tail, const QString& head, int ordinal)
+{
+  QString id;
+  id.reserve(tail.size() + head.size() + 8);
+  id += tail;
+  id += QLatin1String("->");
+  id += head;
+  if (ordinal > 0)
   {
-    kDebug() /*<< edge->name*/ << ":" << attr->name << agxget(edge,attr->index);
-    m_attributes[attr->name] = agxget(edge,attr->index);
-    attr = agnxtattr(edge,attr);
+    id += QLatin1Char('#');
+    id += QString::number(ordinal);
   }
-  
+  return id;
 }
 
 QTextStream& operator<<(QTextStream& s, const GraphEdge& e)
 {
   QString srcLabel = e.fromNode()->id();
-  if (dynamic_cast<const GraphSubgraph*>(e.fromNode()))
+  if (e.fromNode()->kind() == GraphElement::Subgraph)
   {
     srcLabel = QString("subgraph ") + srcLabel;
   }
   QString tgtLabel = e.toNode()->id();
-  if (dynamic_cast<const GraphSubgraph*>(e.toNode()))
+  if (e.toNode()->kind() == GraphElement::Subgraph)
   {
     tgtLabel = QString("subgraph ") + tgtLabel;
   }
@@ -70,8 +70,16 @@ public:
   const GraphElement* fromNode() const { return m_fromNode; }
   const GraphElement* toNode() const { return m_toNode; }
 
-  void setFromNode(GraphElement* n) { m_fromNode = n; }
-  void setToNode(GraphElement* n) { m_toNode = n; }
+  /** Also moves the edge from the edges list of the former bound to the new one's */
+  void setFromNode(GraphElement* n);
+  void setToNode(GraphElement* n);
+
+  /**
+   * Returns the edges leaving or reaching the given node or subgraph, each
+   * one once, and empties its edges lists. The other bounds of the edges
+   * still list them, and the edges keep the given element as bound.
+   */
+  static QList<GraphEdge*> takeIncidentEdges(GraphElement* element);
 
 //   inline const QVector< QPair< float, float > >& edgePoints() const {return m_edgePoints;}
 //   inline QVector< QPair< float, float > >& edgePoints() {return m_edgePoints;}
@@ -89,12 +97,29 @@ public:
   inline const QString& dir() const {return m_dir;}
   inline void dir(const QString& dir) {m_dir = dir;}
 
-  inline QList< DotRenderOp >&  arrowheads() {return m_arrowheads;}
-  inline const QList< DotRenderOp >&  arrowheads() const {return m_arrowheads;}
+  /** Decoded from the _tdraw_ and _hdraw_ attributes with the render operations */
+  inline DotRenderOpVec&  arrowheads() {return m_arrowheads;}
+  inline const DotRenderOpVec&  arrowheads() const {return m_arrowheads;}
 
   virtual void updateWithEdge(const GraphEdge& edge);
   virtual void updateWithEdge(edge_t* edge);
 
+  /** Also counts the arrowheads */
+  virtual void addMemoryUsage(GraphMemoryUsage& usage) const;
+
+  /** The box of the spline points, the arrowheads ends and the labels positions */
+  virtual bool layoutBoundingBox(QRectF& box) const;
+
+  /**
+   * The id given to an edge without id attribute: its tail, its head and its
+   * rank among the parallel edges joining them. It does not change when the
+   * same graph is loaded again.
+   */
+  static QString anonymousId(const QString& tail, const QString& head, int ordinal);
+
+protected:
+  virtual void decodeDrawingAttributes(DotStringPool* strings);
+
 private:
   // we have a _ce *and* _from/_to because for collapsed edges,
   // only _to or _from will be unequal NULL
@@ -105,7 +130,7 @@ private:
 //   QVector< QPair< float, float > > m_edgePoints;
 //   float m_labelX, m_labelY;
   
-  QList< DotRenderOp > m_arrowheads;
+  DotRenderOpVec m_arrowheads;
 };
 
 
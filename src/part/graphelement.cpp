@@ -19,26 +19,131 @@
 #include "graphelement.h"
 #include "canvaselement.h"
 #include "dotdefaults.h"
+#include "dotgrammar.h"
+#include "dotgraph.h"
+#include "graphmemoryusage.h"
+#include "dot2qtconsts.h"
 
 #include <math.h>
 
 #include <kdebug.h>
 
+#include <QHash>
 #include <QRegExp>
+#include <QStringList>
 #include <graphviz/gvc.h>
 
 namespace KGraphViewer
 {
-  
-GraphElement::GraphElement() :
-    QObject(),
+
+// in the order used by DotGraphParsingHelper, edges ones last
+static const char* const drawingAttributes[] = {
+  "_draw_", "_ldraw_", "_hldraw_", "_tldraw_", "_tdraw_", "_hdraw_"
+};
+
+/** The attributes set by the layout programs, besides the drawing ones */
+static const char* const layoutAttributes[] = {
+  "pos", "bb", "lp", "xlp", "head_lp", "tail_lp", "width", "height", "rects"
+};
+
+static bool isLayoutAttribute(const QString& name)
+{
+  if (name.startsWith('_') && name.endsWith("draw_"))
+  {
+    return true;
+  }
+  for (unsigned int i = 0; i < sizeof(layoutAttributes) / sizeof(const char*); i++)
+  {
+    if (name == QLatin1String(layoutAttributes[i]))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Walks the attributes of an element in key order, its own attributes
+ * overriding its default ones, without merging them into a new map
+ */
+class MergedAttributesIterator
+{
+public:
+  MergedAttributesIterator(const QMap<QString,QString>& own, const QMap<QString,QString>& defaults) :
+    m_own(own.constBegin()), m_ownEnd(own.constEnd()),
+    m_default(defaults.constBegin()), m_defaultEnd(defaults.constEnd())
+  {
+  }
+
+  inline bool atEnd() const {return m_own == m_ownEnd && m_default == m_defaultEnd;}
+  inline const QString& key() const {return onOwn() ? m_own.key() : m_default.key();}
+  inline const QString& value() const {return onOwn() ? m_own.value() : m_default.value();}
+
+  void next()
+  {
+    if (onOwn())
+    {
+      if (m_default != m_defaultEnd && m_default.key() == m_own.key())
+      {
+        ++m_default;
+      }
+      ++m_own;
+    }
+    else
+    {
+      ++m_default;
+    }
+  }
+
+private:
+  inline bool onOwn() const
+  {
+    return m_own != m_ownEnd && (m_default == m_defaultEnd || !(m_default.key() < m_own.key()));
+  }
+
+  QMap<QString,QString>::const_iterator m_own, m_ownEnd;
+  QMap<QString,QString>::const_iterator m_default, m_defaultEnd;
+};
+
+GraphElementPaintAttributes::GraphElementPaintAttributes() :
+    bold(false),
+    filled(false),
+    invisible(false),
+    penStyle(Qt::SolidLine),
+    hasStyleLineWidth(false),
+    styleLineWidth(0),
+    hasPenWidth(false),
+    penWidth(0),
+    hasColor(false),
+    color(),
+    lineColor(),
+    backColor(),
+    fontColor(),
+    fontName(),
+    fontSize(0)
+{
+}
+
+GraphElement::GraphElement(Kind kind) :
     m_attributes(),
+    m_defaultAttributes(),
     m_originalAttributes(),
     m_ce(0),
+    m_kind(kind),
     m_z(1.0),
     m_renderOperations(),
     m_renderOperationsRevision(0),
-    m_selected(false)
+    m_renderOperationsPending(false),
+    m_paintAttributes(),
+    m_paintAttributesValid(false),
+    m_selected(false),
+    m_graph(0),
+    m_changeRecorded(false),
+    m_layoutHash(0),
+    m_styleHash(0),
+    m_contentHashesKnown(false),
+    m_outEdges(),
+    m_inEdges()
 {
 /*  label("");
   id("");
@@ -53,59 +158,328 @@ GraphElement::GraphElement() :
   setFontSize(DOT_DEFAULT_FONTSIZE);
 }
 
-GraphElement::GraphElement(const GraphElement& element) : QObject(),
+GraphElement::GraphElement(const GraphElement& element) :
   m_attributes(),
+  m_defaultAttributes(),
   m_originalAttributes(),
   m_ce(element.m_ce),
+  m_kind(element.m_kind),
   m_z(element.m_z),
   m_renderOperations(),
   m_renderOperationsRevision(0),
-  m_selected(element.m_selected)
+  m_renderOperationsPending(false),
+  m_paintAttributes(),
+  m_paintAttributesValid(false),
+  m_selected(element.m_selected),
+  m_graph(0),
+  m_changeRecorded(false),
+  m_layoutHash(0),
+  m_styleHash(0),
+  m_contentHashesKnown(false),
+  m_outEdges(),
+  m_inEdges()
 {
   kDebug() ;
   updateWithElement(element);
 }
 
+void GraphElement::setAttribute(const QString& name, const QString& value)
+{
+  m_attributes.insert(name, value);
+  m_paintAttributesValid = false;
+  m_contentHashesKnown = false;
+}
+
+void GraphElement::setDefaultAttributes(const QMap<QString,QString>& defaults)
+{
+  // the former defaults are kept where the new ones do not override them
+  if (!m_defaultAttributes.isEmpty() && !(m_defaultAttributes == defaults))
+  {
+    QMap<QString,QString>::const_iterator it = m_defaultAttributes.constBegin();
+    for (; it != m_defaultAttributes.constEnd(); it++)
+    {
+      if (!defaults.contains(it.key()) && !m_attributes.contains(it.key()))
+      {
+        m_attributes.insert(it.key(), it.value());
+      }
+    }
+  }
+  QMap<QString,QString>::iterator it = m_attributes.begin();
+  while (it != m_attributes.end())
+  {
+    if (defaults.contains(it.key()))
+    {
+      it = m_attributes.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  m_defaultAttributes = defaults;
+  m_paintAttributesValid = false;
+  m_contentHashesKnown = false;
+}
+
+QMap<QString,QString>& GraphElement::attributes()
+{
+  if (!m_defaultAttributes.isEmpty())
+  {
+    m_attributes = mergedAttributes();
+    m_defaultAttributes.clear();
+  }
+  m_paintAttributesValid = false;
+  m_contentHashesKnown = false;
+  return m_attributes;
+}
+
+QMap<QString,QString> GraphElement::mergedAttributes() const
+{
+  if (m_defaultAttributes.isEmpty())
+  {
+    return m_attributes;
+  }
+  QMap<QString,QString> merged = m_defaultAttributes;
+  QMap<QString,QString>::const_iterator it = m_attributes.constBegin();
+  for (; it != m_attributes.constEnd(); it++)
+  {
+    merged.insert(it.key(), it.value());
+  }
+  return merged;
+}
+
+const DotRenderOpVec& GraphElement::renderOperations() const
+{
+  if (m_renderOperationsPending)
+  {
+    const_cast<GraphElement*>(this)->decodeRenderOperations();
+  }
+  return m_renderOperations;
+}
+
 void GraphElement::setRenderOperations(const DotRenderOpVec& drov)
 {
     m_renderOperations = drov;
+    m_renderOperationsPending = false;
     ++m_renderOperationsRevision;
 }
 
+void GraphElement::setRenderOperationsPending()
+{
+  m_renderOperations.clear();
+  m_renderOperationsPending = true;
+  ++m_renderOperationsRevision;
+}
+
+void GraphElement::decodeRenderOperations(DotStringPool* strings)
+{
+  if (m_renderOperationsPending)
+  {
+    m_renderOperationsPending = false;
+    decodeDrawingAttributes(strings);
+  }
+}
+
+void GraphElement::decodeDrawingAttributes(DotStringPool* strings)
+{
+  for (unsigned int i = 0; i < sizeof(drawingAttributes) / sizeof(const char*); i++)
+  {
+    QString drawing = attribute(drawingAttributes[i]);
+    if (!drawing.isEmpty())
+    {
+      // attributes are built with fromAscii: get back the original bytes
+      QByteArray bytes = drawing.toAscii();
+      parse_renderop(bytes.constData(), bytes.constData() + bytes.size(), m_renderOperations, strings);
+    }
+  }
+  m_renderOperations.squeeze();
+}
+
+const GraphElementPaintAttributes& GraphElement::paintAttributes() const
+{
+  if (m_paintAttributesValid)
+  {
+    return m_paintAttributes;
+  }
+  GraphElementPaintAttributes& pa = const_cast<GraphElement*>(this)->m_paintAttributes;
+  const Dot2QtConsts& consts = Dot2QtConsts::componentData();
+  QString theStyle = style();
+  pa.bold = (theStyle == "bold");
+  pa.filled = (theStyle == "filled");
+  pa.invisible = (theStyle == "invis");
+  pa.penStyle = (pa.bold || pa.filled) ? Qt::SolidLine : consts.qtPenStyle(theStyle);
+  // "setlinewidth(width)"
+  pa.hasStyleLineWidth = theStyle.startsWith("setlinewidth");
+  pa.styleLineWidth = pa.hasStyleLineWidth ? theStyle.mid(13, theStyle.length()-1-13).toInt() : 0;
+  pa.hasPenWidth = hasAttribute("penwidth");
+  pa.penWidth = pa.hasPenWidth ? attribute("penwidth").toInt() : 0;
+  pa.hasColor = hasAttribute("color");
+  pa.color = pa.hasColor ? QColor(attribute("color")) : QColor();
+  pa.lineColor = consts.qtColor(lineColor());
+  pa.backColor = consts.qtColor(backColor());
+  pa.fontColor = consts.qtColor(fontColor());
+  pa.fontName = fontName();
+  pa.fontSize = fontSize();
+  const_cast<GraphElement*>(this)->m_paintAttributesValid = true;
+  return m_paintAttributes;
+}
+
+void GraphElement::contentHashes(uint& layoutHash, uint& styleHash) const
+{
+  layoutHash = 0;
+  styleHash = 0;
+  for (MergedAttributesIterator it(m_attributes, m_defaultAttributes); !it.atEnd(); it.next())
+  {
+    uint& hash = isLayoutAttribute(it.key()) ? layoutHash : styleHash;
+    hash = 31 * hash + qHash(it.key());
+    hash = 31 * hash + qHash(it.value());
+  }
+}
+
+int GraphElement::updateContentHashes(const GraphElement& element)
+{
+  uint layoutHash, styleHash;
+  element.contentHashes(layoutHash, styleHash);
+  int changes = Unchanged;
+  if (!m_contentHashesKnown || layoutHash != m_layoutHash)
+  {
+    changes |= Moved;
+  }
+  if (!m_contentHashesKnown || styleHash != m_styleHash)
+  {
+    changes |= Restyled;
+  }
+  m_layoutHash = layoutHash;
+  m_styleHash = styleHash;
+  m_contentHashesKnown = true;
+  return changes;
+}
+
+int GraphElement::attributesChanges(const QMap<QString,QString>& previous) const
+{
+  int changes = Unchanged;
+  for (MergedAttributesIterator it(m_attributes, m_defaultAttributes); !it.atEnd(); it.next())
+  {
+    QMap<QString,QString>::const_iterator before = previous.constFind(it.key());
+    if (before == previous.constEnd() || *before != it.value())
+    {
+      changes |= isLayoutAttribute(it.key()) ? Moved : Restyled;
+    }
+  }
+  QMap<QString,QString>::const_iterator it = previous.constBegin();
+  for (; it != previous.constEnd(); it++)
+  {
+    if (!hasAttribute(it.key()))
+    {
+      changes |= isLayoutAttribute(it.key()) ? Moved : Restyled;
+    }
+  }
+  return changes;
+}
+
+bool GraphElement::containsAttributes(const GraphElement& element) const
+{
+  for (MergedAttributesIterator it(element.m_attributes, element.m_defaultAttributes); !it.atEnd(); it.next())
+  {
+    if (!hasAttribute(it.key()) || attribute(it.key()) != it.value())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void GraphElement::adoptAttributes(const GraphElement& element)
+{
+  if (!(m_defaultAttributes == element.m_defaultAttributes))
+  {
+    // the attributes element does not have are kept
+    QMap<QString,QString>::const_iterator it = m_defaultAttributes.constBegin();
+    for (; it != m_defaultAttributes.constEnd(); it++)
+    {
+      if (!m_attributes.contains(it.key()) && !element.hasAttribute(it.key()))
+      {
+        m_attributes.insert(it.key(), it.value());
+      }
+    }
+    m_defaultAttributes = element.m_defaultAttributes;
+  }
+  // the values element takes from its defaults are the ones of this element
+  QMap<QString,QString>::iterator own = m_attributes.begin();
+  while (own != m_attributes.end())
+  {
+    if (m_defaultAttributes.contains(own.key()) && !element.m_attributes.contains(own.key()))
+    {
+      own = m_attributes.erase(own);
+    }
+    else
+    {
+      ++own;
+    }
+  }
+  QMap<QString,QString>::const_iterator it = element.m_attributes.constBegin();
+  for (; it != element.m_attributes.constEnd(); it++)
+  {
+    m_attributes.insert(it.key(), it.value());
+  }
+}
+
 void GraphElement::updateWithElement(const GraphElement& element)
 {
   kDebug() << element.id();
+  int changes = updateContentHashes(element);
+  if (changes == Unchanged && element.z() == m_z && containsAttributes(element))
+  {
+    return;
+  }
   bool modified = false;
   if (element.z() != m_z)
   {
     m_z = element.z();
     modified = true;
   }
-  QMap <QString, QString >::const_iterator it = element.attributes().constBegin();
-  for (;it != element.attributes().constEnd(); it++)
+  for (MergedAttributesIterator it(element.m_attributes, element.m_defaultAttributes); !it.atEnd(); it.next())
   {
     const QString &attrib = it.key();
-    if ( (!m_attributes.contains(attrib)) || (m_attributes[attrib] != it.value()) )
+    if (!hasAttribute(attrib) || attribute(attrib) != it.value())
     {
-      m_attributes[attrib] = it.value();
+      // also when the hashes of a different content collided
+      changes |= isLayoutAttribute(attrib) ? Moved : Restyled;
       if (attrib == "z")
       {
         bool ok;
-        setZ(m_attributes[attrib].toDouble(&ok));
+        setZ(it.value().toDouble(&ok));
       }
       modified = true;
     }
   }
   if (modified)
   {
+    adoptAttributes(element);
+    m_paintAttributesValid = false;
     kDebug() << "modified: update render operations";
-    setRenderOperations(element.m_renderOperations);
+    if (element.m_renderOperationsPending)
+    {
+      // decode later from the new drawing attributes only
+      for (unsigned int i = 0; i < sizeof(drawingAttributes) / sizeof(const char*); i++)
+      {
+        if (!element.hasAttribute(drawingAttributes[i]))
+        {
+          m_attributes.remove(drawingAttributes[i]);
+        }
+      }
+      setRenderOperationsPending();
+    }
+    else
+    {
+      setRenderOperations(element.m_renderOperations);
+    }
 /*    foreach (DotRenderOp op, m_renderOperations)
     {
       QString msg;
       QTextStream dd(&msg);
       dd << "an op: " << op.renderop << " ";
-      foreach (int i, op.integers)
+      foreach (float i, op.integers)
       {
         dd << i << " ";
       }
@@ -113,22 +487,21 @@ void GraphElement::updateWithElement(const GraphElement& element)
       kDebug() << msg;
     }
     kDebug() << "modified: emiting changed";*/
-    emit changed();
+    notifyChanged(changes);
   }
-  kDebug() << "done" << m_renderOperations.size();
+  kDebug() << "done" << m_renderOperations.size() << m_renderOperationsPending;
 }
 
 
 QString GraphElement::backColor() const
 {
-  if (m_attributes.find("fillcolor") != m_attributes.end())
+  if (hasAttribute("fillcolor"))
   {
-    return m_attributes["fillcolor"];
+    return attribute("fillcolor");
   }
-  else if ( (m_attributes.find("color") != m_attributes.end())
-    && (m_attributes["style"] == "filled") )
+  else if (hasAttribute("color") && attribute("style") == "filled")
   {
-    return m_attributes["color"];
+    return attribute("color");
   }
   else
   {
@@ -139,14 +512,83 @@ QString GraphElement::backColor() const
 void GraphElement::removeAttribute(const QString& attribName)
 {
   kDebug() << attribName;
-  m_attributes.remove(attribName);
-  emit changed();
+  attributes().remove(attribName);
+  m_paintAttributesValid = false;
+  m_contentHashesKnown = false;
+  notifyChanged();
+}
+
+void GraphElement::addMemoryUsage(GraphMemoryUsage& usage) const
+{
+  usage.addAttributes(GraphMemoryUsage::Attributes, m_attributes);
+  usage.addSharedAttributes(GraphMemoryUsage::Attributes, m_defaultAttributes);
+  usage.addStrings(GraphMemoryUsage::Attributes, m_originalAttributes);
+  if (!m_renderOperationsPending)
+  {
+    addRenderOperationsMemoryUsage(usage, m_renderOperations);
+  }
+  usage.add(GraphMemoryUsage::Structure, (m_outEdges.size() + m_inEdges.size()) * sizeof(GraphEdge*));
+  usage.addString(GraphMemoryUsage::Caches, m_paintAttributes.fontName);
+}
+
+void GraphElement::addRenderOperationsMemoryUsage(GraphMemoryUsage& usage, const DotRenderOpVec& operations)
+{
+  // the vector object is a member of its element
+  usage.add(GraphMemoryUsage::RenderOperations, operations.memoryUsage() - sizeof(DotRenderOpVec));
+  for (int i = 0; i < operations.size(); i++)
+  {
+    usage.addString(GraphMemoryUsage::RenderOperations, operations.at(i).str);
+  }
+}
+
+bool GraphElement::layoutBoundingBox(QRectF& box) const
+{
+  QStringList coordinates = attribute("bb").split(',');
+  if (coordinates.size() != 4)
+  {
+    return false;
+  }
+  QPolygonF corners;
+  corners << QPointF(coordinates[0].toDouble(), coordinates[1].toDouble())
+      << QPointF(coordinates[2].toDouble(), coordinates[3].toDouble());
+  box = corners.boundingRect();
+  return true;
+}
+
+void GraphElement::appendLayoutPoints(const QString& points, QPolygonF& polygon)
+{
+  static const QRegExp separators("[ ;]");
+  foreach (const QString& point, points.split(separators, QString::SkipEmptyParts))
+  {
+    QStringList coordinates = point.split(',');
+    if (coordinates.size() == 3)
+    {
+      coordinates.removeFirst();
+    }
+    bool xOk = false, yOk = false;
+    qreal x = coordinates[0].toDouble(&xOk);
+    // the positions given by the user end with a !
+    qreal y = coordinates.size() == 2 ? coordinates[1].remove('!').toDouble(&yOk) : 0;
+    if (xOk && yOk)
+    {
+      polygon << QPointF(x, y);
+    }
+  }
+}
+
+void GraphElement::notifyChanged(int changes)
+{
+  if (m_graph != 0)
+  {
+    m_graph->recordChange(this, changes);
+  }
 }
 
 void GraphElement::exportToGraphviz(void* element) const
 {
+  QMap<QString,QString> attributes = mergedAttributes();
   QMap<QString,QString>::const_iterator it, it_end;
-  it = attributes().begin(); it_end = attributes().end();
+  it = attributes.constBegin(); it_end = attributes.constEnd();
   for (;it != it_end; it++)
   {
     if (!it.value().isEmpty())
@@ -178,7 +620,8 @@ QTextStream& operator<<(QTextStream& s, const GraphElement& n)
 {
   QMap<QString,QString>::const_iterator it, it_end;
   bool firstAttr = true;
-  it = n.attributes().begin(); it_end = n.attributes().end();
+  QMap<QString,QString> attributes = n.attributes();
+  it = attributes.constBegin(); it_end = attributes.constEnd();
   for (;it != it_end; it++)
   {
     if (!it.value().isEmpty())
@@ -216,5 +659,3 @@ QTextStream& operator<<(QTextStream& s, const GraphElement& n)
 }
 
 }
-
-#include "graphelement.moc"
@@ -20,80 +20,217 @@
 #define GRAPH_ELEMENT_H
 
 #include "dotrenderop.h"
+#include "kgraphviewer_export.h"
 
+#include <QColor>
 #include <QVector>
 #include <QList>
 #include <QMap>
+#include <QPolygonF>
+#include <QRectF>
 #include <QtCore/QTextStream>
 
 namespace KGraphViewer
 {
   
 class CanvasElement;
+class DotGraph;
+class GraphMemoryUsage;
+class GraphEdge;
+
+/**
+ * The attributes read when painting an element, parsed from its attributes
+ * the first time they are needed after a change
+ */
+struct GraphElementPaintAttributes
+{
+  GraphElementPaintAttributes();
+
+  /** The style is "bold", "filled" or "invis" */
+  bool bold;
+  bool filled;
+  bool invisible;
+  /** The pen style corresponding to the style */
+  Qt::PenStyle penStyle;
+  /** If the style is "setlinewidth(width)", the line width it gives */
+  bool hasStyleLineWidth;
+  int styleLineWidth;
+  bool hasPenWidth;
+  int penWidth;
+  /** The color attribute as is, if set */
+  bool hasColor;
+  QColor color;
+  QColor lineColor;
+  QColor backColor;
+  QColor fontColor;
+  QString fontName;
+  int fontSize;
+};
 
 /**
  * The base of all GraphViz dot graph elements (nodes, edges, subgraphs,
  * graphs). It is used to store the element attributes
  */
-class GraphElement: public QObject
+class GraphElement
 {
-  Q_OBJECT
 public:
-  GraphElement();
+  /** What differs between two successive layouts of an element */
+  enum ContentChange
+  {
+    Unchanged = 0,
+    Restyled = 1, ///< attributes other than the layout ones
+    Moved = 2     ///< position, size or drawing attributes, hence render operations
+  };
+
+  /** The kind of an element, to convert it without dynamic_cast */
+  enum Kind
+  {
+    Graph,
+    Node,
+    Edge,
+    Subgraph
+  };
+
+  explicit GraphElement(Kind kind);
   GraphElement(const GraphElement& element);
   
   virtual ~GraphElement() {}
+
+  inline Kind kind() const {return m_kind;}
   
   inline void setId(const QString& id) {m_attributes["id"]=id;}
-  inline void setStyle(const QString& ls) {m_attributes["style"]=ls;}
+  inline void setStyle(const QString& ls) {m_attributes["style"]=ls; m_paintAttributesValid = false;}
   inline void setShape(const QString& lc) {m_attributes["shape"]=lc;}
-  inline void setColor(const QString& nt) {m_attributes["color"]=nt;}
-  inline void setLineColor(const QString& nt) {m_attributes["color"]=nt;}
-  inline void setBackColor(const QString& nc) {m_attributes["bgcolor"]=nc;}
+  inline void setColor(const QString& nt) {m_attributes["color"]=nt; m_paintAttributesValid = false;}
+  inline void setLineColor(const QString& nt) {m_attributes["color"]=nt; m_paintAttributesValid = false;}
+  inline void setBackColor(const QString& nc) {m_attributes["bgcolor"]=nc; m_paintAttributesValid = false;}
   
-  inline QString id() const {return m_attributes["id"];}
-  inline QString style() const {return m_attributes["style"];}
-  inline QString shape() const {return m_attributes["shape"];}
-  inline QString color() const {return m_attributes["color"];}
-  inline QString lineColor() const {return m_attributes["color"];}
+  inline QString id() const {return attribute("id");}
+  inline QString style() const {return attribute("style");}
+  inline QString shape() const {return attribute("shape");}
+  inline QString color() const {return attribute("color");}
+  inline QString lineColor() const {return attribute("color");}
   virtual QString backColor() const;
   
   inline void setLabel(const QString& label) {m_attributes["label"]=label;}
-  inline const QString label() const {return m_attributes["label"];}
+  inline const QString label() const {return attribute("label");}
 
-  inline unsigned int fontSize() const {return m_attributes["fontsize"].toUInt();}
-  inline void setFontSize(unsigned int fs) {m_attributes["fontsize"]=QString::number(fs);}
-  inline QString fontName() const {return m_attributes["fontname"];}
-  inline void setFontName(const QString& fn) {m_attributes["fontname"]=fn;}
-  inline QString fontColor() const {return m_attributes["fontcolor"];}
-  inline void setFontColor(const QString& fc) {m_attributes["fontcolor"] = fc;}
+  inline unsigned int fontSize() const {return attribute("fontsize").toUInt();}
+  inline void setFontSize(unsigned int fs) {m_attributes["fontsize"]=QString::number(fs); m_paintAttributesValid = false;}
+  inline QString fontName() const {return attribute("fontname");}
+  inline void setFontName(const QString& fn) {m_attributes["fontname"]=fn; m_paintAttributesValid = false;}
+  inline QString fontColor() const {return attribute("fontcolor");}
+  inline void setFontColor(const QString& fc) {m_attributes["fontcolor"] = fc; m_paintAttributesValid = false;}
 
-  inline const DotRenderOpVec& renderOperations() const {return m_renderOperations;};
+  /**
+   * The render operations of the element. When their decoding was deferred,
+   * they are decoded from the xdot drawing attributes by the first call.
+   */
+  const DotRenderOpVec& renderOperations() const;
   void setRenderOperations(const DotRenderOpVec& drov);
+  /**
+   * Defers the decoding of the render operations from the xdot drawing
+   * attributes (_draw_, _ldraw_, ...) until they are first used
+   */
+  void setRenderOperationsPending();
+  inline bool renderOperationsPending() const {return m_renderOperationsPending;}
+  /**
+   * Decodes the pending render operations now, sharing their strings through
+   * the given pool if any. Elements can be decoded from different threads.
+   */
+  void decodeRenderOperations(DotStringPool* strings = 0);
   /**
    * indicates the version of the render operations, gets increased everytime
-   * @c setRenderOperations gets called.
+   * @c setRenderOperations or @c setRenderOperationsPending gets called.
    */
   inline quint32 renderOperationsRevision() const {return m_renderOperationsRevision;};
 
+  /** The attributes used when painting, parsed again after each change */
+  const GraphElementPaintAttributes& paintAttributes() const;
+
   inline double z() const {return m_z;}
   inline void setZ(double thez) {m_z = thez;}
   
-  inline QString shapeFile() const {return m_attributes["shapefile"];}
+  inline QString shapeFile() const {return attribute("shapefile");}
   inline void setShapeFile(const QString& sf) {m_attributes["shapefile"] = sf;}
   
-  inline QString url() const {return m_attributes["URL"];}
+  inline QString url() const {return attribute("URL");}
   inline void setUrl(const QString& theUrl) {m_attributes["URL"] = theUrl;}
 
+  /**
+   * Merges the attributes of element, a new layout of this one, into this
+   * element. When the content hashes of element are the ones of the layout
+   * this element was last updated with, its attributes are only checked to
+   * be already there, which a hash collision would not ensure.
+   */
   virtual void updateWithElement(const GraphElement& element);
 
-  inline QMap<QString,QString>& attributes() {return m_attributes;}
-  inline const QMap<QString,QString>& attributes() const {return m_attributes;}
+  /**
+   * Hashes the layout attributes (position, size and xdot drawing
+   * attributes, from which the render operations are decoded) and the
+   * other ones
+   */
+  void contentHashes(uint& layoutHash, uint& styleHash) const;
+  /**
+   * Stores the content hashes of element, a new layout of this one, and
+   * returns the ContentChange flags telling what differs from the layout
+   * stored before
+   */
+  int updateContentHashes(const GraphElement& element);
+  /**
+   * Returns the ContentChange flags telling which attributes were added,
+   * changed or removed since the given previous ones
+   */
+  int attributesChanges(const QMap<QString,QString>& previous) const;
+
+  /**
+   * Adds the bytes used by the element besides its object: attributes,
+   * render operations, edges lists and caches
+   */
+  virtual void addMemoryUsage(GraphMemoryUsage& usage) const;
+
+  /**
+   * Sets box to the bounding box of the element in graph coordinates
+   * (points, y going up), read from its layout attributes. Returns false
+   * when the element is not laid out.
+   */
+  virtual bool layoutBoundingBox(QRectF& box) const;
+
+  /** The value of an attribute of the element, or else of its default attributes */
+  inline QString attribute(const QString& name) const
+  {
+    QMap<QString,QString>::const_iterator it = m_attributes.constFind(name);
+    return it != m_attributes.constEnd() ? *it : m_defaultAttributes.value(name);
+  }
+  inline bool hasAttribute(const QString& name) const
+  {
+    return m_attributes.contains(name) || m_defaultAttributes.contains(name);
+  }
+  /** Sets an attribute of the element itself, overriding its default */
+  void setAttribute(const QString& name, const QString& value);
+
+  /**
+   * Sets the default attributes of the element, shared with the other
+   * elements of its scope: they are the ones of its attributes that the
+   * element does not set itself. The ones set before are overridden.
+   */
+  void setDefaultAttributes(const QMap<QString,QString>& defaults);
+  inline const QMap<QString,QString>& defaultAttributes() const {return m_defaultAttributes;}
+  /** The attributes set by the element itself, over its default ones */
+  inline const QMap<QString,QString>& ownAttributes() const {return m_attributes;}
+
+  /**
+   * The attributes may be changed through the returned map. The default
+   * attributes are copied into the element first, which stops sharing them.
+   */
+  QMap<QString,QString>& attributes();
+  /** All the attributes, the default ones included */
+  inline QMap<QString,QString> attributes() const {return mergedAttributes();}
 
   inline QList<QString>& originalAttributes() {return m_originalAttributes;}
   inline const QList<QString>& originalAttributes() const {return m_originalAttributes;}
 
-  virtual inline void storeOriginalAttributes() {m_originalAttributes = m_attributes.keys();}
+  virtual inline void storeOriginalAttributes() {m_originalAttributes = mergedAttributes().keys();}
 
   virtual void removeAttribute(const QString& attribName);
 
@@ -109,22 +246,80 @@ public:
 
   void exportToGraphviz(void* element)  const;
 
-Q_SIGNALS:
-  void changed();
+  /**
+   * The graph told of the changes of this element, if any. It is set by the
+   * graph creating the element, and not copied with it.
+   */
+  inline DotGraph* graph() const {return m_graph;}
+  inline void setGraph(DotGraph* graph) {m_graph = graph;}
+
+  /** True while the element is recorded in the changes of its graph */
+  inline bool changeRecorded() const {return m_changeRecorded;}
+  inline void setChangeRecorded(bool recorded) {m_changeRecorded = recorded;}
+
+  /**
+   * The edges leaving and reaching this node or subgraph, in their creation
+   * order. They are kept by GraphEdge::setFromNode() and setToNode().
+   */
+  inline const QList<GraphEdge*>& outEdges() const {return m_outEdges;}
+  inline const QList<GraphEdge*>& inEdges() const {return m_inEdges;}
 
 protected:
+  /** Records the change of the element in its graph, if any */
+  void notifyChanged(int changes = Restyled);
+
+  /**
+   * Appends to polygon the points of a layout attribute, x,y pairs separated
+   * by spaces or semicolons, possibly prefixed by the s, or e, of edges ends
+   */
+  static void appendLayoutPoints(const QString& points, QPolygonF& polygon);
+
+  /** Adds the buffers of operations and their texts */
+  static void addRenderOperationsMemoryUsage(GraphMemoryUsage& usage, const DotRenderOpVec& operations);
+
+  /** Decodes the render operations from the drawing attributes */
+  virtual void decodeDrawingAttributes(DotStringPool* strings);
+  /** To be called after changing m_attributes directly */
+  inline void invalidatePaintAttributes() {m_paintAttributesValid = false;}
+  /** The default attributes overridden by the element ones */
+  QMap<QString,QString> KGRAPHVIEWER_EXPORT mergedAttributes() const;
+
+  /** The attributes set by the element, overriding m_defaultAttributes */
   QMap<QString,QString> m_attributes;
+  /** Implicitly shared with the other elements of the same scope */
+  QMap<QString,QString> m_defaultAttributes;
   QList<QString> m_originalAttributes;
   
   CanvasElement* m_ce;
 private:
+  /** Whether merging the attributes of element into this one would change nothing */
+  bool containsAttributes(const GraphElement& element) const;
+  /** Merges the attributes of element, taking its default attributes */
+  void adoptAttributes(const GraphElement& element);
+
+  Kind m_kind;
   double m_z;
   bool m_visible;
 
   DotRenderOpVec m_renderOperations;
   quint32 m_renderOperationsRevision;
+  bool m_renderOperationsPending;
+
+  GraphElementPaintAttributes m_paintAttributes;
+  bool m_paintAttributesValid;
 
   bool m_selected;
+
+  DotGraph* m_graph;
+  bool m_changeRecorded;
+
+  uint m_layoutHash;
+  uint m_styleHash;
+  bool m_contentHashesKnown;
+
+  friend class GraphEdge;
+  QList<GraphEdge*> m_outEdges;
+  QList<GraphEdge*> m_inEdges;
 };
 
 
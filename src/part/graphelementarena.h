@@ -0,0 +1,173 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#ifndef GRAPH_ELEMENT_ARENA_H
+#define GRAPH_ELEMENT_ARENA_H
+
+#include <QBitArray>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <new>
+
+namespace KGraphViewer
+{
+
+/**
+ * Storage of the elements of one kind of a graph: they are built next to
+ * each other in blocks of BlockSize elements, in their creation order, and
+ * all destroyed with the arena. Blocks never move, so the elements
+ * addresses stay valid until they are destroyed. The slots of the elements
+ * destroyed before the arena are reused.
+ */
+template <typename T, int BlockSize = 512>
+class GraphElementArena
+{
+public:
+  GraphElementArena() : m_blocks(), m_blocksByAddress(), m_slots(0), m_live(), m_free() {}
+  ~GraphElementArena() {clear();}
+
+  T* create()
+  {
+    return new (allocate()) T();
+  }
+
+  template <typename A>
+  T* create(const A& a)
+  {
+    return new (allocate()) T(a);
+  }
+
+  /** Destroys an element created by this arena */
+  void destroy(T* element)
+  {
+    int slot = slotOf(element);
+    if (slot < 0 || !m_live.testBit(slot))
+    {
+      return;
+    }
+    element->~T();
+    m_live.clearBit(slot);
+    m_free.push_back(slot);
+  }
+
+  /** Destroys all the elements and releases the blocks */
+  void clear()
+  {
+    for (int slot = 0; slot < m_slots; slot++)
+    {
+      if (m_live.testBit(slot))
+      {
+        address(slot)->~T();
+      }
+    }
+    foreach (T* block, m_blocks)
+    {
+      ::operator delete(block);
+    }
+    m_blocks.clear();
+    m_blocksByAddress.clear();
+    m_slots = 0;
+    m_live.clear();
+    m_free.clear();
+  }
+
+  /** Exchanges the elements of the two arenas, which do not move */
+  void swap(GraphElementArena& other)
+  {
+    qSwap(m_blocks, other.m_blocks);
+    qSwap(m_blocksByAddress, other.m_blocksByAddress);
+    qSwap(m_slots, other.m_slots);
+    qSwap(m_live, other.m_live);
+    qSwap(m_free, other.m_free);
+  }
+
+  /** The number of live elements */
+  inline int size() const {return m_slots - m_free.size();}
+
+  /** The bytes reserved by the blocks */
+  inline int memoryUsage() const {return m_blocks.size() * BlockSize * sizeof(T);}
+
+private:
+  GraphElementArena(const GraphElementArena&);
+  GraphElementArena& operator=(const GraphElementArena&);
+
+  void* allocate()
+  {
+    int slot;
+    if (!m_free.isEmpty())
+    {
+      slot = m_free.back();
+      m_free.pop_back();
+    }
+    else
+    {
+      if (m_slots == m_blocks.size() * BlockSize)
+      {
+        m_blocks.push_back(static_cast<T*>(::operator new(BlockSize * sizeof(T))));
+        BlockAddress block(reinterpret_cast<quintptr>(m_blocks.back()), m_blocks.size() - 1);
+        m_blocksByAddress.insert(qLowerBound(m_blocksByAddress.begin(), m_blocksByAddress.end(), block), block);
+        m_live.resize(m_blocks.size() * BlockSize);
+      }
+      slot = m_slots++;
+    }
+    m_live.setBit(slot);
+    return address(slot);
+  }
+
+  inline T* address(int slot) const
+  {
+    return m_blocks[slot / BlockSize] + slot % BlockSize;
+  }
+
+  /** -1 for an element not created by this arena. Only used when destroying. */
+  int slotOf(const T* element) const
+  {
+    // the block starting last at or before element
+    quintptr position = reinterpret_cast<quintptr>(element);
+    typename QVector< BlockAddress >::const_iterator it =
+        qUpperBound(m_blocksByAddress.constBegin(), m_blocksByAddress.constEnd(), BlockAddress(position, m_blocks.size()));
+    if (it == m_blocksByAddress.constBegin())
+    {
+      return -1;
+    }
+    --it;
+    quintptr offset = position - (*it).first;
+    if (offset >= BlockSize * sizeof(T) || offset % sizeof(T) != 0)
+    {
+      return -1;
+    }
+    return (*it).second * BlockSize + offset / sizeof(T);
+  }
+
+  /** The address of a block and its index in m_blocks */
+  typedef QPair< quintptr, int > BlockAddress;
+
+  QList< T* > m_blocks;
+  /** Sorted by address, to find the block of an element */
+  QVector< BlockAddress > m_blocksByAddress;
+  int m_slots;
+  QBitArray m_live;
+  QVector< int > m_free;
+};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "graphmemoryusage.h"
+
+namespace KGraphViewer
+{
+
+static const char* const categoriesNames[] = {
+  "elements", "attributes", "render operations", "structure",
+  "canvas items", "item menus", "scene index", "caches"
+};
+
+/** The reference count, size, capacity and data pointer before the characters of a string */
+static const int stringHeaderSize = 3 * sizeof(int) + sizeof(void*);
+/** The links of a map or hash node, besides its key and value */
+static const int containerNodeOverhead = 3 * sizeof(void*);
+
+GraphMemoryUsage::GraphMemoryUsage() :
+  m_countedStrings(),
+  m_countedMaps()
+{
+  for (int i = 0; i < CategoriesCount; i++)
+  {
+    m_bytes[i] = 0;
+  }
+}
+
+qint64 GraphMemoryUsage::total() const
+{
+  qint64 total = 0;
+  for (int i = 0; i < CategoriesCount; i++)
+  {
+    total += m_bytes[i];
+  }
+  return total;
+}
+
+void GraphMemoryUsage::addContainerEntries(Category category, int count, int entrySize)
+{
+  m_bytes[category] += qint64(count) * (entrySize + containerNodeOverhead);
+}
+
+void GraphMemoryUsage::addString(Category category, const QString& string)
+{
+  // the shared null and empty strings are not allocated
+  if (string.capacity() == 0 || m_countedStrings.contains(string.constData()))
+  {
+    return;
+  }
+  m_countedStrings.insert(string.constData());
+  m_bytes[category] += stringHeaderSize + (string.capacity() + 1) * sizeof(QChar);
+}
+
+void GraphMemoryUsage::addStrings(Category category, const QList<QString>& strings)
+{
+  m_bytes[category] += strings.size() * sizeof(QString);
+  foreach (const QString& string, strings)
+  {
+    addString(category, string);
+  }
+}
+
+void GraphMemoryUsage::addAttributes(Category category, const QMap<QString,QString>& attributes)
+{
+  addContainerEntries(category, attributes.size(), 2 * sizeof(QString));
+  QMap<QString,QString>::const_iterator it, it_end;
+  it = attributes.constBegin(); it_end = attributes.constEnd();
+  for (; it != it_end; it++)
+  {
+    addString(category, it.key());
+    addString(category, it.value());
+  }
+}
+
+void GraphMemoryUsage::addSharedAttributes(Category category, const QMap<QString,QString>& attributes)
+{
+  // data_ptr() does not detach: the map data identifies the shared copies
+  const void* data = const_cast<QMap<QString,QString>&>(attributes).data_ptr();
+  if (attributes.isEmpty() || m_countedMaps.contains(data))
+  {
+    return;
+  }
+  m_countedMaps.insert(data);
+  addAttributes(category, attributes);
+}
+
+const char* GraphMemoryUsage::categoryName(Category category)
+{
+  return categoriesNames[category];
+}
+
+QString GraphMemoryUsage::report() const
+{
+  QString report;
+  for (int i = 0; i < CategoriesCount; i++)
+  {
+    report += QString("%1: %2 KB\n").arg(QLatin1String(categoriesNames[i]), -18).arg(m_bytes[i] / 1024);
+  }
+  report += QString("%1: %2 KB\n").arg(QLatin1String("total"), -18).arg(total() / 1024);
+  return report;
+}
+
+}
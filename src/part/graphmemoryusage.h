@@ -0,0 +1,83 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#ifndef GRAPH_MEMORY_USAGE_H
+#define GRAPH_MEMORY_USAGE_H
+
+#include "kgraphviewer_export.h"
+
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QString>
+
+namespace KGraphViewer
+{
+
+/**
+ * The bytes used by a graph and its display, by category. They are
+ * estimated from the sizes of the objects and the element counts of the
+ * containers: the allocator overhead and the private data of the Qt objects
+ * are not counted. An implicitly shared string is counted once.
+ */
+class KGRAPHVIEWER_EXPORT GraphMemoryUsage
+{
+public:
+  enum Category
+  {
+    Elements,         ///< the nodes, edges and subgraphs objects
+    Attributes,       ///< their attributes maps, keys and values
+    RenderOperations, ///< their decoded render operations
+    Structure,        ///< elements maps and indexes, subgraphs contents, incident edges, spatial cells
+    CanvasItems,      ///< the graphics items of the elements and labels
+    ItemMenus,        ///< the popup menu and actions of each graphics item
+    SceneIndex,       ///< the BSP tree of the graphics scene
+    Caches,           ///< paint attributes, font sizes, shared fonts and edge shapes
+    CategoriesCount
+  };
+
+  GraphMemoryUsage();
+
+  inline void add(Category category, qint64 bytes) {m_bytes[category] += bytes;}
+  inline qint64 bytes(Category category) const {return m_bytes[category];}
+  qint64 total() const;
+
+  /** Counts count entries of a QMap or QHash, their keys and values taking entrySize bytes */
+  void addContainerEntries(Category category, int count, int entrySize);
+  /** Counts a string, once for all its implicitly shared copies */
+  void addString(Category category, const QString& string);
+  void addStrings(Category category, const QList<QString>& strings);
+  /** Counts a map of attributes, its keys and its values */
+  void addAttributes(Category category, const QMap<QString,QString>& attributes);
+  /** Counts an implicitly shared map of attributes, once for all its copies */
+  void addSharedAttributes(Category category, const QMap<QString,QString>& attributes);
+
+  /** The name of a category, for the reports */
+  static const char* categoryName(Category category);
+  /** One line per category, then the total */
+  QString report() const;
+
+private:
+  qint64 m_bytes[CategoriesCount];
+  QSet<const void*> m_countedStrings;
+  QSet<const void*> m_countedMaps;
+};
+
+}
+
+#endif
@@ -47,7 +47,7 @@ namespace KGraphViewer
 //
 
 GraphNode::GraphNode() :
-    GraphElement()
+    GraphElement(Node)
 {
 //   kDebug() ;
 }
@@ -58,7 +58,7 @@ GraphElement(gn)
   //   kDebug() ;
 }
 
-GraphNode::GraphNode(node_t* gn) : GraphElement()
+GraphNode::GraphNode(node_t* gn) : GraphElement(Node)
 {
   kDebug();
   updateWithNode(gn);
@@ -68,11 +68,6 @@ void GraphNode::updateWithNode(const GraphNode& node)
 {
   kDebug() << id() << node.id();
   GraphElement::updateWithElement(node);
-  if (canvasNode())
-  {
-    canvasNode()->computeBoundingRect();
-    canvasNode()->modelChanged();
-  }
 //   kDebug() << "done";
 }
 
@@ -82,23 +77,6 @@ void GraphNode::updateWithNode(node_t* node)
   m_attributes["id"] = node->name;
   m_attributes["label"] = ND_label(node)->text;
 
-  DotRenderOpVec ops;
-  // decrease mem peak
-  setRenderOperations(ops);
-
-  if (agget(node, (char*)"_draw_") != NULL)
-  {
-    parse_renderop(agget(node, (char*)"_draw_"), ops);
-    kDebug() << "_draw_: element renderOperations size is now " << ops.size();
-  }
-  if (agget(node, (char*)"_ldraw_") != NULL)
-  {
-    parse_renderop(agget(node, (char*)"_ldraw_"), ops);
-    kDebug() << "_ldraw_: element renderOperations size is now " << ops.size();
-  }
-
-  setRenderOperations(ops);
-
   Agsym_t *attr = agfstattr(node);
   while(attr)
   {
@@ -106,6 +84,23 @@ void GraphNode::updateWithNode(node_t* node)
     m_attributes[attr->name] = agxget(node,attr->index);
     attr = agnxtattr(node,attr);
   }
+  invalidatePaintAttributes();
+  // decoded from the drawing attributes when first used
+  setRenderOperationsPending();
+}
+
+bool GraphNode::layoutBoundingBox(QRectF& box) const
+{
+  QPolygonF center;
+  appendLayoutPoints(attribute("pos"), center);
+  if (center.isEmpty())
+  {
+    return false;
+  }
+  qreal width = attribute("width").toDouble() * 72;
+  qreal height = attribute("height").toDouble() * 72;
+  box = QRectF(center[0].x() - width / 2, center[0].y() - height / 2, width, height);
+  return true;
 }
 
 QTextStream& operator<<(QTextStream& s, const GraphNode& n)
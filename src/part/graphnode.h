@@ -70,6 +70,9 @@ public:
   virtual void updateWithNode(const GraphNode& node);
   virtual void updateWithNode(node_t* node);
 
+  /** The box of width and height inches centered on pos */
+  virtual bool layoutBoundingBox(QRectF& box) const;
+
   
 private:
 };
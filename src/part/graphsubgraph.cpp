@@ -22,8 +22,10 @@
 
 #include "graphsubgraph.h"
 #include "graphnode.h"
+#include "dotgraph.h"
 #include "canvassubgraph.h"
 #include "dotdefaults.h"
+#include "graphmemoryusage.h"
 
 #include <kdebug.h>
 
@@ -35,95 +37,51 @@ namespace KGraphViewer
 //
 
 GraphSubgraph::GraphSubgraph() :
-  GraphElement(), m_content()
+  GraphElement(Subgraph), m_content(), m_contentIndex()
 {
 }
 
-GraphSubgraph::GraphSubgraph(graph_t* sg) :
-  GraphElement(), m_content()
-{
-  updateWithSubgraph(sg);
-}
-
-void GraphSubgraph::updateWithSubgraph(const GraphSubgraph& subgraph)
+void GraphSubgraph::updateWithSubgraph(const GraphSubgraph& subgraph, DotGraph* graph)
 {
   kDebug() << id() << subgraph.id();
   GraphElement::updateWithElement(subgraph);
 
-  bool found = false;
   foreach (GraphElement* updatingge, subgraph.content())
   {
-    foreach (GraphElement* ge, content())
+    GraphElement* ge = contentElement(updatingge->id());
+    if (ge != 0 && ge->kind() != updatingge->kind())
     {
-      if (ge->id() == updatingge->id())
-      {
-        found = true;
-        if (dynamic_cast<GraphNode*>(ge) != 0)
-        {
-          dynamic_cast<GraphNode*>(ge)->updateWithNode(*dynamic_cast<GraphNode*>(updatingge));
-        //     kDebug() << "node " << ngn->id();
-        }
-        else if (dynamic_cast<GraphSubgraph*>(ge) != 0)
-        {
-          dynamic_cast<GraphSubgraph*>(ge)->updateWithSubgraph(*dynamic_cast<GraphSubgraph*>(updatingge));
-        }
-        else
-        {
-          kError() << "Updated element is neither a node nor a subgraph";
-        }
-        break;
-      }
+      kError() << "Updated element" << ge->id() << "changed of kind";
     }
-    if (!found)
+    else if (ge != 0 && ge->kind() == Node)
     {
-  //       kDebug() << "new";
-      if (dynamic_cast<GraphNode*>(updatingge) != 0)
-      {
-        GraphNode* newgn = new GraphNode(*dynamic_cast<GraphNode*>(updatingge));
-  //       kDebug() << "new created";
-        content().push_back(newgn);
-  //       kDebug() << "new inserted";
-      }
-      else if (dynamic_cast<GraphSubgraph*>(updatingge) != 0)
-      {
-        GraphSubgraph* newsg = new GraphSubgraph(*dynamic_cast<GraphSubgraph*>(updatingge));
-        content().push_back(newsg);
-      }
+      static_cast<GraphNode*>(ge)->updateWithNode(*static_cast<GraphNode*>(updatingge));
+    }
+    else if (ge != 0)
+    {
+      static_cast<GraphSubgraph*>(ge)->updateWithSubgraph(*static_cast<GraphSubgraph*>(updatingge), graph);
+    }
+    else if (updatingge->kind() == Node)
+    {
+      appendElement(graph->createNode(*static_cast<GraphNode*>(updatingge)));
+    }
+    else if (updatingge->kind() == Subgraph)
+    {
+      GraphSubgraph* newsg = graph->createSubgraph();
+      newsg->updateWithSubgraph(*static_cast<GraphSubgraph*>(updatingge), graph);
+      appendElement(newsg);
     }
-  }
-
-  if (canvasSubgraph())
-  {
-    canvasSubgraph()->modelChanged();
-    canvasSubgraph()->computeBoundingRect();
   }
 //   kDebug() << "done";
 }
 
-void GraphSubgraph::updateWithSubgraph(graph_t* subgraph)
+void GraphSubgraph::updateWithSubgraph(graph_t* subgraph, DotGraph* graph)
 {
   kDebug() << subgraph->name;
   m_attributes["id"] = subgraph->name;
   if (GD_label(subgraph))
     m_attributes["label"] = GD_label(subgraph)->text;
   
-  DotRenderOpVec ops;
-  // decrease mem peak
-  setRenderOperations(ops);
-
-  if (agget(subgraph, (char*)"_draw_") != NULL)
-  {
-    parse_renderop(agget(subgraph, (char*)"_draw_"), ops);
-    kDebug() << "_draw_: element renderOperations size is now " << ops.size();
-  }
-  if (agget(subgraph, (char*)"_ldraw_") != NULL)
-  {
-    parse_renderop(agget(subgraph, (char*)"_ldraw_"), ops);
-    kDebug() << "_ldraw_: element renderOperations size is now " << ops.size();
-  }
-
-  setRenderOperations(ops);
-
   Agsym_t *attr = agfstattr(subgraph);
   while(attr)
   {
@@ -131,6 +89,9 @@ void GraphSubgraph::updateWithSubgraph(graph_t* subgraph)
     m_attributes[attr->name] = agxget(subgraph,attr->index);
     attr = agnxtattr(subgraph,attr);
   }
+  invalidatePaintAttributes();
+  // decoded from the drawing attributes when first used
+  setRenderOperationsPending();
 
 
   for (edge_t* e = agfstout(subgraph->meta_node->graph, subgraph->meta_node); e;
@@ -143,7 +104,7 @@ void GraphSubgraph::updateWithSubgraph(graph_t* subgraph)
       kDebug() << "known subsubgraph";
       // ???
       //       nodes()[ngn->name]->setZ(ngn->z());
-      subgraphs()[sg->name]->updateWithSubgraph(sg);
+      subgraphs()[sg->name]->updateWithSubgraph(sg, graph);
       if (subgraphs()[sg->name]->canvasElement()!=0)
       {
         //         nodes()[ngn->id()]->canvasElement()->setGh(m_height);
@@ -152,7 +113,8 @@ void GraphSubgraph::updateWithSubgraph(graph_t* subgraph)
     else
     {
       kDebug() << "new subsubgraph";
-      GraphSubgraph* newsg = new GraphSubgraph(sg);
+      GraphSubgraph* newsg = graph->createSubgraph();
+      newsg->updateWithSubgraph(sg, graph);
       //       kDebug() << "new created";
       subgraphs().insert(sg->name, newsg);
       //       kDebug() << "new inserted";
@@ -164,21 +126,17 @@ void GraphSubgraph::updateWithSubgraph(graph_t* subgraph)
 
 QString GraphSubgraph::backColor() const
 {
-  if (m_attributes.find("bgcolor") != m_attributes.end())
+  if (hasAttribute("bgcolor"))
   {
-    return m_attributes["bgcolor"];
+    return attribute("bgcolor");
   }
-  else if ( (m_attributes.find("style") != m_attributes.end())
-    && (m_attributes["style"] == "filled")
-    && (m_attributes.find("color") != m_attributes.end()) )
+  else if (attribute("style") == "filled" && hasAttribute("color"))
   {
-    return m_attributes["color"];
+    return attribute("color");
   }
-  else if ((m_attributes.find("style") != m_attributes.end())
-    && (m_attributes["style"] == "filled")
-    && (m_attributes.find("fillcolor") != m_attributes.end()))
+  else if (attribute("style") == "filled" && hasAttribute("fillcolor"))
   {
-    return m_attributes["fillcolor"];
+    return attribute("fillcolor");
   }
   else
   {
@@ -186,23 +144,81 @@ QString GraphSubgraph::backColor() const
   }
 }
 
+void GraphSubgraph::addMemoryUsage(GraphMemoryUsage& usage) const
+{
+  GraphElement::addMemoryUsage(usage);
+  usage.add(GraphMemoryUsage::Structure, m_content.size() * sizeof(GraphElement*));
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_contentIndex.size(), sizeof(QString) + sizeof(GraphElement*));
+  usage.addContainerEntries(GraphMemoryUsage::Structure, m_subgraphsMap.size(), sizeof(QString) + sizeof(GraphSubgraph*));
+  foreach (const QString& id, m_contentIndex.keys())
+  {
+    usage.addString(GraphMemoryUsage::Structure, id);
+  }
+}
+
+void GraphSubgraph::setContent(const QList<GraphElement*>& c)
+{
+  clearContent();
+  foreach (GraphElement* element, c)
+  {
+    appendElement(element);
+  }
+}
+
+void GraphSubgraph::appendElement(GraphElement* element)
+{
+  m_content.push_back(element);
+  // the first element with an id is the one found, as when looking in the list
+  if (!m_contentIndex.contains(element->id()))
+  {
+    m_contentIndex.insert(element->id(), element);
+  }
+}
+
 void GraphSubgraph::removeElement(GraphElement* element)
 {
   m_content.removeAll(element);
+  QHash<QString, GraphElement*>::iterator it = m_contentIndex.find(element->id());
+  if (it != m_contentIndex.end() && it.value() == element)
+  {
+    m_contentIndex.erase(it);
+    foreach (GraphElement* other, m_content)
+    {
+      if (other->id() == element->id())
+      {
+        m_contentIndex.insert(other->id(), other);
+        break;
+      }
+    }
+  }
+}
+
+void GraphSubgraph::clearContent()
+{
+  m_content.clear();
+  m_contentIndex.clear();
+}
+
+GraphElement* GraphSubgraph::contentElement(const QString& id) const
+{
+  GraphElement* element = m_contentIndex.value(id, 0);
+  // an element renamed since it was added is not found under its old id
+  return (element != 0 && element->id() == id) ? element : 0;
 }
 
 GraphElement* GraphSubgraph::elementNamed(const QString& id)
 {
   if (this->id() == id) return this;
+  GraphElement* found = contentElement(id);
+  if (found != 0)
+  {
+    return found;
+  }
   foreach (GraphElement* element, content())
   {
-    if (element->id() == id)
+    if (element->kind() == Subgraph)
     {
-      return element;
-    }
-    else if (dynamic_cast<GraphSubgraph*>(element))
-    {
-      GraphElement* subgraphElement = dynamic_cast<GraphSubgraph*>(element)->elementNamed(id);
+      GraphElement* subgraphElement = static_cast<GraphSubgraph*>(element)->elementNamed(id);
       if (subgraphElement != 0)
       {
         return subgraphElement;
@@ -236,9 +252,9 @@ bool GraphSubgraph::setElementSelected(
   }
   foreach (GraphElement* el, content())
   {
-    if (dynamic_cast<GraphSubgraph*>(el) != 0)
+    if (el->kind() == Subgraph)
     {
-      bool subres = dynamic_cast<GraphSubgraph*>(el)->setElementSelected(element, selectValue, unselectOthers);
+      bool subres = static_cast<GraphSubgraph*>(el)->setElementSelected(element, selectValue, unselectOthers);
       if (!res) res = subres;
     }
     else if (element == el)
@@ -270,9 +286,9 @@ void GraphSubgraph::retrieveSelectedElementsIds(QList<QString> selection)
   }
   foreach (GraphElement* el, content())
   {
-    if (dynamic_cast<GraphSubgraph*>(el) != 0)
+    if (el->kind() == Subgraph)
     {
-      dynamic_cast<GraphSubgraph*>(el)->retrieveSelectedElementsIds(selection);
+      static_cast<GraphSubgraph*>(el)->retrieveSelectedElementsIds(selection);
     }
     else  if (el->isSelected())
     {
@@ -289,7 +305,14 @@ QTextStream& operator<<(QTextStream& s, const GraphSubgraph& sg)
     << " ] " << endl;
   foreach (const GraphElement* el, sg.content())
   {
-    s << *(dynamic_cast<const GraphNode*>(el));
+    if (el->kind() == GraphElement::Subgraph)
+    {
+      s << *static_cast<const GraphSubgraph*>(el);
+    }
+    else
+    {
+      s << *static_cast<const GraphNode*>(el);
+    }
   }
   s <<"}"<<endl;
   return s;
@@ -23,12 +23,14 @@
 #ifndef GRAPH_SUBGRAPH_H
 #define GRAPH_SUBGRAPH_H
 
+#include <QHash>
 #include <QMap>
 #include <QTextStream>
 
 #include "dotgrammar.h"
 #include "graphelement.h"
 #include "dotrenderop.h"
+#include "kgraphviewer_export.h"
 
 #include <graphviz/gvc.h>
 
@@ -38,6 +40,7 @@ namespace KGraphViewer
   
 class CanvasSubgraph;
 class GraphSubgraph;
+class DotGraph;
 
 typedef QMap<QString, GraphSubgraph*> GraphSubgraphMap;
 
@@ -50,26 +53,35 @@ class GraphSubgraph : public GraphElement
 //   Q_OBJECT
 public:
   GraphSubgraph();
-  explicit GraphSubgraph(graph_t* sg);
   
   virtual ~GraphSubgraph() {}  
 
   inline const GraphSubgraphMap& subgraphs() const {return m_subgraphsMap;}
   inline GraphSubgraphMap& subgraphs() {return m_subgraphsMap;}
   
-  void updateWithSubgraph(const GraphSubgraph& subgraph);
-  void updateWithSubgraph(graph_t* subgraph);
+  /** The elements added to this subgraph are created by graph */
+  void updateWithSubgraph(const GraphSubgraph& subgraph, DotGraph* graph);
+  void updateWithSubgraph(graph_t* subgraph, DotGraph* graph);
   
   CanvasSubgraph* canvasSubgraph() { return (CanvasSubgraph*)canvasElement();  }
   void setCanvasSubgraph(CanvasSubgraph* cs) { setCanvasElement((CanvasElement*)cs); }
 
   virtual QString backColor() const;
 
-  inline const QList<GraphElement*>& content() const {return m_content;}
-  inline QList<GraphElement*>& content() {return m_content;}
-  inline void setContent(QList<GraphElement*>& c) {m_content=c;}
+  /** Also counts the content and its index */
+  virtual void addMemoryUsage(GraphMemoryUsage& usage) const;
 
+  /**
+   * The nodes and subgraphs directly in this subgraph. It is changed by the
+   * methods below, which keep it indexed by id.
+   */
+  inline const QList<GraphElement*>& content() const {return m_content;}
+  void setContent(const QList<GraphElement*>& c);
+  void appendElement(GraphElement* element);
   void removeElement(GraphElement* element);
+  void clearContent();
+  /** The element of the content with the given id, not looked for in the nested subgraphs, or 0 */
+  GraphElement* KGRAPHVIEWER_EXPORT contentElement(const QString& id) const;
 
   /// Recursively walk through this subgraph and its subsubgraphs to find an element named id
   /// @return the node found or 0 if there is no such node
@@ -89,6 +101,7 @@ public:
   
  private:
   QList<GraphElement*> m_content;
+  QHash<QString, GraphElement*> m_contentIndex;
   GraphSubgraphMap m_subgraphsMap;
 };
 
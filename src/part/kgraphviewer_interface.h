@@ -123,6 +123,18 @@ public:
   virtual void slotSetLayoutMethod(LayoutMethod method) = 0;
   virtual void slotRenameNode(const QString& oldName, const QString& newName) = 0;
   virtual void setBackgroundColor(const QColor& color) = 0;
+  /**
+   * The estimated bytes used by the displayed graph, by category (attributes,
+   * render operations, canvas items, menus, caches...), one per line. Empty
+   * when the implementation does not report it.
+   */
+  virtual QString memoryUsageReport() const {return QString();}
+  /**
+   * The number of layouts in the cache of the layouts computed before, its
+   * size, and its hits, misses and bytes read and written since the start.
+   * Empty when the implementation has no such cache.
+   */
+  virtual QString layoutCacheReport() const {return QString();}
   
 
 protected:
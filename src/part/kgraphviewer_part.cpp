@@ -157,6 +157,16 @@ void KGraphViewerPart::setBackgroundColor(const QColor& color)
   d->m_widget->setBackgroundColor(color);
 }
 
+QString KGraphViewerPart::memoryUsageReport() const
+{
+  return d->m_widget->memoryUsage().report();
+}
+
+QString KGraphViewerPart::layoutCacheReport() const
+{
+  return d->m_widget->layoutCacheReport();
+}
+
 QList<QString> KGraphViewerPart::nodesIdsPrivate()
 {
   QList<QString> result;
@@ -62,6 +62,8 @@ public:
     virtual void zoomIn();
     virtual void zoomOut();
     virtual void setBackgroundColor(const QColor& color);
+    virtual QString memoryUsageReport() const;
+    virtual QString layoutCacheReport() const;
 
 public:
     /**
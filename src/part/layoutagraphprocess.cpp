@@ -0,0 +1,154 @@
+/*
+    This file is part of KGraphViewer.
+    Copyright (C) 2010  Gael de Chalendar <kleag@free.fr>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "layoutagraphprocess.h"
+
+#include <kdebug.h>
+#include <ktemporaryfile.h>
+
+#include <QFile>
+#include <QMetaObject>
+
+#include <stdio.h>
+
+using namespace KGraphViewer;
+
+LayoutAGraphProcess::LayoutAGraphProcess(QObject* parent) :
+  QObject(parent),
+  m_layoutCommand(),
+  m_job(),
+  m_graphFile(0),
+  m_output(),
+  m_result(0)
+{
+}
+
+LayoutAGraphProcess::~LayoutAGraphProcess()
+{
+  cancel();
+  if (m_result != 0)
+  {
+    agclose(m_result);
+  }
+}
+
+void LayoutAGraphProcess::layoutGraph(graph_t* graph, const QString& layoutCommand)
+{
+  kDebug() << layoutCommand;
+  // the newest request replaces the running one
+  cancel();
+  if (m_result != 0)
+  {
+    agclose(m_result);
+    m_result = 0;
+  }
+  m_layoutCommand = layoutCommand;
+  m_output.clear();
+
+  m_graphFile = new KTemporaryFile();
+  m_graphFile->setSuffix(".dot");
+  FILE* out = 0;
+  if (m_graphFile->open())
+  {
+    out = fopen(QFile::encodeName(m_graphFile->fileName()).data(), "w");
+  }
+  bool written = (out != 0 && agwrite(graph, out) == 0);
+  if (out != 0 && fclose(out) != 0)
+  {
+    written = false;
+  }
+  agclose(graph);
+  if (!written)
+  {
+    kError() << "Unable to write the graph to lay out to" << m_graphFile->fileName();
+    delete m_graphFile;
+    m_graphFile = 0;
+    QMetaObject::invokeMethod(this, "failed", Qt::QueuedConnection);
+    return;
+  }
+
+  m_job = LayoutService::changeable().submit(m_layoutCommand,
+                                             QStringList() << "-Txdot" << m_graphFile->fileName());
+  connect(m_job, SIGNAL(outputAvailable()), this, SLOT(slotOutputAvailable()));
+  connect(m_job, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(slotJobFinished(int,QProcess::ExitStatus)));
+  connect(m_job, SIGNAL(failed(QProcess::ProcessError)), this, SLOT(slotJobFailed(QProcess::ProcessError)));
+}
+
+void LayoutAGraphProcess::slotOutputAvailable()
+{
+  if (m_job != 0)
+  {
+    m_output.append(m_job->readOutput());
+  }
+}
+
+void LayoutAGraphProcess::slotJobFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+  Q_UNUSED(exitStatus);
+  slotOutputAvailable();
+  // the service deletes the job
+  m_job = 0;
+  delete m_graphFile;
+  m_graphFile = 0;
+  if (exitCode == 0 && !m_output.isEmpty())
+  {
+    m_result = agmemread(m_output.data());
+  }
+  if (m_result == 0)
+  {
+    m_output.clear();
+    kError() << m_layoutCommand << "layout failed";
+    emit(failed());
+    return;
+  }
+  kDebug() << m_layoutCommand << "layout done";
+  emit(finished());
+}
+
+void LayoutAGraphProcess::slotJobFailed(QProcess::ProcessError error)
+{
+  kError() << m_layoutCommand << "layout failed:" << error;
+  m_job = 0;
+  delete m_graphFile;
+  m_graphFile = 0;
+  m_output.clear();
+  emit(failed());
+}
+
+void LayoutAGraphProcess::cancel()
+{
+  if (m_job != 0)
+  {
+    kDebug() << m_layoutCommand;
+    m_job->cancel();
+    m_job = 0;
+  }
+  delete m_graphFile;
+  m_graphFile = 0;
+  m_output.clear();
+}
+
+graph_t* LayoutAGraphProcess::takeResult()
+{
+  graph_t* result = m_result;
+  m_result = 0;
+  return result;
+}
+
+#include "layoutagraphprocess.moc"
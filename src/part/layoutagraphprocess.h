@@ -0,0 +1,81 @@
+/*
+    This file is part of KGraphViewer.
+    Copyright (C) 2010  Gael de Chalendar <kleag@free.fr>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LAYOUTAGRAPHPROCESS_H
+#define LAYOUTAGRAPHPROCESS_H
+
+#include "layoutservice.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+#include <graphviz/gvc.h>
+
+class KTemporaryFile;
+
+/**
+ * Lays out a graph read with the graphviz library by running its layout
+ * program through the LayoutService on a copy of the graph written to a
+ * temporary file: a layout can be cancelled at any time by killing its
+ * process, and nothing but the program itself runs in the new process.
+ */
+class LayoutAGraphProcess : public QObject
+{
+  Q_OBJECT
+public:
+  explicit LayoutAGraphProcess(QObject* parent = 0);
+  virtual ~LayoutAGraphProcess();
+
+  /**
+   * Starts the layout of graph, closed once written for the layout program,
+   * after cancelling the layout still running, if any
+   */
+  void layoutGraph(graph_t* graph, const QString& layoutCommand);
+  /** Kills the layout running, if any: neither finished() nor failed() is emitted */
+  void cancel();
+  inline bool isRunning() const {return m_job != 0;}
+  inline const QString& layoutCommand() const {return m_layoutCommand;}
+  /**
+   * The graph with its layout attributes after finished(), to close with
+   * agclose() by the caller
+   */
+  graph_t* takeResult();
+  /** The xdot output of the last layout done, until the next one starts */
+  inline const QByteArray& xdot() const {return m_output;}
+
+Q_SIGNALS:
+  void finished();
+  void failed();
+
+private Q_SLOTS:
+  void slotOutputAvailable();
+  void slotJobFinished(int exitCode, QProcess::ExitStatus exitStatus);
+  void slotJobFailed(QProcess::ProcessError error);
+
+private:
+  QString m_layoutCommand;
+  QPointer<KGraphViewer::LayoutJob> m_job;
+  KTemporaryFile* m_graphFile;
+  QByteArray m_output;
+  graph_t* m_result;
+};
+
+#endif // LAYOUTAGRAPHPROCESS_H
@@ -0,0 +1,459 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "layoutcache.h"
+
+#include <kdebug.h>
+#include <kglobal.h>
+#include <kstandarddirs.h>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QtConcurrentRun>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <utime.h>
+#endif
+
+namespace KGraphViewer
+{
+
+/** The time given to a layout program to output its version, in ms */
+#define PROGRAMVERSIONTIMEOUT 5000
+/** The age of the part files removed even if their writer may be running, in s */
+#define PARTFILEMAXAGE (24 * 3600)
+
+static QMutex programVersionsMutex;
+/** The versions output by the layout programs, by command */
+static QHash< QString, QByteArray > programVersions;
+
+/** The version output by command -V, asked once per command */
+static QByteArray programVersion(const QString& command)
+{
+  {
+    QMutexLocker locker(&programVersionsMutex);
+    QHash< QString, QByteArray >::const_iterator it = programVersions.constFind(command);
+    if (it != programVersions.constEnd())
+    {
+      return *it;
+    }
+  }
+  // graphviz programs print their version on the error output
+  QProcess process;
+  process.setProcessChannelMode(QProcess::MergedChannels);
+  process.start(command, QStringList() << "-V");
+  if (!process.waitForFinished(PROGRAMVERSIONTIMEOUT))
+  {
+    kError() << "Unable to get the version of" << command;
+    process.kill();
+    process.waitForFinished();
+    return QByteArray();
+  }
+  QByteArray version = process.readAll().trimmed();
+  kDebug() << command << "version:" << version;
+  QMutexLocker locker(&programVersionsMutex);
+  programVersions.insert(command, version);
+  return version;
+}
+
+static QString entryPath(const QString& directory, const QByteArray& key)
+{
+  return directory + QString::fromLatin1(key) + ".xdot";
+}
+
+/**
+ * Whether a part file, named <entry>.<pid>.part, was left by an instance
+ * which ended before committing or removing it
+ */
+static bool isStalePartFile(const QFileInfo& info)
+{
+  if (info.lastModified().secsTo(QDateTime::currentDateTime()) > PARTFILEMAXAGE)
+  {
+    return true;
+  }
+#ifdef Q_OS_UNIX
+  bool ok = false;
+  pid_t pid = info.completeBaseName().section('.', -1).toInt(&ok);
+  return ok && pid != QCoreApplication::applicationPid() && kill(pid, 0) == -1 && errno == ESRCH;
+#else
+  return false;
+#endif
+}
+
+static LayoutCacheEntry lookupLayout(const QString& directory, const QString& fileName,
+                                     const QString& command, const QStringList& options,
+                                     LayoutCacheLookup::Mode mode)
+{
+  LayoutCacheEntry entry;
+  entry.key = LayoutCache::key(fileName, command, options);
+  if (entry.key.isEmpty())
+  {
+    return entry;
+  }
+  QString path = entryPath(directory, entry.key);
+  QFile file(path);
+  if (file.open(QIODevice::ReadOnly))
+  {
+    entry.layout = file.readAll();
+  }
+#ifdef Q_OS_UNIX
+  if (!entry.layout.isEmpty())
+  {
+    // the modification time orders the layouts by last use
+    utime(QFile::encodeName(path).constData(), 0);
+  }
+#endif
+  if (mode == LayoutCacheLookup::ReadGraph && !entry.layout.isEmpty())
+  {
+    entry.graph = agmemread(entry.layout.data());
+  }
+  return entry;
+}
+
+/** Closes the graph read by an abandoned lookup, waiting for it if needed */
+static void closeAbandonedGraph(QFuture< LayoutCacheEntry > lookup)
+{
+  graph_t* graph = lookup.result().graph;
+  if (graph != 0)
+  {
+    agclose(graph);
+  }
+}
+
+LayoutCache::LayoutCache() :
+  m_directory(KGlobal::dirs()->saveLocation("cache", "kgraphviewer/layouts/")),
+  m_maxSize(256 * 1024 * 1024),
+  m_size(0),
+  m_entries(0),
+  m_scanned(false),
+  m_hits(0),
+  m_misses(0),
+  m_bytesRead(0),
+  m_bytesWritten(0),
+  m_evictions(0)
+{
+}
+
+QByteArray LayoutCache::key(const QString& fileName, const QString& command, const QStringList& options)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return QByteArray();
+  }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(command.toUtf8());
+  foreach (const QString& option, options)
+  {
+    hash.addData("\0", 1);
+    hash.addData(option.toUtf8());
+  }
+  hash.addData("\0", 1);
+  // a new graphviz version may lay the same file out differently
+  hash.addData(programVersion(command));
+  hash.addData("\0\0", 2);
+  while (!file.atEnd())
+  {
+    QByteArray block = file.read(1024 * 1024);
+    if (block.isEmpty())
+    {
+      return QByteArray();
+    }
+    hash.addData(block);
+  }
+  return hash.result().toHex();
+}
+
+void LayoutCache::scan()
+{
+  if (m_scanned)
+  {
+    return;
+  }
+  m_scanned = true;
+  m_size = 0;
+  m_entries = 0;
+  foreach (const QFileInfo& info, QDir(m_directory).entryInfoList(QStringList() << "*.part", QDir::Files))
+  {
+    if (isStalePartFile(info) && QFile::remove(info.filePath()))
+    {
+      kDebug() << "removing the stale" << info.fileName();
+    }
+  }
+  foreach (const QFileInfo& info, QDir(m_directory).entryInfoList(QStringList() << "*.xdot", QDir::Files))
+  {
+    m_size += info.size();
+    m_entries++;
+  }
+  kDebug() << m_directory << ":" << m_entries << "layouts," << m_size << "bytes";
+}
+
+void LayoutCache::recordLookup(qint64 layoutSize)
+{
+  if (layoutSize == 0)
+  {
+    m_misses++;
+    return;
+  }
+  m_hits++;
+  m_bytesRead += layoutSize;
+}
+
+void LayoutCache::insert(const QByteArray& key, const QByteArray& layout)
+{
+  LayoutCacheWriter writer(key);
+  writer.write(layout);
+  writer.commit();
+}
+
+void LayoutCache::remove(const QByteArray& key)
+{
+  QFileInfo info(entryPath(m_directory, key));
+  qint64 size = info.size();
+  if (!info.exists() || !QFile::remove(info.filePath()))
+  {
+    return;
+  }
+  kDebug() << "removing" << info.fileName();
+  if (m_scanned)
+  {
+    m_size -= size;
+    m_entries--;
+  }
+}
+
+void LayoutCache::recordEntry(qint64 size, qint64 formerSize)
+{
+  if (formerSize >= 0)
+  {
+    m_size -= formerSize;
+    m_entries--;
+  }
+  if (size > 0)
+  {
+    m_size += size;
+    m_entries++;
+    m_bytesWritten += size;
+  }
+  evict();
+}
+
+void LayoutCache::evict()
+{
+  if (m_size <= m_maxSize)
+  {
+    return;
+  }
+  // the other instances may have changed the cache since the scan
+  m_scanned = false;
+  scan();
+  QFileInfoList entries = QDir(m_directory).entryInfoList(QStringList() << "*.xdot", QDir::Files,
+                                                          QDir::Time | QDir::Reversed);
+  foreach (const QFileInfo& info, entries)
+  {
+    if (m_size <= m_maxSize)
+    {
+      break;
+    }
+    if (QFile::remove(info.filePath()))
+    {
+      kDebug() << "evicting" << info.fileName();
+      m_size -= info.size();
+      m_entries--;
+      m_evictions++;
+    }
+  }
+}
+
+void LayoutCache::setMaxSize(qint64 maxSize)
+{
+  m_maxSize = qMax(maxSize, qint64(0));
+  if (m_scanned && isEnabled())
+  {
+    evict();
+  }
+}
+
+QString LayoutCache::report()
+{
+  if (isEnabled())
+  {
+    scan();
+  }
+  int lookups = m_hits + m_misses;
+  QString report;
+  report += QString("layouts: %1 (%2 KB of %3 KB)\n").arg(m_entries).arg(m_size / 1024).arg(m_maxSize / 1024);
+  report += QString("hits: %1, misses: %2 (%3% hits)\n").arg(m_hits).arg(m_misses)
+      .arg(lookups == 0 ? 0 : 100 * m_hits / lookups);
+  report += QString("read: %1 KB, written: %2 KB, evicted: %3 layouts\n")
+      .arg(m_bytesRead / 1024).arg(m_bytesWritten / 1024).arg(m_evictions);
+  return report;
+}
+
+
+
+LayoutCacheLookup::LayoutCacheLookup(const QString& fileName, const QString& command,
+                                     const QStringList& options, QObject* parent, Mode mode) :
+  QObject(parent),
+  m_watcher(),
+  m_entry(),
+  m_mode(mode),
+  m_entryRead(false)
+{
+  connect(&m_watcher, SIGNAL(finished()), this, SLOT(slotFinished()));
+  m_watcher.setFuture(QtConcurrent::run(lookupLayout, LayoutCache::changeable().directory(),
+                                        fileName, command, options, mode));
+}
+
+LayoutCacheLookup::~LayoutCacheLookup()
+{
+  // the lookup still running ends with its result unread
+  m_watcher.disconnect(this);
+  if (m_mode == ReadGraph && !m_entryRead)
+  {
+    QtConcurrent::run(closeAbandonedGraph, m_watcher.future());
+  }
+  else if (m_entry.graph != 0)
+  {
+    agclose(m_entry.graph);
+  }
+}
+
+QByteArray LayoutCacheLookup::takeLayout()
+{
+  QByteArray layout;
+  qSwap(layout, m_entry.layout);
+  return layout;
+}
+
+graph_t* LayoutCacheLookup::takeGraph()
+{
+  graph_t* graph = m_entry.graph;
+  m_entry.graph = 0;
+  return graph;
+}
+
+void LayoutCacheLookup::slotFinished()
+{
+  m_entry = m_watcher.result();
+  m_entryRead = true;
+  if (!m_entry.key.isEmpty())
+  {
+    LayoutCache::changeable().recordLookup(m_entry.layout.size());
+  }
+  emit(done());
+}
+
+
+LayoutCacheWriter::LayoutCacheWriter(const QByteArray& key) :
+  m_key(),
+  m_file(),
+  m_size(0)
+{
+  LayoutCache& cache = LayoutCache::changeable();
+  if (key.isEmpty() || !cache.isEnabled())
+  {
+    return;
+  }
+  // counts the entries before this one is added
+  cache.scan();
+  m_file.setFileName(entryPath(cache.directory(), key) + '.'
+      + QString::number(QCoreApplication::applicationPid()) + ".part");
+  if (!m_file.open(QIODevice::WriteOnly))
+  {
+    kError() << "Unable to write the layout cache entry" << m_file.fileName();
+    return;
+  }
+  m_key = key;
+}
+
+LayoutCacheWriter::~LayoutCacheWriter()
+{
+  abort();
+}
+
+void LayoutCacheWriter::write(const QByteArray& chunk)
+{
+  if (!m_file.isOpen())
+  {
+    return;
+  }
+  m_size += chunk.size();
+  if (m_size > LayoutCache::single().maxSize())
+  {
+    kDebug() << "layout too large for the cache";
+    abort();
+    return;
+  }
+  if (m_file.write(chunk) != chunk.size())
+  {
+    kError() << "Unable to write the layout cache entry" << m_file.fileName();
+    abort();
+  }
+}
+
+void LayoutCacheWriter::commit()
+{
+  if (!m_file.isOpen() || m_size == 0)
+  {
+    abort();
+    return;
+  }
+  m_file.close();
+  QString path = entryPath(LayoutCache::single().directory(), m_key);
+  QFileInfo former(path);
+  qint64 formerSize = former.exists() ? former.size() : -1;
+  if (formerSize >= 0)
+  {
+    QFile::remove(path);
+  }
+  if (!m_file.rename(path))
+  {
+    kError() << "Unable to store the layout cache entry" << path;
+    m_file.remove();
+    if (formerSize >= 0)
+    {
+      LayoutCache::changeable().recordEntry(0, formerSize);
+    }
+    return;
+  }
+  LayoutCache::changeable().recordEntry(m_size, formerSize);
+}
+
+void LayoutCacheWriter::abort()
+{
+  if (m_file.isOpen())
+  {
+    m_file.close();
+    m_file.remove();
+  }
+}
+
+}
+
+#include "layoutcache.moc"
@@ -0,0 +1,188 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#ifndef LAYOUT_CACHE_H
+#define LAYOUT_CACHE_H
+
+#include "kgraphviewer_export.h"
+#include "Singleton.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <graphviz/gvc.h>
+
+namespace KGraphViewer
+{
+
+/**
+ * The xdot layouts computed before, stored in the user cache directory
+ * under a hash of the dot file content, the layout command with its options
+ * and the graphviz version output by the command. The least recently used
+ * layouts are removed when the cache exceeds its maximum size. The cache is
+ * shared with the other running instances.
+ *
+ * The layouts are looked up in a worker thread by LayoutCacheLookup and
+ * written while they are output by LayoutCacheWriter. The cache itself is
+ * only used from the GUI thread.
+ */
+class KGRAPHVIEWER_EXPORT LayoutCache : public Singleton<LayoutCache>
+{
+  friend class Singleton<LayoutCache>;
+
+public:
+  /**
+   * The key of the layout of the dot file fileName by command with options,
+   * or an empty key when the file cannot be read. Reads and hashes the whole
+   * file and runs command -V the first time: safe in any thread.
+   */
+  static QByteArray key(const QString& fileName, const QString& command, const QStringList& options = QStringList());
+
+  /** Stores layout under key, removing the least recently used layouts if needed */
+  void insert(const QByteArray& key, const QByteArray& layout);
+  /** Removes the layout stored under key, found unreadable */
+  void remove(const QByteArray& key);
+
+  /** In bytes, 0 disabling the cache */
+  void setMaxSize(qint64 maxSize);
+  inline qint64 maxSize() const {return m_maxSize;}
+  inline bool isEnabled() const {return m_maxSize > 0;}
+
+  /** The hits, misses and bytes read and written since the start, and the cache size */
+  QString report();
+
+private:
+  friend class LayoutCacheLookup;
+  friend class LayoutCacheWriter;
+
+  LayoutCache();
+
+  inline const QString& directory() const {return m_directory;}
+  /** Records the result of a lookup, layoutSize being 0 for a miss */
+  void recordLookup(qint64 layoutSize);
+  /**
+   * Records a layout written with the given size, 0 if none, replacing one
+   * of formerSize if not negative
+   */
+  void recordEntry(qint64 size, qint64 formerSize);
+  /**
+   * Computes the cache size from its directory the first time, removing the
+   * part files left by the instances which ended while writing them
+   */
+  void scan();
+  void evict();
+
+  QString m_directory;
+  qint64 m_maxSize;
+  qint64 m_size;
+  int m_entries;
+  bool m_scanned;
+  int m_hits;
+  int m_misses;
+  qint64 m_bytesRead;
+  qint64 m_bytesWritten;
+  int m_evictions;
+};
+
+/** The key and layout found by a lookup, both empty when it failed */
+struct LayoutCacheEntry
+{
+  LayoutCacheEntry() : key(), layout(), graph(0) {}
+
+  QByteArray key;
+  QByteArray layout;
+  /** The graph read from the layout, with LayoutCacheLookup::ReadGraph */
+  graph_t* graph;
+};
+
+/**
+ * Computes the key of a layout and reads it from the LayoutCache in a
+ * worker thread, emitting done() in the thread of the object. Deleting
+ * the object before abandons the lookup.
+ */
+class KGRAPHVIEWER_EXPORT LayoutCacheLookup : public QObject
+{
+  Q_OBJECT
+public:
+  enum Mode
+  {
+    ReadLayout, ///< only reads the layout
+    ReadGraph   ///< also reads the graph from the layout with agmemread, in the worker thread
+  };
+
+  LayoutCacheLookup(const QString& fileName, const QString& command, const QStringList& options,
+                    QObject* parent = 0, Mode mode = ReadLayout);
+  /** Closes the graph read and not taken, once read if needed */
+  virtual ~LayoutCacheLookup();
+
+  /** The key of the layout after done(), empty if the file could not be read */
+  inline const QByteArray& key() const {return m_entry.key;}
+  /** The layout found after done(), empty for a miss */
+  QByteArray takeLayout();
+  /**
+   * With ReadGraph, the graph read from the layout found after done(), to
+   * be closed with agclose(), or 0 for a miss or an unreadable layout
+   */
+  graph_t* takeGraph();
+
+Q_SIGNALS:
+  void done();
+
+private Q_SLOTS:
+  void slotFinished();
+
+private:
+  QFutureWatcher< LayoutCacheEntry > m_watcher;
+  LayoutCacheEntry m_entry;
+  Mode m_mode;
+  bool m_entryRead;
+};
+
+/**
+ * Writes a layout to the LayoutCache while it is output: the chunks go to
+ * a part file renamed once the layout is committed, for the other
+ * instances not to read a partial layout. The part file is removed when
+ * the writer is destroyed without commit.
+ */
+class KGRAPHVIEWER_EXPORT LayoutCacheWriter
+{
+public:
+  /** Writes nothing if key is empty or the cache disabled */
+  explicit LayoutCacheWriter(const QByteArray& key);
+  ~LayoutCacheWriter();
+
+  /** Stops writing on errors or when the layout exceeds the cache size */
+  void write(const QByteArray& chunk);
+  /** Stores the layout written, if complete */
+  void commit();
+
+private:
+  void abort();
+
+  QByteArray m_key;
+  QFile m_file;
+  qint64 m_size;
+};
+
+}
+
+#endif
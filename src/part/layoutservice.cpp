@@ -0,0 +1,237 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#include "layoutservice.h"
+
+#include <kdebug.h>
+
+#include <QMetaObject>
+#include <QThread>
+
+namespace KGraphViewer
+{
+
+/** The period of the progress signals, in ms */
+#define LAYOUTPROGRESSPERIOD 250
+
+LayoutJob::LayoutJob(const QString& command, const QStringList& arguments, Priority priority, int timeout) :
+  QObject(),
+  m_command(command),
+  m_arguments(arguments),
+  m_priority(priority),
+  m_timeout(timeout),
+  m_status(Queued),
+  m_process(0),
+  m_output(),
+  m_bytesRead(0),
+  m_runTime(),
+  m_timeoutTimer(),
+  m_progressTimer()
+{
+  m_timeoutTimer.setSingleShot(true);
+  connect(&m_timeoutTimer, SIGNAL(timeout()), this, SLOT(slotTimeout()));
+  m_progressTimer.setInterval(LAYOUTPROGRESSPERIOD);
+  connect(&m_progressTimer, SIGNAL(timeout()), this, SLOT(slotProgress()));
+}
+
+int LayoutJob::elapsed() const
+{
+  return m_runTime.isNull() ? 0 : m_runTime.elapsed();
+}
+
+QByteArray LayoutJob::readOutput()
+{
+  QByteArray output;
+  qSwap(output, m_output);
+  return output;
+}
+
+void LayoutJob::start()
+{
+  kDebug() << "Running" << m_command << m_arguments;
+  m_status = Running;
+  m_process = new QProcess(this);
+  connect(m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(slotOutputAvailable()));
+  connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(slotFinished(int,QProcess::ExitStatus)));
+  connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(slotError(QProcess::ProcessError)));
+  m_runTime.start();
+  if (m_timeout > 0)
+  {
+    m_timeoutTimer.start(m_timeout);
+  }
+  m_progressTimer.start();
+  emit(started());
+  if (m_status == Running)
+  {
+    m_process->start(m_command, m_arguments);
+  }
+}
+
+void LayoutJob::kill()
+{
+  if (m_process == 0)
+  {
+    return;
+  }
+  m_process->disconnect(this);
+  if (m_process->state() != QProcess::NotRunning)
+  {
+    m_process->kill();
+    m_process->waitForFinished();
+  }
+}
+
+void LayoutJob::end(Status status)
+{
+  if (m_status != Queued && m_status != Running)
+  {
+    return;
+  }
+  m_status = status;
+  m_timeoutTimer.stop();
+  m_progressTimer.stop();
+  kill();
+  LayoutService::changeable().jobEnded(this);
+}
+
+void LayoutJob::cancel()
+{
+  if (m_status != Queued && m_status != Running)
+  {
+    return;
+  }
+  kDebug() << "Cancelling" << m_command << m_arguments;
+  // the users of the job forget it when cancelling it
+  disconnect();
+  end(Cancelled);
+}
+
+void LayoutJob::slotOutputAvailable()
+{
+  QByteArray chunk = m_process->readAllStandardOutput();
+  if (chunk.isEmpty())
+  {
+    return;
+  }
+  m_bytesRead += chunk.size();
+  m_output.append(chunk);
+  emit(outputAvailable());
+}
+
+void LayoutJob::slotFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+  kDebug() << m_command << "exited with" << exitCode << "after" << elapsed() << "ms";
+  slotOutputAvailable();
+  if (exitStatus == QProcess::CrashExit)
+  {
+    emit(failed(QProcess::Crashed));
+    end(Failed);
+    return;
+  }
+  emit(finished(exitCode, exitStatus));
+  end(Finished);
+}
+
+void LayoutJob::slotError(QProcess::ProcessError error)
+{
+  // a crash is reported when the program has exited
+  if (error == QProcess::Crashed)
+  {
+    return;
+  }
+  kError() << m_command << "failed:" << error;
+  emit(failed(error));
+  end(Failed);
+}
+
+void LayoutJob::slotTimeout()
+{
+  kError() << m_command << "timed out after" << m_timeout << "ms";
+  emit(failed(QProcess::Timedout));
+  end(Failed);
+}
+
+void LayoutJob::slotProgress()
+{
+  emit(progress(m_bytesRead, elapsed()));
+}
+
+
+LayoutService::LayoutService() :
+  QObject(),
+  m_queue(),
+  m_running(),
+  m_maxRunningJobs(qMax(QThread::idealThreadCount(), 1)),
+  m_startJobsScheduled(false)
+{
+}
+
+LayoutJob* LayoutService::submit(const QString& command, const QStringList& arguments,
+                                 LayoutJob::Priority priority, int timeout)
+{
+  LayoutJob* job = new LayoutJob(command, arguments, priority, timeout);
+  int i = 0;
+  while (i < m_queue.size() && m_queue[i]->priority() >= priority)
+  {
+    i++;
+  }
+  m_queue.insert(i, job);
+  kDebug() << command << "queued," << m_queue.size() << "waiting," << m_running.size() << "running";
+  scheduleStartJobs();
+  return job;
+}
+
+void LayoutService::setMaxRunningJobs(int count)
+{
+  m_maxRunningJobs = qMax(count, 1);
+  scheduleStartJobs();
+}
+
+void LayoutService::scheduleStartJobs()
+{
+  if (!m_startJobsScheduled)
+  {
+    m_startJobsScheduled = true;
+    QMetaObject::invokeMethod(this, "startJobs", Qt::QueuedConnection);
+  }
+}
+
+void LayoutService::startJobs()
+{
+  m_startJobsScheduled = false;
+  while (m_running.size() < m_maxRunningJobs && !m_queue.isEmpty())
+  {
+    LayoutJob* job = m_queue.takeFirst();
+    m_running.push_back(job);
+    job->start();
+  }
+}
+
+void LayoutService::jobEnded(LayoutJob* job)
+{
+  m_queue.removeOne(job);
+  if (m_running.removeOne(job))
+  {
+    scheduleStartJobs();
+  }
+  job->deleteLater();
+}
+
+}
+
+#include "layoutservice.moc"
@@ -0,0 +1,163 @@
+/* This file is part of KGraphViewer.
+   Copyright (C) 2010 Gael de Chalendar <kleag@free.fr>
+
+   KGraphViewer is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA
+*/
+
+#ifndef LAYOUT_SERVICE_H
+#define LAYOUT_SERVICE_H
+
+#include "kgraphviewer_export.h"
+#include "Singleton.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTime>
+#include <QTimer>
+
+namespace KGraphViewer
+{
+
+class LayoutService;
+
+/**
+ * A run of a layout program, queued by the LayoutService until one of its
+ * workers is free. The service deletes the job once it finished, failed or
+ * was cancelled: its users have to forget it in the slots connected to
+ * finished() and failed(), and when cancelling it.
+ */
+class KGRAPHVIEWER_EXPORT LayoutJob : public QObject
+{
+  Q_OBJECT
+public:
+  enum Priority {Low, Normal, High};
+  enum Status {Queued, Running, Finished, Failed, Cancelled};
+
+  inline const QString& command() const {return m_command;}
+  inline const QStringList& arguments() const {return m_arguments;}
+  inline Priority priority() const {return m_priority;}
+  /** In ms, 0 for no limit */
+  inline int timeout() const {return m_timeout;}
+  inline Status status() const {return m_status;}
+  /** The bytes output by the program until now */
+  inline qint64 bytesRead() const {return m_bytesRead;}
+  /** The ms elapsed since the program started, 0 while queued */
+  int elapsed() const;
+
+  /** Returns the output of the program not read yet */
+  QByteArray readOutput();
+
+public Q_SLOTS:
+  /**
+   * Removes the job from the queue or kills its program. The job emits no
+   * signal anymore.
+   */
+  void cancel();
+
+Q_SIGNALS:
+  void started();
+  /** Some output is ready to be read with readOutput() */
+  void outputAvailable();
+  /** Emitted periodically while the program runs */
+  void progress(qint64 bytesRead, int elapsed);
+  /** The program exited normally, the end of its output being still readable */
+  void finished(int exitCode, QProcess::ExitStatus exitStatus);
+  /** The program could not start, crashed or timed out */
+  void failed(QProcess::ProcessError error);
+
+private Q_SLOTS:
+  void slotOutputAvailable();
+  void slotFinished(int exitCode, QProcess::ExitStatus exitStatus);
+  void slotError(QProcess::ProcessError error);
+  void slotTimeout();
+  void slotProgress();
+
+private:
+  friend class LayoutService;
+
+  LayoutJob(const QString& command, const QStringList& arguments, Priority priority, int timeout);
+
+  void start();
+  void kill();
+  /** Stops the job and gives it back to the service */
+  void end(Status status);
+
+  QString m_command;
+  QStringList m_arguments;
+  Priority m_priority;
+  int m_timeout;
+  Status m_status;
+  QProcess* m_process;
+  QByteArray m_output;
+  qint64 m_bytesRead;
+  QTime m_runTime;
+  QTimer m_timeoutTimer;
+  QTimer m_progressTimer;
+};
+
+/**
+ * Runs the layout programs of all the graphs of the process, at most
+ * maxRunningJobs() at the same time. The other jobs wait in a queue, the
+ * higher priorities first, and only start in a later event loop iteration:
+ * a job cancelled before, by a reload following quickly another one, never
+ * forks a process.
+ */
+class KGRAPHVIEWER_EXPORT LayoutService :
+  public QObject,
+  public Singleton<LayoutService>
+{
+  Q_OBJECT
+  friend class Singleton<LayoutService>;
+
+public:
+  /**
+   * Queues a run of command with arguments, stopped after timeout ms if
+   * not 0. The caller connects to the job signals before returning to the
+   * event loop.
+   */
+  LayoutJob* submit(const QString& command, const QStringList& arguments,
+                    LayoutJob::Priority priority = LayoutJob::Normal, int timeout = 0);
+
+  /** The number of workers, by default the number of processors */
+  void setMaxRunningJobs(int count);
+  inline int maxRunningJobs() const {return m_maxRunningJobs;}
+  inline int runningJobsCount() const {return m_running.size();}
+  inline int queuedJobsCount() const {return m_queue.size();}
+
+private Q_SLOTS:
+  void startJobs();
+
+private:
+  friend class LayoutJob;
+
+  LayoutService();
+
+  /** Called by the jobs which were cancelled, finished or failed */
+  void jobEnded(LayoutJob* job);
+  void scheduleStartJobs();
+
+  QList< LayoutJob* > m_queue;
+  QList< LayoutJob* > m_running;
+  int m_maxRunningJobs;
+  bool m_startJobsScheduled;
+};
+
+}
+
+#endif